@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+// ====================================================================================
+// PER-ATTEMPT ARENA
+// ====================================================================================
+//
+// Transient state of one update check (manifest text and JSON pool, redirect
+// URLs, hash contexts, signature and download buffers) is bump-allocated from
+// one region reserved at link time. Scopes release everything allocated since
+// they were opened in a single step, so a failed attempt leaves nothing behind
+// and the OTA path's footprint is fixed at OTA_ARENA_SIZE.
+
+#ifndef OTA_ARENA_SIZE
+#define OTA_ARENA_SIZE (8 * 1024)
+#endif
+
+#define OTA_ARENA_ALIGN 8
+
+// Returns `size` bytes, 8-byte aligned, or nullptr if the arena is exhausted.
+void* otaArenaAlloc(size_t size);
+
+// Bytes still available.
+size_t otaArenaAvailable();
+
+// Highest use since the last otaArenaResetPeak().
+size_t otaArenaPeak();
+void otaArenaResetPeak();
+
+// Allocation failures since boot; non-zero means OTA_ARENA_SIZE is too small.
+uint32_t otaArenaFailures();
+
+// Releases, on destruction, everything allocated while the scope was open.
+// Scopes nest like function calls.
+class OtaArenaScope {
+ public:
+  OtaArenaScope();
+  ~OtaArenaScope();
+  OtaArenaScope(const OtaArenaScope&) = delete;
+  OtaArenaScope& operator=(const OtaArenaScope&) = delete;
+
+ private:
+  size_t mark;
+};
+
+// Constructs a T in the arena. Destructors are never run, so only use it for
+// types that own no other resources.
+template <typename T>
+T* otaArenaNew() {
+  static_assert(alignof(T) <= OTA_ARENA_ALIGN, "type needs stronger alignment than the arena gives");
+  void* memory = otaArenaAlloc(sizeof(T));
+  return memory == nullptr ? nullptr : new (memory) T();
+}
+
+// ArduinoJson allocator that puts a document's pool in the arena.
+struct OtaArenaJsonAllocator {
+  void* allocate(size_t size) { return otaArenaAlloc(size); }
+  void deallocate(void*) {} // released with the enclosing scope
+  void* reallocate(void*, size_t) { return nullptr; }
+};
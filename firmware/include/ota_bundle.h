@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ====================================================================================
+// UPDATE BUNDLE FORMAT
+// ====================================================================================
+//
+// A bundle carries everything needed for one update in a single stream:
+//
+//   [ header (80 bytes) ][ signature (sig_len bytes) ][ image (image_size bytes) ]
+//
+// Header layout (all integers little-endian):
+//   0   4  magic "OTAB"
+//   4   1  format version (OTA_BUNDLE_FORMAT_V1)
+//   5   1  hash algorithm (OTA_BUNDLE_HASH_SHA256)
+//   6   1  compression (OTA_BUNDLE_COMPRESSION_NONE)
+//   7   1  reserved, must be 0
+//   8   4  image size in bytes
+//   12  2  signature length in bytes
+//   14  2  reserved, must be 0
+//   16  32 firmware version, NUL padded (e.g. "1.3")
+//   48  32 digest of the image
+//
+// The signature covers the SHA-256 of the 80 header bytes, so the image is
+// authenticated through the digest it carries. Bundles are produced by
+// tools/make_bundle.py.
+
+#define OTA_BUNDLE_MAGIC "OTAB"
+#define OTA_BUNDLE_HEADER_SIZE 80
+#define OTA_BUNDLE_MAX_SIG_LEN 512
+#define OTA_BUNDLE_VERSION_LEN 32
+#define OTA_BUNDLE_DIGEST_LEN 32
+
+#define OTA_BUNDLE_FORMAT_V1 1
+#define OTA_BUNDLE_HASH_SHA256 1
+#define OTA_BUNDLE_COMPRESSION_NONE 0
+
+struct OtaBundleHeader {
+  uint8_t format;
+  uint8_t hashAlgorithm;
+  uint8_t compression;
+  uint32_t imageSize;
+  uint16_t signatureLength;
+  char version[OTA_BUNDLE_VERSION_LEN + 1];
+  uint8_t imageDigest[OTA_BUNDLE_DIGEST_LEN];
+};
+
+enum OtaBundleParseResult {
+  OTA_BUNDLE_OK = 0,
+  OTA_BUNDLE_BAD_MAGIC,
+  OTA_BUNDLE_BAD_FORMAT,
+  OTA_BUNDLE_UNSUPPORTED,
+  OTA_BUNDLE_BAD_SIZE,
+};
+
+// Decodes and sanity-checks the fixed header. `raw` must hold OTA_BUNDLE_HEADER_SIZE bytes.
+OtaBundleParseResult otaBundleParseHeader(const uint8_t* raw, OtaBundleHeader& out);
+
+// Total stream length (header + signature + image) described by a parsed header.
+size_t otaBundleTotalSize(const OtaBundleHeader& header);
@@ -0,0 +1,35 @@
+#pragma once
+
+// ====================================================================================
+// OTA ERROR CODES
+// ====================================================================================
+//
+// Reported through handleErrorState(). The names printed by otaErrorName() are
+// the strings earlier firmware printed, so existing log filters keep working.
+// Add new codes at the end: the persistent statistics keep failure counts by code.
+
+enum OtaError {
+  OTA_OK = 0,
+  OTA_ERR_CONFIG_VALIDATION_FAILED,
+  OTA_ERR_MANIFEST_FETCH_FAILED,
+  OTA_ERR_MANIFEST_PARSE_FAILED,
+  OTA_ERR_MANIFEST_INVALID,
+  OTA_ERR_MANIFEST_SIGNATURE_INVALID,
+  OTA_ERR_MANIFEST_REPLAYED,
+  OTA_ERR_FIRMWARE_DOWNLOAD_FAILED,
+  OTA_ERR_INVALID_FIRMWARE_SIZE,
+  OTA_ERR_INSUFFICIENT_SPACE,
+  OTA_ERR_FIRMWARE_WRITE_ERROR,
+  OTA_ERR_FIRMWARE_WRITE_INCOMPLETE,
+  OTA_ERR_SIGNATURE_DOWNLOAD_FAILED,
+  OTA_ERR_SIGNATURE_VERIFICATION_FAILED,
+  OTA_ERR_UPDATE_FINALIZE_FAILED,
+  OTA_ERR_BUNDLE_DOWNLOAD_FAILED,
+  OTA_ERR_BUNDLE_HEADER_INVALID,
+  OTA_ERR_BUNDLE_UNSUPPORTED,
+  OTA_ERR_BUNDLE_VERSION_MISMATCH,
+  OTA_ERR_ARENA_EXHAUSTED,
+  OTA_ERR_COUNT,
+};
+
+const char* otaErrorName(OtaError error);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include "ota_text.h"
+
+// ====================================================================================
+// OTA HTTP TRANSPORT
+// ====================================================================================
+//
+// Redirects are followed here instead of inside HTTPClient so that the resolved
+// target (e.g. the signed CDN URL behind a GitHub release asset) can be cached
+// until it expires. Later requests for the same URL go straight to the CDN,
+// skipping the extra github.com request and TLS handshake.
+//
+// Plain http:// URLs are refused unless otaHttpAllowPlainHttp(true) was called,
+// which the signed-manifest mode does: there every byte that matters is
+// covered by a signature, so artifacts can come from cacheable HTTP mirrors.
+
+#define OTA_USER_AGENT "ESP32-OTA-Client/1.0"
+
+// Maximum number of 3xx hops followed for one request
+#define OTA_MAX_REDIRECTS 5
+
+// Number of resolved redirect targets kept between requests
+#define OTA_REDIRECT_CACHE_SIZE 3
+
+// Source URLs longer than this are followed but not cached
+#define OTA_REDIRECT_SOURCE_MAX 256
+
+// Lifetime given to a redirect target whose URL carries no recognisable expiry
+#ifndef OTA_REDIRECT_DEFAULT_TTL_S
+#define OTA_REDIRECT_DEFAULT_TTL_S 60
+#endif
+
+// Cached targets are dropped this long before their signed URL expires
+#ifndef OTA_REDIRECT_EXPIRY_MARGIN_S
+#define OTA_REDIRECT_EXPIRY_MARGIN_S 30
+#endif
+
+// Returned when a request exceeds OTA_MAX_REDIRECTS
+#define OTA_HTTP_ERROR_TOO_MANY_REDIRECTS (-100)
+
+// Returned when a pinned server presents a different key
+#define OTA_HTTP_ERROR_PIN_MISMATCH (-101)
+
+// Returned for http:// URLs while plain HTTP is not allowed
+#define OTA_HTTP_ERROR_INSECURE_SCHEME (-102)
+
+// Returned when the per-attempt arena has no room for the URL buffers
+#define OTA_HTTP_ERROR_OUT_OF_MEMORY (-103)
+
+// Connections used by one update check. Requests pick the client by URL scheme.
+struct OtaSession {
+  WiFiClientSecure secure;
+  WiFiClient plain;
+  OtaFixedString<OTA_ORIGIN_MAX> secureOrigin; // Origin each client is connected to
+  OtaFixedString<OTA_ORIGIN_MAX> plainOrigin;
+};
+
+// Sets the socket timeout of both clients.
+void otaSessionSetTimeout(OtaSession& session, uint32_t timeoutMs);
+
+// Closes any open connection so that TLS session memory is released.
+void otaSessionClose(OtaSession& session);
+
+// Permits http:// URLs (signed-manifest mode only).
+void otaHttpAllowPlainHttp(bool allow);
+
+// Sends a GET for `url`, following redirects through the cache. On return the
+// response body (if any) is ready on `http`; the caller must call http.end(), or
+// otaHttpAbort() if it leaves the body unread.
+int otaHttpGet(HTTPClient& http, OtaSession& session, const char* url);
+
+// Sends `body` with a POST to `url` on the session's connections. Redirects are
+// not followed. The caller must call http.end().
+int otaHttpPost(HTTPClient& http, OtaSession& session, const char* url, const uint8_t* body, size_t length,
+                const char* contentType);
+
+// Ends a response whose body was not read to the end and closes its
+// connection. Kept alive, the unread rest of the body would be taken for the
+// next response on it, e.g. the telemetry upload after a failed check.
+void otaHttpAbort(HTTPClient& http);
+
+// Resolves and caches the redirect target of `url` with a HEAD request, without
+// fetching the body. Returns true if a target is cached afterwards.
+bool otaHttpResolve(OtaSession& session, const char* url);
+
+// Drops all cached redirect targets.
+void otaRedirectCacheClear();
+
+// Host name part of a URL, without scheme, port or path.
+OtaTextView otaUrlHost(const char* url);
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// ====================================================================================
+// BUFFERED LOGGING
+// ====================================================================================
+//
+// Serial output at 115200 baud takes ~87 us per character, which is far too
+// slow for the download loop. OTA_LOGx() instead stores the format string
+// pointer and the raw arguments in a lock-free ring buffer. A low-priority task
+// formats the records and writes them to the UART. A full ring drops the record
+// (and counts it) rather than blocking. Levels above OTA_LOG_LEVEL compile to
+// nothing, and their arguments are not evaluated; they are still type-checked,
+// so a variable used only in a log line does not warn as unused.
+//
+// Formats must be string literals. String arguments are copied into the record,
+// so arena and stack buffers may be logged safely.
+//
+// OTA_LOG_PINNED() is for the one line per update check that must reach the
+// log: it goes into a slot of its own outside the ring, whatever OTA_LOG_LEVEL
+// is, and the drain task writes it after the records queued before it. Only a
+// second pinned record written before the first has gone out is dropped.
+
+#define OTA_LOG_LEVEL_NONE 0
+#define OTA_LOG_LEVEL_ERROR 1
+#define OTA_LOG_LEVEL_WARN 2
+#define OTA_LOG_LEVEL_INFO 3
+#define OTA_LOG_LEVEL_DEBUG 4
+
+#ifndef OTA_LOG_LEVEL
+#define OTA_LOG_LEVEL OTA_LOG_LEVEL_INFO
+#endif
+
+// Number of records buffered (power of two)
+#ifndef OTA_LOG_RING_SIZE
+#define OTA_LOG_RING_SIZE 32
+#endif
+
+// Bytes of arguments per record; longer strings are truncated
+#define OTA_LOG_PAYLOAD_SIZE 80
+
+// A call the compiler checks and then drops
+#define OTA_LOG_DISCARD(format, ...) \
+  do { \
+    if (0) otaLogWrite(OTA_LOG_LEVEL_NONE, "" format "", ##__VA_ARGS__); \
+  } while (0)
+
+#define OTA_LOG_PINNED(format, ...) otaLogWritePinned(OTA_LOG_LEVEL_INFO, "" format "", ##__VA_ARGS__)
+
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_ERROR
+#define OTA_LOGE(format, ...) otaLogWrite(OTA_LOG_LEVEL_ERROR, "" format "", ##__VA_ARGS__)
+#else
+#define OTA_LOGE(format, ...) OTA_LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_WARN
+#define OTA_LOGW(format, ...) otaLogWrite(OTA_LOG_LEVEL_WARN, "" format "", ##__VA_ARGS__)
+#else
+#define OTA_LOGW(format, ...) OTA_LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_INFO
+#define OTA_LOGI(format, ...) otaLogWrite(OTA_LOG_LEVEL_INFO, "" format "", ##__VA_ARGS__)
+#else
+#define OTA_LOGI(format, ...) OTA_LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_DEBUG
+#define OTA_LOGD(format, ...) otaLogWrite(OTA_LOG_LEVEL_DEBUG, "" format "", ##__VA_ARGS__)
+#else
+#define OTA_LOGD(format, ...) OTA_LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+
+// Starts the drain task. Records logged before this are kept and written once it runs.
+bool otaLogBegin();
+
+// Writes out everything buffered from the calling task, e.g. before a restart.
+void otaLogFlush();
+
+// Records dropped because the ring was full.
+uint32_t otaLogDropped();
+
+// Unused stack of the drain task in bytes, 0 if it is not running.
+uint32_t otaLogStackHighWater();
+
+// ------------------------------------------------------------------------------------
+// Record encoding (used by the macros above)
+// ------------------------------------------------------------------------------------
+
+enum OtaLogArgType : uint8_t {
+  OTA_LOG_ARG_INT32,
+  OTA_LOG_ARG_INT64,
+  OTA_LOG_ARG_DOUBLE,
+  OTA_LOG_ARG_STRING, // NUL-terminated copy follows the tag
+  OTA_LOG_ARG_POINTER,
+};
+
+struct OtaLogRecord {
+  uint32_t timestampMs;
+  const char* format;
+  uint8_t level;
+  uint8_t length; // bytes used in payload
+  uint8_t payload[OTA_LOG_PAYLOAD_SIZE];
+
+  void put(OtaLogArgType type, const void* value, size_t size) {
+    if ((size_t)length + 1 + size > sizeof(payload)) {
+      length = sizeof(payload); // stop encoding; later arguments print as "?"
+      return;
+    }
+    payload[length++] = type;
+    memcpy(payload + length, value, size);
+    length += size;
+  }
+
+  void putString(const char* text) {
+    if (text == nullptr) text = "(null)";
+    if ((size_t)length + 2 > sizeof(payload)) {
+      length = sizeof(payload);
+      return;
+    }
+    payload[length++] = OTA_LOG_ARG_STRING;
+    size_t room = sizeof(payload) - length - 1;
+    size_t count = strnlen(text, room);
+    memcpy(payload + length, text, count);
+    length += count;
+    payload[length++] = '\0';
+  }
+};
+
+// Reserves a record; returns nullptr (and counts a drop) if the ring is full.
+OtaLogRecord* otaLogClaim(uint8_t level, const char* format, uint32_t& ticket);
+
+// Hands a claimed record to the drain task.
+void otaLogPublish(uint32_t ticket);
+
+// Reserves the pinned slot; returns nullptr (and counts a drop) if it is still taken.
+OtaLogRecord* otaLogClaimPinned(uint8_t level, const char* format);
+
+// Hands the pinned record to the drain task.
+void otaLogPublishPinned();
+
+template <typename T>
+inline void otaLogEncodeArg(OtaLogRecord& record, T value) {
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "unsupported log argument type");
+  if (std::is_floating_point<T>::value) {
+    double number = (double)value;
+    record.put(OTA_LOG_ARG_DOUBLE, &number, sizeof(number));
+  } else if (sizeof(T) > 4) {
+    int64_t number = (int64_t)value;
+    record.put(OTA_LOG_ARG_INT64, &number, sizeof(number));
+  } else {
+    int32_t number = (int32_t)value;
+    record.put(OTA_LOG_ARG_INT32, &number, sizeof(number));
+  }
+}
+
+template <typename T>
+inline void otaLogEncodeArg(OtaLogRecord& record, T* pointer) {
+  const void* value = pointer;
+  record.put(OTA_LOG_ARG_POINTER, &value, sizeof(value));
+}
+
+inline void otaLogEncodeArg(OtaLogRecord& record, const char* text) { record.putString(text); }
+inline void otaLogEncodeArg(OtaLogRecord& record, char* text) { record.putString(text); }
+
+template <typename... Args>
+inline void otaLogEncodeArgs(OtaLogRecord& record, Args... args) {
+  int expand[] = {0, (otaLogEncodeArg(record, args), 0)...};
+  (void)expand;
+}
+
+template <typename... Args>
+void otaLogWrite(uint8_t level, const char* format, Args... args) {
+  uint32_t ticket;
+  OtaLogRecord* record = otaLogClaim(level, format, ticket);
+  if (record == nullptr) return;
+  otaLogEncodeArgs(*record, args...);
+  otaLogPublish(ticket);
+}
+
+template <typename... Args>
+void otaLogWritePinned(uint8_t level, const char* format, Args... args) {
+  OtaLogRecord* record = otaLogClaimPinned(level, format);
+  if (record == nullptr) return;
+  otaLogEncodeArgs(*record, args...);
+  otaLogPublishPinned();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct OtaAttemptStats;
+
+// ====================================================================================
+// PROMETHEUS METRICS ENDPOINT
+// ====================================================================================
+//
+// Build with -DOTA_METRICS_PORT=9100 (any non-zero port) to serve cumulative
+// OTA counters and histograms at http://<device>:<port>/metrics in Prometheus
+// text format. The server runs in its own low-priority task and renders each
+// response into a fixed buffer. The OTA task only copies its finished attempt
+// into the totals under a short spinlock, so a slow or stalled scraper never
+// delays an update. Totals start from zero at every boot.
+
+#ifndef OTA_METRICS_PORT
+#define OTA_METRICS_PORT 0
+#endif
+
+// Size of the response buffer; a response that does not fit is cut at a line end
+#ifndef OTA_METRICS_BUFFER_SIZE
+#define OTA_METRICS_BUFFER_SIZE 8192
+#endif
+
+// Upper bounds (ms) of the per-stage latency histogram buckets
+#define OTA_METRICS_LATENCY_BUCKETS_MS {50, 100, 250, 500, 1000, 5000, 15000, 60000}
+
+// Starts the server task; it waits for WiFi before listening. `firmwareVersion`
+// must stay valid. Does nothing when OTA_METRICS_PORT is 0.
+bool otaMetricsBegin(const char* firmwareVersion);
+
+// Adds a finished update check to the totals.
+void otaMetricsRecordAttempt(const OtaAttemptStats& attempt);
+
+// Renders all metrics into `out`; returns the length written. Exposed so the
+// output can be checked without a network.
+size_t otaMetricsRender(char* out, size_t size);
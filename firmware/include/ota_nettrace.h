@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Print;
+
+// ====================================================================================
+// NETWORK TRACE
+// ====================================================================================
+//
+// Build with -DOTA_NET_TRACE=1 to record when the image bytes of each download
+// arrive: streamImageToFlash() notes the time and size of every read in a
+// fixed RAM buffer. After each check the trace is written to the serial port
+// in base64 between "=== OTA NETTRACE BEGIN ===" and "=== OTA NETTRACE END ===";
+// tools/extract_trace.py cuts it out into a .otnt file, and the native_replay
+// program plays it back into the download path. Without the flag the calls
+// compile to nothing.
+//
+// File layout (little-endian):
+//   0   4  magic "OTNT"
+//   4   1  format version (1)
+//   5   1  flags (OTA_NET_TRACE_TRUNCATED: the buffer filled up first)
+//   6   2  reserved, 0
+//   8   4  image length
+//   12  4  bytes recorded
+//   16  4  round trip estimate from the attempt's connects, us
+//   20  4  record count
+//   24     records: LEB128 microseconds since the previous read (the first
+//          since the download started), then LEB128 byte count
+//
+// A read sees bytes when they are waiting, so a device that was busy writing
+// flash records them late; the trace includes its own pipeline's back-pressure.
+
+#ifndef OTA_NET_TRACE
+#define OTA_NET_TRACE 0
+#endif
+
+// Encoded records kept per download; a record takes 3-5 bytes
+#ifndef OTA_NET_TRACE_BUFFER_SIZE
+#define OTA_NET_TRACE_BUFFER_SIZE 8192
+#endif
+
+#define OTA_NET_TRACE_MAGIC "OTNT"
+#define OTA_NET_TRACE_FORMAT_V1 1
+#define OTA_NET_TRACE_HEADER_SIZE 24
+#define OTA_NET_TRACE_TRUNCATED 0x01
+
+#if OTA_NET_TRACE
+
+// Starts a trace for a download of `imageLength` bytes, dropping the last one.
+void otaNetTraceBegin(size_t imageLength);
+
+// Records a read of `bytes` bytes.
+void otaNetTraceArrival(size_t bytes);
+
+// Writes the trace of the last download, if one was recorded since the
+// previous export, framed by the BEGIN and END lines.
+void otaNetTraceExport(Print& out, uint32_t rttUs);
+
+#define OTA_NET_TRACE_BEGIN(imageLength) otaNetTraceBegin(imageLength)
+#define OTA_NET_TRACE_ARRIVAL(bytes) otaNetTraceArrival(bytes)
+
+#else
+
+#define OTA_NET_TRACE_BEGIN(imageLength) do {} while (0)
+#define OTA_NET_TRACE_ARRIVAL(bytes) do {} while (0)
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+// ====================================================================================
+// HOT-PATH CYCLE PROBES
+// ====================================================================================
+//
+// Build with -DOTA_PROFILE=1 to time the network read, flash write and SHA-256
+// update of every download chunk with the CPU cycle counter. Each probe keeps
+// a fixed log-linear histogram (four buckets per power of two, so percentiles
+// are within 25%). The summary is printed with every attempt report. Without
+// the flag the probes compile to nothing.
+
+#ifndef OTA_PROFILE
+#define OTA_PROFILE 0
+#endif
+
+enum OtaProbeId {
+  OTA_PROBE_NET_READ,    // stream->readBytes()
+  OTA_PROBE_FLASH_WRITE, // Update.write()
+  OTA_PROBE_SHA256,      // mbedtls_sha256_update_ret()
+  OTA_PROBE_COUNT,
+};
+
+// Clears all probes; called at the start of each attempt.
+void otaProfileReset();
+
+// Logs calls, min/avg/p99/max cycles and the average in microseconds per probe.
+void otaProfileReport();
+
+#if OTA_PROFILE
+
+void otaProfileRecord(OtaProbeId id, uint32_t cycles);
+uint32_t otaProfileCycles();
+
+// Times the rest of the enclosing block
+class OtaProbeScope {
+ public:
+  explicit OtaProbeScope(OtaProbeId id) : id(id), start(otaProfileCycles()) {}
+  ~OtaProbeScope() { otaProfileRecord(id, otaProfileCycles() - start); }
+  OtaProbeScope(const OtaProbeScope&) = delete;
+  OtaProbeScope& operator=(const OtaProbeScope&) = delete;
+
+ private:
+  OtaProbeId id;
+  uint32_t start;
+};
+
+#define OTA_PROBE_CONCAT_(a, b) a##b
+#define OTA_PROBE_CONCAT(a, b) OTA_PROBE_CONCAT_(a, b)
+#define OTA_PROBE_SCOPE(id) OtaProbeScope OTA_PROBE_CONCAT(otaProbe, __LINE__)(id)
+
+#else
+
+#define OTA_PROBE_SCOPE(id) do {} while (0)
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// ====================================================================================
+// SIGNED MANIFEST ANTI-REPLAY
+// ====================================================================================
+//
+// In signed-manifest mode the manifest may come from an untrusted HTTP cache, so
+// a validly signed but old manifest could be replayed to hold devices on an old
+// release. The highest sequence number and timestamp accepted so far are kept
+// in NVS and anything older is rejected.
+
+// When the device clock is set (SNTP), manifests older than this are rejected too
+#ifndef OTA_MANIFEST_MAX_AGE_S
+#define OTA_MANIFEST_MAX_AGE_S (30UL * 24 * 3600)
+#endif
+
+// Time server started by otaReplayClockBegin()
+#ifndef OTA_NTP_SERVER
+#define OTA_NTP_SERVER "pool.ntp.org"
+#endif
+
+// How long setup() waits for the first SNTP answer
+#ifndef OTA_CLOCK_SYNC_TIMEOUT_MS
+#define OTA_CLOCK_SYNC_TIMEOUT_MS 5000
+#endif
+
+enum OtaReplayResult {
+  OTA_REPLAY_OK = 0,
+  OTA_REPLAY_OLD_SEQUENCE,
+  OTA_REPLAY_OLD_TIMESTAMP,
+  OTA_REPLAY_EXPIRED,
+};
+
+// Starts SNTP and waits up to `waitMs` for the clock to be set. Returns true
+// once it is; otherwise SNTP keeps trying in the background.
+bool otaReplayClockBegin(uint32_t waitMs);
+
+// Checks a verified manifest's sequence and timestamp against what was accepted
+// before. While the clock is not set the age cannot be checked; the manifest is
+// then accepted on sequence and timestamp alone, with a warning.
+OtaReplayResult otaReplayCheck(uint32_t sequence, uint32_t timestamp);
+
+// Manifests accepted since boot without an age check because the clock was not set.
+uint32_t otaReplayAgeUnchecked();
+
+// Records an accepted manifest. NVS is only written when the values advance.
+void otaReplayAccept(uint32_t sequence, uint32_t timestamp);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "ota_error.h"
+
+struct OtaAttemptStats;
+
+// ====================================================================================
+// PERSISTENT OTA STATISTICS
+// ====================================================================================
+//
+// Lifetime counters kept in NVS so that update history survives reboots.
+// Attempts update a RAM copy only. The copy is written back as one blob, and
+// only from loop(), once OTA_STATS_FLUSH_ATTEMPTS checks have accumulated or
+// OTA_STATS_FLUSH_INTERVAL_MS has passed since the first unsaved one. Polling
+// every hour then costs about three flash writes a day, and nothing on the
+// update path waits for flash. A successful update flushes before the restart.
+
+// Unsaved checks that trigger a write
+#ifndef OTA_STATS_FLUSH_ATTEMPTS
+#define OTA_STATS_FLUSH_ATTEMPTS 8
+#endif
+
+// Longest time a recorded check stays unsaved
+#ifndef OTA_STATS_FLUSH_INTERVAL_MS
+#define OTA_STATS_FLUSH_INTERVAL_MS (6UL * 3600 * 1000)
+#endif
+
+// Stored as the fields up to `failures` followed by `errorCount` entries of
+// it, so firmware with more or fewer error codes keeps the history: it loads
+// the entries both know and leaves the rest at zero.
+struct OtaPersistentStats {
+  uint16_t layout;          // OTA_STATS_LAYOUT of the firmware that wrote the blob
+  uint16_t errorCount;      // Entries of `failures` in the blob
+  uint32_t boots;
+  uint32_t checks;
+  uint32_t updatesStarted;  // Checks that began downloading an image
+  uint32_t updatesSucceeded;
+  uint32_t lastThroughput;  // Bytes/s of the last download
+  uint64_t bytesDownloaded;
+  uint32_t flashWrites;     // Times this blob has been saved
+  uint32_t failures[OTA_ERR_COUNT]; // Indexed by OtaError; [OTA_OK] is unused
+};
+
+// Loads the stored counters and counts a boot. Call once from setup().
+void otaStatsBegin();
+
+// Adds a finished update check to the RAM copy.
+void otaStatsRecordAttempt(const OtaAttemptStats& attempt);
+
+// Saves the RAM copy if a flush is due. Call from loop().
+void otaStatsPoll();
+
+// Saves the RAM copy now if it has unsaved changes.
+void otaStatsFlush();
+
+// The current counters, including unsaved changes.
+const OtaPersistentStats& otaStats();
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+// ====================================================================================
+// PER-ATTEMPT OTA TELEMETRY
+// ====================================================================================
+
+// Stages of one update check. Memory figures are kept per stage.
+enum OtaPhase {
+  OTA_PHASE_MANIFEST,  // Manifest (and manifest signature) fetch
+  OTA_PHASE_DOWNLOAD,  // Firmware or bundle download into flash
+  OTA_PHASE_SIGNATURE, // Detached signature download
+  OTA_PHASE_VERIFY,    // Signature verification
+  OTA_PHASE_FINALIZE,  // Update.end()
+  OTA_PHASE_COUNT,
+};
+
+// Microseconds spent in each step of one check. Connection and request times
+// add up over every connection and request the check made.
+struct OtaAttemptTiming {
+  uint32_t startUs;
+  uint32_t totalUs;
+  uint32_t dnsUs;
+  uint32_t tcpUs;      // Plain HTTP connects only
+  uint32_t tlsUs;      // TCP connect plus handshake; WiFiClientSecure does both in one call
+  uint32_t ttfbUs;     // Request sent until the response headers were read
+  uint32_t redirectUs; // Whole requests that ended in a 3xx
+  uint32_t parseUs;    // Manifest JSON; an unsigned manifest is parsed as it streams in
+  uint32_t downloadUs; // Image streaming, including the flash and hash time below
+  uint32_t flashWriteUs;
+  uint32_t sha256Us;
+  uint32_t verifyUs;
+  uint32_t finalizeUs; // Update.end()
+  uint32_t bytesReceived; // Image and signature bytes
+  uint16_t stalls;        // Waits for data longer than OTA_STALL_THRESHOLD_MS
+  uint32_t phaseStartUs;
+  uint32_t phaseUs[OTA_PHASE_COUNT]; // Wall time per stage, summed over re-entries
+};
+
+// A wait for download data this long counts as a stall
+#ifndef OTA_STALL_THRESHOLD_MS
+#define OTA_STALL_THRESHOLD_MS 250
+#endif
+
+// Heap and stack figures per stage. The free heap is sampled throughout the
+// stage. The largest block, lifetime minimum and stack mark are taken at the
+// stage boundaries, because walking the heap or the stack is too slow to do
+// per chunk.
+struct OtaPhaseMemory {
+  bool entered;
+  uint32_t minFreeHeap;      // Lowest free heap sampled during the stage
+  uint32_t minLargestBlock;  // Smallest "largest free block" seen at a boundary
+  uint32_t minEverFreeHeap;  // ESP.getMinFreeHeap() when the stage ended
+  uint32_t stackHighWater;   // Unused loop task stack (bytes) when the stage ended
+  uint32_t tlsPoolPeak;      // Peak use of the static TLS pool (low-memory mode)
+};
+
+// Counters for one update check (manifest fetch plus any download it triggers).
+struct OtaAttemptStats {
+  uint16_t httpRequests;      // Every request sent, including redirect hops
+  uint16_t redirectHops;      // 3xx responses followed
+  uint16_t redirectCacheHits; // Requests sent straight to a cached redirect target
+  uint16_t connections;       // New TCP connections opened
+  uint16_t tlsHandshakes;     // New TLS sessions negotiated
+  uint16_t downloadBufferSize;
+  uint32_t startFreeHeap;
+  uint32_t startLargestFreeBlock;
+  uint32_t startFreePsram;      // 0 without PSRAM
+  uint32_t endLargestFreeBlock; // Largest allocatable block once the check is over
+  OtaPhase phase;
+  OtaPhaseMemory memory[OTA_PHASE_COUNT];
+  OtaAttemptTiming timing;
+  int lastError; // OtaError of the last handleErrorState(), 0 if none
+};
+
+extern OtaAttemptStats otaAttempt;
+
+// Clears the counters at the start of an update check.
+void otaTelemetryBeginAttempt();
+
+// Marks the start of a stage; stages may be re-entered.
+void otaTelemetryEnterPhase(OtaPhase phase);
+
+// Records the current free heap against the current stage. Cheap enough to
+// call once per downloaded chunk.
+void otaTelemetrySampleHeap();
+
+// Logs the counters collected since otaTelemetryBeginAttempt(). The timing
+// record is one line, logged with OTA_LOG_PINNED() so that neither a full ring
+// nor OTA_LOG_LEVEL drops it:
+//   ota_timing_us error=0 total=... dns=... tcp=... tls=... ttfb=... redirect=...
+//     parse=... download=... flash=... sha=... verify=... finalize=... bytes=... stalls=...
+void otaTelemetryEndAttempt();
+
+// Adds the time since `startUs` (a micros() value) to `field`.
+void otaTelemetryAddTime(uint32_t& field, uint32_t startUs);
+
+const char* otaPhaseName(OtaPhase phase);
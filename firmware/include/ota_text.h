@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+// ====================================================================================
+// FIXED-CAPACITY STRINGS
+// ====================================================================================
+//
+// The OTA path runs every UPDATE_CHECK_INTERVAL for the lifetime of the device,
+// so URLs, versions and header values are kept in fixed buffers instead of
+// Arduino Strings. Nothing here touches the heap; text that does not fit is
+// truncated and the buffer remembers that it overflowed, so callers can reject
+// it instead of acting on a cut-off URL.
+
+// Longest URL handled, including signed CDN redirect targets
+#ifndef OTA_URL_MAX
+#define OTA_URL_MAX 1024
+#endif
+
+// Longest origin ("https://host:port")
+#define OTA_ORIGIN_MAX 128
+
+// Longest host name
+#define OTA_HOST_MAX 64
+
+// Longest version string taken from a manifest
+#define OTA_VERSION_MAX 32
+
+template <size_t N>
+struct OtaFixedString {
+  char text[N];
+  size_t length;
+  bool overflow;
+
+  OtaFixedString() { clear(); }
+
+  void clear() {
+    text[0] = '\0';
+    length = 0;
+    overflow = false;
+  }
+
+  bool assign(const char* value) {
+    clear();
+    return append(value);
+  }
+
+  bool assign(const char* value, size_t count) {
+    clear();
+    return append(value, count);
+  }
+
+  bool append(const char* value) { return append(value, value ? strlen(value) : 0); }
+
+  bool append(const char* value, size_t count) {
+    if (count > N - 1 - length) {
+      count = N - 1 - length;
+      overflow = true;
+    }
+    memcpy(text + length, value, count);
+    length += count;
+    text[length] = '\0';
+    return !overflow;
+  }
+
+  bool append(char c) { return append(&c, 1); }
+
+  const char* c_str() const { return text; }
+  bool isEmpty() const { return length == 0; }
+  bool equals(const char* other) const { return strcmp(text, other) == 0; }
+};
+
+typedef OtaFixedString<OTA_URL_MAX> OtaUrl;
+
+// A non-owning slice of a longer string (e.g. one query parameter of a URL)
+struct OtaTextView {
+  const char* data;
+  size_t length;
+
+  bool isEmpty() const { return length == 0; }
+  bool equals(const char* other) const {
+    return strlen(other) == length && strncmp(data, other, length) == 0;
+  }
+};
+
+inline bool otaStartsWith(const char* text, const char* prefix) {
+  return strncmp(text, prefix, strlen(prefix)) == 0;
+}
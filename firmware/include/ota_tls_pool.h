@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ====================================================================================
+// STATIC TLS MEMORY POOL (LOW-MEMORY OTA MODE)
+// ====================================================================================
+//
+// A TLS handshake allocates roughly 40 KB (record buffers, peer chain, bignums)
+// from the heap on every connection. When the application keeps the heap nearly
+// full this fails, or fails only after fragmentation has set in. Building with
+// -DOTA_LOW_MEMORY_TLS=1 reserves OTA_TLS_POOL_SIZE bytes at link time and
+// routes mbedtls allocations into it, so the same memory is reused by every
+// check. Allocations that do not fit fall back to the heap and are counted.
+//
+// The pool does not make TLS need less memory; it moves the same amount out of
+// the heap, where it is reserved for good, so a connection no longer depends on
+// finding 40 KB of contiguous free heap. Every check still closes its
+// connections, so no TLS session state is kept between checks.
+//
+// The hook is process-wide. mbedtls has a single calloc/free pair, so once the
+// pool is installed every mbedtls user in the firmware allocates from it, not
+// just the update check: the application's own TLS clients (MQTT, HTTPS APIs)
+// and any hashing or key parsing outside the OTA path. Size OTA_TLS_POOL_SIZE
+// for all connections that can be open at the same time. While another
+// connection holds pool memory, the OTA handshake spills into the heap, which
+// shows up as fallbacks. The hook is not swapped in and out around each check:
+// mbedtls cannot report the hooks it had before, and a block can outlive the
+// swap and be freed through the other allocator.
+//
+// No max fragment length is negotiated: WiFiClientSecure does not expose the
+// mbedtls config, so record buffers keep the size fixed by the framework's
+// sdkconfig. When building against a custom sdkconfig with
+// CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN lowered, reduce OTA_TLS_POOL_SIZE to match;
+// the server must then send records that fit.
+
+#ifndef OTA_LOW_MEMORY_TLS
+#define OTA_LOW_MEMORY_TLS 0
+#endif
+
+#ifndef OTA_TLS_POOL_SIZE
+#define OTA_TLS_POOL_SIZE (40 * 1024)
+#endif
+
+// Routes mbedtls allocations into the pool. Call once, before the first TLS
+// connection. Returns false if the pool is disabled or the hooks are unavailable.
+bool otaTlsPoolInstall();
+
+// Bytes currently allocated from the pool.
+size_t otaTlsPoolInUse();
+
+// Highest otaTlsPoolInUse() since the last otaTlsPoolResetPeak().
+size_t otaTlsPoolPeak();
+void otaTlsPoolResetPeak();
+
+// Allocations that did not fit in the pool and went to the heap.
+uint32_t otaTlsPoolFallbacks();
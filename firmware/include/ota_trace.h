@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+class Print;
+
+// ====================================================================================
+// TIMELINE TRACE
+// ====================================================================================
+//
+// Build with -DOTA_TRACE=1 to record begin and end events for every stage and
+// every download chunk (and the read, flash write and SHA-256 update inside it)
+// into a fixed RAM ring, together with the task and core they ran on. After
+// each check the ring is written to the serial port as Chrome trace JSON, which
+// chrome://tracing and ui.perfetto.dev open directly, or to a file set with
+// otaTraceSetOutput() (the native runner's --trace). When the ring is full the
+// oldest events are overwritten. Without the flag the calls compile to nothing.
+//
+// The attempt and stage spans are kept in a small array of their own, so a
+// full image that wraps the ring still exports them. Chunk spans whose begin
+// was overwritten are left out, so every export stays well-formed.
+
+#ifndef OTA_TRACE
+#define OTA_TRACE 0
+#endif
+
+// Events kept (power of two); each takes 16 bytes
+#ifndef OTA_TRACE_RING_SIZE
+#define OTA_TRACE_RING_SIZE 1024
+#endif
+
+// Attempt and stage events kept outside the ring; later ones are dropped
+#ifndef OTA_TRACE_STAGE_EVENTS
+#define OTA_TRACE_STAGE_EVENTS 64
+#endif
+
+// Discards all recorded events; called at the start of each attempt.
+void otaTraceReset();
+
+#if OTA_TRACE
+
+// Records the start or end of a span. `name` must be a string literal.
+void otaTraceBegin(const char* name);
+void otaTraceEnd(const char* name);
+
+// Same for the attempt and its stages, which must survive a wrapping ring.
+void otaTraceStageBegin(const char* name);
+void otaTraceStageEnd(const char* name);
+
+// Writes the recorded events as one Chrome trace JSON document, framed by
+// "=== OTA TRACE BEGIN ===" and "=== OTA TRACE END ===" lines so
+// tools/extract_trace.py can cut it out of a serial log.
+void otaTraceExport(Print& out);
+
+// Sends the events of every later check to `out` instead of the serial port,
+// as entries of one Chrome trace array (JSON Array Format); the caller writes
+// the opening "[" and the closing "]". Checks are placed by millis(), so a
+// whole run reads as one timeline. nullptr restores the serial export.
+void otaTraceSetOutput(Print* out);
+
+// Writes the events of the check that just ended to the output above, or
+// exports them to Serial. Called by otaTelemetryEndAttempt().
+void otaTraceFlush();
+
+// Spans the rest of the enclosing block
+class OtaTraceScope {
+ public:
+  explicit OtaTraceScope(const char* name) : name(name) { otaTraceBegin(name); }
+  ~OtaTraceScope() { otaTraceEnd(name); }
+  OtaTraceScope(const OtaTraceScope&) = delete;
+  OtaTraceScope& operator=(const OtaTraceScope&) = delete;
+
+ private:
+  const char* name;
+};
+
+#define OTA_TRACE_CONCAT_(a, b) a##b
+#define OTA_TRACE_CONCAT(a, b) OTA_TRACE_CONCAT_(a, b)
+#define OTA_TRACE_SCOPE(name) OtaTraceScope OTA_TRACE_CONCAT(otaTrace, __LINE__)(name)
+#define OTA_TRACE_BEGIN(name) otaTraceBegin(name)
+#define OTA_TRACE_END(name) otaTraceEnd(name)
+#define OTA_TRACE_STAGE_BEGIN(name) otaTraceStageBegin(name)
+#define OTA_TRACE_STAGE_END(name) otaTraceStageEnd(name)
+
+#else
+
+#define OTA_TRACE_SCOPE(name) do {} while (0)
+#define OTA_TRACE_BEGIN(name) do {} while (0)
+#define OTA_TRACE_END(name) do {} while (0)
+#define OTA_TRACE_STAGE_BEGIN(name) do {} while (0)
+#define OTA_TRACE_STAGE_END(name) do {} while (0)
+
+#endif
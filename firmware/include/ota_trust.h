@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <WiFiClientSecure.h>
+
+// ====================================================================================
+// PER-HOST TLS TRUST TABLE
+// ====================================================================================
+//
+// Every TLS connection opened by the OTA transport looks up its host here to
+// decide how the server is authenticated. Hosts without an entry use the
+// default policy, which is normally the compiled-in root bundle
+// (ota_trust_bundle.h, generated by tools/gen_trust_bundle.py). The bundle is
+// binary-searched by issuer during the handshake, so redirect targets on other
+// CDNs are verified without parsing a PEM chain per connection.
+//
+// For our own mirrors two cheaper modes skip X.509 chain validation entirely:
+// a pinned SHA-256 of the server's SubjectPublicKeyInfo, checked right after
+// the handshake, or TLS-PSK with no certificates at all. WiFiClientSecure does
+// not expose cipher suite selection, so the fast ECDHE-ECDSA / PSK suites have
+// to be preferred by the mirror's server configuration.
+
+enum OtaTrustMode {
+  OTA_TRUST_BUNDLE,   // Roots from the compiled-in bundle
+  OTA_TRUST_PEM,      // One PEM root CA, parsed on every connection
+  OTA_TRUST_INSECURE, // No server authentication (ALLOW_INSECURE_OTA)
+  OTA_TRUST_SPKI_PIN, // Chain not validated; server key must match a pinned hash
+  OTA_TRUST_PSK,      // TLS-PSK with a pre-shared identity and key
+};
+
+#define OTA_TRUST_TABLE_SIZE 8
+#define OTA_TRUST_HOST_MAX 64
+
+struct OtaTrustEntry {
+  uint32_t hostHash; // FNV-1a of the lower-cased host name; table sort key
+  char host[OTA_TRUST_HOST_MAX];
+  OtaTrustMode mode;
+  const char* pem;         // OTA_TRUST_PEM
+  const char* pskIdentity; // OTA_TRUST_PSK
+  const char* pskKey;      // OTA_TRUST_PSK, hex encoded
+  uint8_t spkiPin[32];     // OTA_TRUST_SPKI_PIN, SHA-256 of the SubjectPublicKeyInfo DER
+};
+
+// Sets the policy used for hosts without their own entry.
+void otaTrustSetDefault(OtaTrustMode mode, const char* pem = nullptr);
+
+// Adds or replaces the policy for one host. Returns false if the table is full.
+bool otaTrustAddHost(const char* host, OtaTrustMode mode, const char* pem = nullptr);
+
+// Pins `host` to a server key. `spkiSha256Hex` is 64 hex characters, e.g. from
+//   openssl x509 -in server.pem -pubkey -noout | openssl pkey -pubin -outform der | openssl dgst -sha256
+bool otaTrustAddPinnedHost(const char* host, const char* spkiSha256Hex);
+
+// Uses TLS-PSK for `host`. `keyHex` is the pre-shared key in hex.
+bool otaTrustAddPskHost(const char* host, const char* identity, const char* keyHex);
+
+// Returns the entry for `host`, or the default entry if it has none.
+const OtaTrustEntry* otaTrustLookup(const char* host);
+
+// Configures `client` for a new connection to `host`.
+void otaTrustApply(WiFiClientSecure& client, const char* host);
+
+// Checks an established connection against the host's pin, if it has one.
+bool otaTrustVerifyPeer(WiFiClientSecure& client, const char* host);
+
+const char* otaTrustModeName(OtaTrustMode mode);
+
+// Connects to host:port `rounds` times per trust mode (PEM when `pem` is set,
+// the bundle, and the host's own pin or PSK entry) and prints handshake time
+// and heap cost for each.
+void otaTrustBenchmark(const char* host, uint16_t port, const char* pem, int rounds);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ota_http.h"
+
+struct OtaAttemptStats;
+
+// ====================================================================================
+// TELEMETRY UPLINK
+// ====================================================================================
+//
+// Every finished update check is kept as a fixed 44-byte record in a small RAM
+// ring. Records are POSTed to a collector in batches, over the connections the
+// update check already holds, instead of with one request per event. A batch
+// goes out once OTA_UPLINK_BATCH_RECORDS records are waiting or the oldest has
+// waited OTA_UPLINK_MAX_DELAY_MS. A full ring overwrites its oldest record, and
+// records stay queued until the collector answers 2xx.
+//
+// Batch layout (all integers little-endian, Content-Type
+// application/x-ota-telemetry):
+//   0   4  magic "OTAT"
+//   4   1  format version (OTA_UPLINK_FORMAT_V1)
+//   5   1  record size in bytes (OTA_UPLINK_RECORD_SIZE)
+//   6   2  record count
+//   8   4  batch sequence number since boot
+//   12  4  records overwritten before they could be sent, since boot
+//   16  6  station MAC address
+//   22  2  reserved, 0
+//   24  32 firmware version, NUL padded
+//   56  ...records
+//
+// Record layout:
+//   0   4  seconds since boot when the check ended
+//   4   4  Unix time when the check ended, 0 if the clock is not set
+//   8   4  total check time in ms
+//   12  20 wall time in ms per stage: manifest, download, signature, verify, finalize
+//   32  4  image streaming time in ms
+//   36  4  image and signature bytes received
+//   40  2  download stalls
+//   42  1  OtaError of the last handleErrorState(), 0 if none
+//   43  1  flags: OTA_UPLINK_FLAG_*
+//
+// tools/telemetry_collector.py decodes batches and can stand in for the
+// collector in tests.
+
+#define OTA_UPLINK_MAGIC "OTAT"
+#define OTA_UPLINK_FORMAT_V1 1
+#define OTA_UPLINK_HEADER_SIZE 56
+#define OTA_UPLINK_RECORD_SIZE 44
+#define OTA_UPLINK_CONTENT_TYPE "application/x-ota-telemetry"
+
+#define OTA_UPLINK_FLAG_DOWNLOAD_STARTED 0x01
+#define OTA_UPLINK_FLAG_UPDATE_SUCCEEDED 0x02
+
+// Records held in RAM
+#ifndef OTA_UPLINK_MAX_RECORDS
+#define OTA_UPLINK_MAX_RECORDS 16
+#endif
+
+// Records that make a batch worth sending
+#ifndef OTA_UPLINK_BATCH_RECORDS
+#define OTA_UPLINK_BATCH_RECORDS 8
+#endif
+
+// Longest a record waits for its batch
+#ifndef OTA_UPLINK_MAX_DELAY_MS
+#define OTA_UPLINK_MAX_DELAY_MS (24UL * 3600 * 1000)
+#endif
+
+// Queues a finished update check.
+void otaUplinkRecordAttempt(const OtaAttemptStats& attempt);
+
+// True when a batch should be sent.
+bool otaUplinkDue();
+
+// POSTs every queued record to `collectorUrl` over `session` and drops them once
+// the collector accepts the batch. The batch is built in the per-attempt arena.
+// Returns the HTTP status, or a negative HTTPClient/OTA_HTTP_ERROR_* code.
+int otaUplinkSend(OtaSession& session, const char* collectorUrl, const char* firmwareVersion);
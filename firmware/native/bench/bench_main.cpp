@@ -0,0 +1,237 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "ota_error.h"
+#include "ota_host.h"
+#include "ota_sim.h"
+#include "ota_telemetry.h"
+
+// ====================================================================================
+// DOWNLOAD PIPELINE BENCHMARK
+// ====================================================================================
+//
+// Runs the real update check (checkForUpdates() down to Update.end()) against
+// the simulated link, server and flash in ota_sim.h, once per combination of
+//
+//   --links    link profiles (wifi, lan, cellular, weak)
+//   --flash    flash models (esp32, none)
+//   --modes    download paths: split (file_url + signature_url) or bundle
+//   --buffers  OTA_DOWNLOAD_BUFFER_MAX values
+//
+// and writes one JSON object per run (JSON Lines) to stdout or --output.
+//
+// Link and flash waits take real time unless --clock virtual is given; then a
+// run takes milliseconds and repeats exactly for a seed, but the CPU-bound
+// phases (SHA-256, signature check) read as zero.
+//
+// peak_heap_used is the most the modelled heap dropped below its level at the
+// start of the check; see otaHostStableHeap().
+
+#define BENCH_RELEASE_VERSION "2.0"
+#define BENCH_MMAP_THRESHOLD (32 * 1024)
+
+struct BenchOptions {
+  std::vector<std::string> links = {"wifi"};
+  std::vector<std::string> flashModels = {"esp32"};
+  std::vector<std::string> modes = {"split", "bundle"};
+  std::vector<uint32_t> buffers = {1024, 4096, 16384};
+  size_t imageSize = 512 * 1024;
+  uint32_t repeat = 1;
+  uint32_t seed = 1;
+  const char* output = nullptr;
+  bool virtualClock = false;
+};
+
+static std::vector<std::string> splitList(const char* text) {
+  std::vector<std::string> items;
+  std::string current;
+  for (const char* c = text;; c++) {
+    if (*c == ',' || *c == '\0') {
+      if (!current.empty()) items.push_back(current);
+      current.clear();
+      if (*c == '\0') break;
+    } else {
+      current += *c;
+    }
+  }
+  return items;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [--links wifi,weak|all] [--flash esp32,none] [--modes split,bundle]\n"
+          "          [--buffers 1024,4096] [--image-size BYTES] [--repeat N] [--seed N] [--output FILE]\n"
+          "          [--clock real|virtual]\n",
+          program);
+}
+
+static bool parseArguments(int argc, char** argv, BenchOptions& options) {
+  for (int i = 1; i < argc; i += 2) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) return false;
+    if (strcmp(arg, "--links") == 0) {
+      options.links.clear();
+      if (strcmp(value, "all") == 0) {
+        for (size_t l = 0; l < otaSimLinkCount; l++) options.links.push_back(otaSimLinks[l].name);
+      } else {
+        options.links = splitList(value);
+      }
+    } else if (strcmp(arg, "--flash") == 0) {
+      options.flashModels = splitList(value);
+    } else if (strcmp(arg, "--modes") == 0) {
+      options.modes = splitList(value);
+    } else if (strcmp(arg, "--buffers") == 0) {
+      options.buffers.clear();
+      for (const std::string& item : splitList(value)) options.buffers.push_back(strtoul(item.c_str(), nullptr, 0));
+    } else if (strcmp(arg, "--image-size") == 0) {
+      options.imageSize = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--repeat") == 0) {
+      options.repeat = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--seed") == 0) {
+      options.seed = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--output") == 0) {
+      options.output = value;
+    } else if (strcmp(arg, "--clock") == 0 && (strcmp(value, "real") == 0 || strcmp(value, "virtual") == 0)) {
+      options.virtualClock = strcmp(value, "virtual") == 0;
+    } else {
+      return false;
+    }
+  }
+  for (const std::string& name : options.links) {
+    if (otaSimFindLink(name.c_str()) == nullptr) {
+      fprintf(stderr, "unknown link profile: %s\n", name.c_str());
+      return false;
+    }
+  }
+  for (const std::string& name : options.flashModels) {
+    if (otaSimFindFlashModel(name.c_str()) == nullptr) {
+      fprintf(stderr, "unknown flash model: %s\n", name.c_str());
+      return false;
+    }
+  }
+  for (const std::string& mode : options.modes) {
+    if (mode != "split" && mode != "bundle") {
+      fprintf(stderr, "unknown mode: %s\n", mode.c_str());
+      return false;
+    }
+  }
+  for (uint32_t buffer : options.buffers) {
+    // otaAttempt.downloadBufferSize is 16 bits wide
+    if (buffer < 1024 || buffer > 32768) {
+      fprintf(stderr, "buffer sizes must be within 1024..32768\n");
+      return false;
+    }
+  }
+  return !options.links.empty() && !options.flashModels.empty() && !options.modes.empty() &&
+         !options.buffers.empty() && options.imageSize > 0 && options.repeat > 0;
+}
+
+// ------------------------------------------------------------------------------------
+// Runs
+// ------------------------------------------------------------------------------------
+
+static double toMs(uint32_t us) {
+  return us / 1000.0;
+}
+
+// Most heap the check held at once, from the per-stage samples
+static uint32_t peakHeapUsed() {
+  uint32_t minFree = otaAttempt.startFreeHeap;
+  for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) {
+    const OtaPhaseMemory& memory = otaAttempt.memory[phase];
+    if (memory.entered && memory.minFreeHeap < minFree) minFree = memory.minFreeHeap;
+  }
+  return otaAttempt.startFreeHeap - minFree;
+}
+
+static void runOne(FILE* out, const OtaSimRelease& release, const OtaSimLink& link, const OtaSimFlashModel& model,
+                   const std::string& mode, uint32_t buffer, uint32_t run, uint32_t seed) {
+  OtaSimServer server;
+  otaSimPublish(server, release, mode == "bundle");
+  OtaSimNetwork network(server, link, seed);
+  OtaSimFlash flash(model);
+  otaHostSetNetwork(&network);
+  otaHostSetFlash(&flash);
+  otaHostOptions().downloadBufferMax = buffer;
+
+  auto wallStart = std::chrono::steady_clock::now();
+  bool restarted = otaSimRunCheck();
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+  otaHostSetNetwork(nullptr);
+  otaHostSetFlash(nullptr);
+
+  bool imageMatches = restarted && flash.activatedSize() == release.image.size() &&
+                      memcmp(flash.contents().data(), release.image.data(), release.image.size()) == 0;
+  const OtaAttemptTiming& timing = otaAttempt.timing;
+  double downloadS = timing.downloadUs / 1e6;
+
+  fprintf(out, "{\"link\":\"%s\",\"flash\":\"%s\",\"mode\":\"%s\",\"buffer\":%u,\"run\":%u,", link.name, model.name,
+          mode.c_str(), buffer, run);
+  fprintf(out, "\"ok\":%s,\"error\":\"%s\",\"image_bytes\":%u,\"chunk_bytes\":%u,", imageMatches ? "true" : "false",
+          otaErrorName((OtaError)otaAttempt.lastError), (unsigned)release.image.size(),
+          otaAttempt.downloadBufferSize);
+  fprintf(out, "\"total_ms\":%.3f,\"download_ms\":%.3f,\"flash_ms\":%.3f,\"sha256_ms\":%.3f,\"verify_ms\":%.3f,",
+          toMs(timing.totalUs), toMs(timing.downloadUs), toMs(timing.flashWriteUs), toMs(timing.sha256Us),
+          toMs(timing.verifyUs));
+  fprintf(out, "\"parse_ms\":%.3f,\"peak_heap_used\":%u,", toMs(timing.parseUs), peakHeapUsed());
+  fprintf(out, "\"ttfb_ms\":%.3f,\"connect_ms\":%.3f,\"dns_ms\":%.3f,", toMs(timing.ttfbUs),
+          toMs(timing.tcpUs + timing.tlsUs), toMs(timing.dnsUs));
+  fprintf(out, "\"throughput_kBps\":%.2f,\"stalls\":%u,\"requests\":%u,\"connections\":%u,\"lost_segments\":%u,",
+          downloadS > 0 ? release.image.size() / 1024.0 / downloadS : 0.0, timing.stalls, network.stats.requests,
+          network.stats.connections, network.stats.lostSegments);
+  fprintf(out, "\"phase_ms\":{");
+  for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) {
+    fprintf(out, "%s\"%s\":%.3f", phase > 0 ? "," : "", otaPhaseName((OtaPhase)phase), toMs(timing.phaseUs[phase]));
+  }
+  fprintf(out, "},\"wall_ms\":%.3f}\n", wallMs);
+  fflush(out);
+}
+
+int main(int argc, char** argv) {
+  otaHostStableHeap(argv, BENCH_MMAP_THRESHOLD);
+  BenchOptions options;
+  if (!parseArguments(argc, argv, options)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  OtaSimRelease release;
+  if (!otaSimMakeRelease(release, options.imageSize, BENCH_RELEASE_VERSION, options.seed)) {
+    fprintf(stderr, "could not create the signed test image\n");
+    return 1;
+  }
+  if (otaHostOptions().flashSize < release.image.size()) otaHostOptions().flashSize = release.image.size();
+  otaHostOptions().publicKey = release.publicKeyPem.c_str();
+  otaHostOptions().serialOutput = false; // stdout carries the results
+
+  FILE* out = stdout;
+  if (options.output != nullptr && (out = fopen(options.output, "w")) == nullptr) {
+    fprintf(stderr, "cannot write %s\n", options.output);
+    return 2;
+  }
+
+  OtaHostVirtualClock virtualClock;
+  if (options.virtualClock) otaHostSetClock(&virtualClock);
+
+  WiFi.begin("bench");
+  int failures = 0;
+  uint32_t run = 0;
+  for (const std::string& linkName : options.links) {
+    for (const std::string& flashName : options.flashModels) {
+      for (const std::string& mode : options.modes) {
+        for (uint32_t buffer : options.buffers) {
+          for (uint32_t i = 0; i < options.repeat; i++) {
+            runOne(out, release, *otaSimFindLink(linkName.c_str()), *otaSimFindFlashModel(flashName.c_str()), mode,
+                   buffer, i, options.seed + run++);
+            if (otaAttempt.lastError != OTA_OK) failures++;
+          }
+        }
+      }
+    }
+  }
+  if (out != stdout) fclose(out);
+  return failures == 0 ? 0 : 1;
+}
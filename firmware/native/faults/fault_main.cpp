@@ -0,0 +1,258 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string>
+#include <vector>
+#include "ota_bundle.h"
+#include "ota_error.h"
+#include "ota_host.h"
+#include "ota_host_config.h"
+#include "ota_sim.h"
+#include "ota_telemetry.h"
+
+// ====================================================================================
+// DOWNLOAD FAULT INJECTION
+// ====================================================================================
+//
+// Replays the failures seen in the field against the real update check, one
+// case at a time, over the simulated link and flash in ota_sim.h. Each case
+// runs two checks: one against the faulty server, then a clean retry, which
+// the device would make UPDATE_CHECK_INTERVAL later. One JSON line per case
+// reports:
+//
+//   detect_ms     how long the faulty check ran before it gave up
+//   wasted_bytes  bytes it received; nothing is resumed, so all are fetched again
+//   recovery_ms   detect_ms + the wait for the next check + the retry
+//
+// The exit status is 1 if a corrupt image was installed, a case that should
+// fail did not, or a retry failed.
+//
+// Time is virtual unless --clock real is given, so the stall cases finish at
+// once and every number repeats exactly for a given seed.
+
+#define FAULT_RELEASE_VERSION "2.0"
+
+enum FaultKind {
+  FAULT_NONE,
+  FAULT_RESET,          // Connection drops after `fraction` of the body
+  FAULT_TRUNCATED_FILE, // The artifact on the server is short; headers agree with it
+  FAULT_DRIP,           // Sender pauses `pauseMs` at `fraction` of the body
+  FAULT_LENGTH_LONG,    // Content-Length claims 1 KB more than is sent
+  FAULT_LENGTH_SHORT,   // Content-Length claims 1 KB less than is sent
+  FAULT_BAD_SIGNATURE,  // One signature byte flipped
+  FAULT_CORRUPT_IMAGE,  // One image byte flipped
+  FAULT_REDIRECT_LOOP,  // The artifact redirects to a URL that redirects back
+  FAULT_SERVER_ERROR,   // 503 for the artifact
+};
+
+struct FaultCase {
+  const char* name;
+  FaultKind kind;
+  float fraction;
+  uint32_t pauseMs;
+  bool mustFail;
+};
+
+// The drip cases straddle the 30 s stall timeout in streamImageToFlash()
+static const FaultCase faultCases[] = {
+    {"baseline", FAULT_NONE, 0, 0, false},
+    {"reset-10%", FAULT_RESET, 0.10f, 0, true},
+    {"reset-50%", FAULT_RESET, 0.50f, 0, true},
+    {"reset-99%", FAULT_RESET, 0.99f, 0, true},
+    {"truncated-file", FAULT_TRUNCATED_FILE, 0.90f, 0, true},
+    {"drip-29s", FAULT_DRIP, 0.50f, 29000, false},
+    {"drip-31s", FAULT_DRIP, 0.50f, 31000, true},
+    {"content-length-long", FAULT_LENGTH_LONG, 0, 0, true},
+    {"content-length-short", FAULT_LENGTH_SHORT, 0, 0, true},
+    {"bad-signature", FAULT_BAD_SIGNATURE, 0, 0, true},
+    {"corrupt-image", FAULT_CORRUPT_IMAGE, 0.50f, 0, true},
+    {"redirect-loop", FAULT_REDIRECT_LOOP, 0, 0, true},
+    {"http-503", FAULT_SERVER_ERROR, 0, 0, true},
+};
+
+// Serves the release, applying the active fault to the artifact requests
+class FaultServer : public OtaSimServer {
+ public:
+  FaultServer(const FaultCase& fault, bool bundle) : fault(&fault), bundle(bundle) {}
+
+  void clearFault() { fault = nullptr; }
+
+  OtaSimResponse handle(const OtaSimRequest& request) override {
+    if (fault == nullptr || fault->kind == FAULT_NONE) return OtaSimServer::handle(request);
+    std::string path = request.path.substr(0, request.path.find('?'));
+    const char* artifact = bundle ? OTA_SIM_BUNDLE_PATH : OTA_SIM_IMAGE_PATH;
+
+    if (fault->kind == FAULT_REDIRECT_LOOP && (path == artifact || path == "/loop")) {
+      OtaSimResponse response;
+      response.status = 302;
+      response.headers.emplace_back("Location", path == "/loop" ? std::string("https://" OTA_SIM_HOST) + artifact
+                                                                : "https://" OTA_SIM_HOST "/loop");
+      return response;
+    }
+    if (fault->kind == FAULT_BAD_SIGNATURE && !bundle && path == OTA_SIM_SIGNATURE_PATH) {
+      OtaSimResponse response = OtaSimServer::handle(request);
+      response.body[response.body.size() / 2] ^= 0x01;
+      return response;
+    }
+    if (path != artifact) return OtaSimServer::handle(request);
+
+    OtaSimResponse response = OtaSimServer::handle(request);
+    size_t size = response.body.size();
+    size_t at = (size_t)(size * fault->fraction);
+    switch (fault->kind) {
+      case FAULT_RESET:
+        response.cutAfter = at;
+        break;
+      case FAULT_TRUNCATED_FILE:
+        response.body.resize(at);
+        break;
+      case FAULT_DRIP:
+        response.pauses.push_back({at, fault->pauseMs * 1000});
+        break;
+      case FAULT_LENGTH_LONG:
+        response.headers.emplace_back("Content-Length", std::to_string(size + 1024));
+        break;
+      case FAULT_LENGTH_SHORT:
+        response.headers.emplace_back("Content-Length", std::to_string(size - 1024));
+        break;
+      case FAULT_BAD_SIGNATURE: // Bundle: the signature follows the header
+        response.body[OTA_BUNDLE_HEADER_SIZE + 8] ^= 0x01;
+        break;
+      case FAULT_CORRUPT_IMAGE:
+        response.body[at] ^= 0x01;
+        break;
+      case FAULT_SERVER_ERROR:
+        response.status = 503;
+        response.body = "unavailable\n";
+        break;
+      default:
+        break;
+    }
+    return response;
+  }
+
+ private:
+  const FaultCase* fault;
+  bool bundle;
+};
+
+struct CheckResult {
+  bool installed;  // Ended in a restart
+  bool imageValid; // The installed image is the release
+  int error;
+  uint32_t durationUs;
+  uint64_t bytes;
+};
+
+static CheckResult runCheck(OtaSimServer& server, const OtaSimLink& link, const OtaSimFlashModel& model,
+                            const OtaSimRelease& release, uint32_t seed) {
+  OtaSimNetwork network(server, link, seed);
+  OtaSimFlash flash(model);
+  otaHostSetNetwork(&network);
+  otaHostSetFlash(&flash);
+  CheckResult result;
+  result.installed = otaSimRunCheck();
+  otaHostSetNetwork(nullptr);
+  otaHostSetFlash(nullptr);
+  result.imageValid = result.installed && flash.activatedSize() == release.image.size() &&
+                      memcmp(flash.contents().data(), release.image.data(), release.image.size()) == 0;
+  result.error = otaAttempt.lastError;
+  result.durationUs = otaAttempt.timing.totalUs;
+  result.bytes = network.stats.bytesDelivered;
+  return result;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [--cases all|name,name] [--mode split|bundle] [--link NAME] [--flash NAME]\n"
+          "          [--image-size BYTES] [--seed N] [--output FILE] [--clock virtual|real]\n",
+          program);
+}
+
+int main(int argc, char** argv) {
+  std::string cases = "all";
+  bool bundle = false;
+  const OtaSimLink* link = otaSimFindLink("lan");
+  const OtaSimFlashModel* model = otaSimFindFlashModel("none");
+  size_t imageSize = 256 * 1024;
+  uint32_t seed = 1;
+  const char* output = nullptr;
+  bool virtualClock = true;
+
+  for (int i = 1; i < argc; i += 2) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(arg, "--cases") == 0) {
+      cases = value;
+    } else if (strcmp(arg, "--mode") == 0 && (strcmp(value, "split") == 0 || strcmp(value, "bundle") == 0)) {
+      bundle = strcmp(value, "bundle") == 0;
+    } else if (strcmp(arg, "--link") == 0 && otaSimFindLink(value) != nullptr) {
+      link = otaSimFindLink(value);
+    } else if (strcmp(arg, "--flash") == 0 && otaSimFindFlashModel(value) != nullptr) {
+      model = otaSimFindFlashModel(value);
+    } else if (strcmp(arg, "--image-size") == 0 && strtoul(value, nullptr, 0) > 2048) {
+      imageSize = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--seed") == 0) {
+      seed = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--output") == 0) {
+      output = value;
+    } else if (strcmp(arg, "--clock") == 0 && (strcmp(value, "real") == 0 || strcmp(value, "virtual") == 0)) {
+      virtualClock = strcmp(value, "virtual") == 0;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  OtaSimRelease release;
+  if (!otaSimMakeRelease(release, imageSize, FAULT_RELEASE_VERSION, seed)) {
+    fprintf(stderr, "could not create the signed test image\n");
+    return 1;
+  }
+  if (otaHostOptions().flashSize < imageSize + 1024) otaHostOptions().flashSize = imageSize + 1024;
+  otaHostOptions().publicKey = release.publicKeyPem.c_str();
+  otaHostOptions().serialOutput = false; // stdout carries the results
+
+  FILE* out = stdout;
+  if (output != nullptr && (out = fopen(output, "w")) == nullptr) {
+    fprintf(stderr, "cannot write %s\n", output);
+    return 2;
+  }
+
+  OtaHostVirtualClock clock;
+  if (virtualClock) otaHostSetClock(&clock);
+
+  WiFi.begin("faults");
+  int problems = 0;
+  uint32_t run = 0;
+  for (const FaultCase& fault : faultCases) {
+    if (cases != "all" && ("," + cases + ",").find("," + std::string(fault.name) + ",") == std::string::npos) continue;
+
+    FaultServer server(fault, bundle);
+    otaSimPublish(server, release, bundle);
+    CheckResult first = runCheck(server, *link, *model, release, seed + run++);
+    server.clearFault();
+    CheckResult retry = runCheck(server, *link, *model, release, seed + run++);
+
+    bool accepted = first.installed;
+    bool corruptInstalled = first.installed && !first.imageValid;
+    if (corruptInstalled || (fault.mustFail && accepted) || !retry.imageValid) problems++;
+    uint64_t recoveryUs = first.installed ? first.durationUs
+                                          : first.durationUs + (uint64_t)UPDATE_CHECK_INTERVAL * 1000 + retry.durationUs;
+
+    fprintf(out, "{\"fault\":\"%s\",\"mode\":\"%s\",\"link\":\"%s\",\"installed\":%s,\"expected_failure\":%s,",
+            fault.name, bundle ? "bundle" : "split", link->name, accepted ? "true" : "false",
+            fault.mustFail ? "true" : "false");
+    fprintf(out, "\"error\":\"%s\",\"detect_ms\":%.3f,\"wasted_bytes\":%llu,", otaErrorName((OtaError)first.error),
+            first.durationUs / 1000.0, first.installed ? 0ULL : (unsigned long long)first.bytes);
+    fprintf(out, "\"retry_ok\":%s,\"retry_error\":\"%s\",\"retry_ms\":%.3f,\"retry_bytes\":%llu,\"recovery_ms\":%.3f}\n",
+            retry.imageValid ? "true" : "false", otaErrorName((OtaError)retry.error), retry.durationUs / 1000.0,
+            (unsigned long long)retry.bytes, recoveryUs / 1000.0);
+    fflush(out);
+  }
+  if (out != stdout) fclose(out);
+  return problems == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+// Host stand-in for the parts of the Arduino core the OTA sources use.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "ota_host.h"
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+// The host clock is already set; SNTP is not emulated
+inline void configTime(long, int, const char*, const char* = nullptr, const char* = nullptr) {}
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Owning string for the few APIs that return an Arduino String
+class String {
+ public:
+  String(const char* text = "") : value(text ? text : "") {}
+  String(const std::string& text) : value(text) {}
+  const char* c_str() const { return value.c_str(); }
+  unsigned int length() const { return (unsigned int)value.size(); }
+  bool isEmpty() const { return value.empty(); }
+  bool equalsIgnoreCase(const String& other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+  bool operator==(const char* other) const { return value == other; }
+
+ private:
+  std::string value;
+};
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size && write(buffer[written])) written++;
+    return written;
+  }
+  size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+  virtual void flush() {}
+
+  size_t print(const char* text) { return write(text); }
+  size_t print(const String& text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value) { return printf("%d", value); }
+  size_t print(unsigned int value) { return printf("%u", value); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  template <typename T>
+  size_t println(T value) { return print(value) + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    if ((size_t)length < sizeof(line)) return write((const uint8_t*)line, length);
+    std::string longLine(length + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&longLine[0], longLine.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)longLine.data(), length);
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+
+  void setTimeout(unsigned long timeoutMs) { timeout = timeoutMs; }
+  unsigned long getTimeout() const { return timeout; }
+
+  // Reads until `length` bytes arrived or no byte came for the timeout
+  virtual size_t readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+      int c = timedRead();
+      if (c < 0) break;
+      buffer[count++] = (uint8_t)c;
+    }
+    return count;
+  }
+  size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+
+ protected:
+  int timedRead();
+  unsigned long timeout = 1000;
+};
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  void flush() override { fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getHeapSize() { return otaHostOptions().heapSize; }
+  uint32_t getFreePsram() { return 0; }
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  [[noreturn]] void restart();
+};
+
+extern EspClass ESP;
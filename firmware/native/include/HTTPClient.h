@@ -0,0 +1,79 @@
+#pragma once
+
+// Host stand-in for the ESP32 HTTPClient: HTTP/1.1 over a caller-supplied
+// WiFiClient with keep-alive. As on the device, getStream() returns the raw
+// connection (chunked bodies are not decoded), an open connection is reused
+// whatever host it points at, and redirects are left to the caller.
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+typedef enum {
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_NO_CONTENT = 204,
+  HTTP_CODE_PARTIAL_CONTENT = 206,
+  HTTP_CODE_MOVED_PERMANENTLY = 301,
+  HTTP_CODE_FOUND = 302,
+  HTTP_CODE_SEE_OTHER = 303,
+  HTTP_CODE_NOT_MODIFIED = 304,
+  HTTP_CODE_TEMPORARY_REDIRECT = 307,
+  HTTP_CODE_PERMANENT_REDIRECT = 308,
+  HTTP_CODE_NOT_FOUND = 404,
+} t_http_codes;
+
+typedef enum {
+  HTTPC_DISABLE_FOLLOW_REDIRECTS,
+  HTTPC_STRICT_FOLLOW_REDIRECTS,
+  HTTPC_FORCE_FOLLOW_REDIRECTS,
+} followRedirects_t;
+
+class HTTPClient {
+ public:
+  bool begin(WiFiClient& client, const char* url);
+  bool begin(WiFiClient& client, const String& url) { return begin(client, url.c_str()); }
+  void end();
+
+  void setTimeout(uint16_t timeoutMs) { timeout = timeoutMs; }
+  void setFollowRedirects(followRedirects_t) {}
+  void setUserAgent(const char* agent) { userAgent = agent; }
+  void setReuse(bool reuse) { this->reuse = reuse; }
+  void addHeader(const char* name, const char* value);
+  void collectHeaders(const char* headerKeys[], size_t count);
+
+  int GET() { return sendRequest("GET"); }
+  int sendRequest(const char* method, uint8_t* payload = nullptr, size_t size = 0);
+
+  String header(const char* name);
+  bool hasHeader(const char* name);
+  int getSize() { return size; }
+  WiFiClient& getStream() { return *client; }
+  WiFiClient* getStreamPtr() { return client; }
+  bool connected() { return client != nullptr && client->connected(); }
+
+ private:
+  bool readLine(std::string& line);
+  int readResponseHeaders();
+
+  WiFiClient* client = nullptr;
+  std::string host;
+  uint16_t port = 80;
+  std::string uri;
+  std::string userAgent = "ESP32HTTPClient";
+  std::string extraHeaders;
+  std::vector<std::pair<std::string, std::string>> collected;
+  uint16_t timeout = 5000;
+  bool reuse = true;
+  bool canReuse = false;
+  int size = -1;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+// Host stand-in for NVS: each key is a file under <nvsDir>/<namespace>/.
+
+#include "Arduino.h"
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+
+  uint32_t getULong(const char* key, uint32_t defaultValue = 0);
+  size_t putULong(const char* key, uint32_t value);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buffer, size_t length);
+  size_t putBytes(const char* key, const void* value, size_t length);
+  bool remove(const char* key);
+
+ private:
+  std::string path(const char* key) const;
+
+  std::string directory;
+  bool open = false;
+  bool readOnly = true;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+// Host stand-in for the ESP32 Update library. Like the device version it
+// buffers one flash sector and erases each sector just before programming it,
+// so flash models see the same access pattern.
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass {
+ public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+  size_t write(uint8_t* data, size_t length);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+  bool isRunning() const { return running; }
+  size_t progress() const { return written; }
+  const char* errorString() const { return error; }
+
+ private:
+  bool flushSector();
+
+  uint8_t sector[OTA_HOST_FLASH_SECTOR_SIZE];
+  size_t sectorFill = 0;
+  size_t imageSize = 0;
+  size_t written = 0;
+  bool running = false;
+  const char* error = "No Error";
+};
+
+extern UpdateClass Update;
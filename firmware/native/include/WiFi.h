@@ -0,0 +1,92 @@
+#pragma once
+
+// Host stand-in for the ESP32 WiFi library. The station is "connected" once
+// WiFi.begin() has been called; connections go through otaHostNetwork().
+
+#include <memory>
+#include "Arduino.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1 } wifi_mode_t;
+
+class IPAddress {
+ public:
+  IPAddress() : address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+  explicit IPAddress(uint32_t networkOrder) : address(networkOrder) {}
+  uint8_t operator[](int index) const { return (uint8_t)(address >> (8 * index)); }
+  operator uint32_t() const { return address; }
+
+ private:
+  uint32_t address;
+};
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient() = default;
+  explicit WiFiClient(std::shared_ptr<OtaHostSocket> socket) : socket(std::move(socket)) {}
+  virtual ~WiFiClient() = default;
+
+  virtual int connect(const char* host, uint16_t port);
+  virtual int connect(IPAddress ip, uint16_t port);
+  virtual void stop();
+  uint8_t connected();
+  explicit operator bool() { return connected(); }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t size);
+  int peek() override;
+  size_t readBytes(uint8_t* buffer, size_t length) override;
+  using Stream::readBytes;
+  void flush() override; // Discards unread input, like the ESP32 client
+
+ protected:
+  std::shared_ptr<OtaHostSocket> socket;
+  int peeked = -1;
+};
+
+class WiFiServer {
+ public:
+  explicit WiFiServer(uint16_t port) : port(port) {}
+  ~WiFiServer();
+  void begin();
+  WiFiClient available();
+
+ private:
+  uint16_t port;
+  int listenFd = -1;
+};
+
+class WiFiClass {
+ public:
+  wl_status_t status() { return state; }
+  bool mode(wifi_mode_t) { return true; }
+  wl_status_t begin(const char*, const char* = nullptr) {
+    state = WL_CONNECTED;
+    return state;
+  }
+  bool disconnect(bool = false) {
+    state = WL_DISCONNECTED;
+    return true;
+  }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  int hostByName(const char* host, IPAddress& result);
+  uint8_t* macAddress(uint8_t* mac);
+
+ private:
+  wl_status_t state = WL_IDLE_STATUS;
+};
+
+extern WiFiClass WiFi;
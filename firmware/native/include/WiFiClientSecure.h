@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in: no TLS is simulated, so the secure client is a plain TCP
+// client. Certificate settings are accepted and ignored.
+
+#include "WiFi.h"
+
+class WiFiClientSecure : public WiFiClient {
+ public:
+  void setCACert(const char*) {}
+  void setInsecure() {}
+  void setPreSharedKey(const char*, const char*) {}
+};
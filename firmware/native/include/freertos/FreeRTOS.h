@@ -0,0 +1,39 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS types and macros the OTA sources use. Tasks
+// are std::threads; ticks are milliseconds of the HAL clock.
+
+#include <atomic>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+struct OtaHostTask;
+typedef OtaHostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define tskIDLE_PRIORITY 0
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+struct portMUX_TYPE {
+  std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void otaHostEnterCritical(portMUX_TYPE* mux) {
+  while (mux->flag.test_and_set(std::memory_order_acquire)) {
+  }
+}
+inline void otaHostExitCritical(portMUX_TYPE* mux) { mux->flag.clear(std::memory_order_release); }
+
+#define portENTER_CRITICAL(mux) otaHostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) otaHostExitCritical(mux)
+
+BaseType_t xPortGetCoreID();
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                       UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+const char* pcTaskGetTaskName(TaskHandle_t task);
+
+// Host threads have no measurable stack mark; reports the configured depth.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the mbedtls public-key API used to verify signatures,
+// backed by OpenSSL. RSA PKCS#1 v1.5 and ECDSA keys are supported.
+
+#include <stddef.h>
+
+typedef enum { MBEDTLS_MD_NONE = 0, MBEDTLS_MD_SHA256 = 6 } mbedtls_md_type_t;
+
+typedef struct {
+  void* key; // EVP_PKEY
+} mbedtls_pk_context;
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keyLength);
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t mdType, const unsigned char* hash, size_t hashLength,
+                      const unsigned char* signature, size_t signatureLength);
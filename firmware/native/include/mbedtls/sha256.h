@@ -0,0 +1,16 @@
+#pragma once
+
+// Host stand-in for the mbedtls SHA-256 API (2.x "_ret" names), backed by OpenSSL.
+
+#include <stddef.h>
+
+typedef struct {
+  void* digest; // EVP_MD_CTX
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* input, size_t length);
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char output[32]);
+int mbedtls_sha256_ret(const unsigned char* input, size_t length, unsigned char output[32], int is224);
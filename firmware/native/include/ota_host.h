@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ====================================================================================
+// HOST HARDWARE ABSTRACTION LAYER
+// ====================================================================================
+//
+// The native environment builds the unmodified OTA sources against host
+// versions of the Arduino headers they include (WiFi, HTTPClient, Update,
+// Serial, Preferences, FreeRTOS and the two mbedtls APIs used). Those versions
+// forward every call that touches hardware to the three seams below:
+//
+//   OtaHostClock    millis(), micros(), delay() and Stream timeouts
+//   OtaHostNetwork  every TCP connection (WiFiClient and WiFiClientSecure)
+//   OtaHostFlash    the OTA partition behind Update
+//
+// The defaults are a monotonic clock starting at zero, POSIX sockets and a
+// file-backed partition. OtaHostVirtualClock replaces the first with simulated
+// time. Benchmarks and tests install their own models with
+// otaHostSet*() before calling setup().
+//
+// There is no TLS on the host: https:// URLs are carried over plain TCP, so the
+// reference server and the link models speak HTTP only. The trust table is a
+// stub. Signatures are still verified, through OpenSSL.
+
+// ------------------------------------------------------------------------------------
+// Clock
+// ------------------------------------------------------------------------------------
+
+class OtaHostClock {
+ public:
+  virtual ~OtaHostClock() = default;
+
+  // Microseconds since the simulated boot.
+  virtual uint64_t nowUs() = 0;
+
+  // Blocks the calling task for `us` microseconds of this clock's time.
+  virtual void sleepUs(uint64_t us) = 0;
+
+  // Called by xTaskCreate() before it starts the task's thread, and by that
+  // thread before it runs the task. Only a clock that schedules the tasks
+  // itself needs them.
+  virtual void taskCreating() {}
+  virtual void taskStarted() {}
+};
+
+// Simulated time. Tasks take turns: exactly one runs while the others sleep,
+// and when it sleeps the clock jumps to the earliest wake-up and hands the
+// turn to that task (ties go to whoever slept first). Waits therefore cost no
+// real time, and a run whose inputs are seeded replays exactly:
+//
+//   OtaHostVirtualClock clock;
+//   otaHostSetClock(&clock); // Before setup() creates any task
+//
+// Computation takes no simulated time, so phases the device spends on the CPU
+// (hashing, signature checks) read as zero; model them where it matters.
+// Sockets from the POSIX network wait in real time and read virtual time, so
+// pair this clock with a simulated network. A task that never sleeps, or
+// exits while holding the turn, stops every other task.
+class OtaHostVirtualClock : public OtaHostClock {
+ public:
+  explicit OtaHostVirtualClock(uint64_t startUs = 0) : now(startUs) {}
+
+  uint64_t nowUs() override;
+  void sleepUs(uint64_t us) override;
+  void taskCreating() override;
+  void taskStarted() override;
+
+ private:
+  struct Sleeper {
+    uint64_t wakeUs;
+    uint64_t ticket; // Order of the sleep calls; breaks ties
+    std::thread::id thread;
+  };
+
+  void waitTurn(std::unique_lock<std::mutex>& lock, uint64_t wakeUs, bool holdsTurn);
+
+  std::mutex mutex;
+  std::condition_variable turnChanged;
+  std::atomic<uint64_t> now; // Written under `mutex`
+  std::vector<Sleeper> sleepers;
+  uint64_t nextTicket = 0;
+  std::atomic<uint64_t> runningTicket{UINT64_MAX};
+  std::thread::id runningThread; // Default id until the first sleep
+  uint32_t starting = 0;         // Tasks created but not yet asleep
+};
+
+// ------------------------------------------------------------------------------------
+// Network
+// ------------------------------------------------------------------------------------
+
+// One established TCP connection.
+class OtaHostSocket {
+ public:
+  virtual ~OtaHostSocket() = default;
+
+  // Bytes that can be read without waiting.
+  virtual int available() = 0;
+
+  // Reads up to `size` bytes, waiting at most `timeoutMs` for the first one.
+  // Returns the count, 0 on timeout, or -1 once the peer has closed and
+  // everything it sent has been read.
+  virtual int read(uint8_t* buffer, size_t size, uint32_t timeoutMs) = 0;
+
+  // Sends all of `data`; returns false if the connection is gone.
+  virtual bool write(const uint8_t* data, size_t size) = 0;
+
+  // False once the connection is closed and nothing is left to read.
+  virtual bool connected() = 0;
+
+  virtual void close() = 0;
+};
+
+class OtaHostNetwork {
+ public:
+  virtual ~OtaHostNetwork() = default;
+
+  // Opens a connection to host:port; nullptr if it cannot be established.
+  virtual std::unique_ptr<OtaHostSocket> connect(const char* host, uint16_t port, uint32_t timeoutMs) = 0;
+
+  // Resolves `host` to an IPv4 address in network order; false if unknown.
+  virtual bool resolve(const char* host, uint32_t& address) = 0;
+};
+
+// ------------------------------------------------------------------------------------
+// Flash
+// ------------------------------------------------------------------------------------
+
+// The inactive OTA partition.
+class OtaHostFlash {
+ public:
+  virtual ~OtaHostFlash() = default;
+
+  // Partition size in bytes.
+  virtual size_t size() = 0;
+
+  // Erases `length` bytes starting at `offset` (sector aligned).
+  virtual bool erase(size_t offset, size_t length) = 0;
+
+  // Programs `length` bytes at `offset`; the range has been erased before.
+  virtual bool program(size_t offset, const uint8_t* data, size_t length) = 0;
+
+  // Marks the partition bootable (Update.end()).
+  virtual bool activate(size_t imageSize) = 0;
+};
+
+#define OTA_HOST_FLASH_SECTOR_SIZE 4096
+
+// ------------------------------------------------------------------------------------
+// Installation and options
+// ------------------------------------------------------------------------------------
+
+// The HAL does not take ownership; the object must outlive its use.
+void otaHostSetClock(OtaHostClock* clock);
+void otaHostSetNetwork(OtaHostNetwork* network);
+void otaHostSetFlash(OtaHostFlash* flash);
+
+OtaHostClock& otaHostClock();
+OtaHostNetwork& otaHostNetwork();
+OtaHostFlash& otaHostFlash();
+
+// Settings that the device gets from secrets/config.h and its hardware. The
+// native runner fills them from the command line; see native/src/main.cpp.
+struct OtaHostOptions {
+  const char* firmwareVersion = "1.0";
+  const char* publicKey = ""; // PEM text
+  // When set, every host name resolves to this server and every connection
+  // goes to it, so the device URLs can stay unchanged
+  const char* serverHost = nullptr;
+  uint16_t serverPort = 0;
+  const char* flashPath = "ota_partition.bin";
+  size_t flashSize = 0x140000; // Default app partition of the ESP32 layout
+  const char* nvsDir = ".ota_nvs";
+  uint32_t heapSize = 320 * 1024; // Reported as the device heap by ESP.getFreeHeap()
+  uint32_t downloadBufferMax = 4096; // OTA_DOWNLOAD_BUFFER_MAX, so benchmarks can sweep it
+  bool serialOutput = true; // Serial goes to stdout; harnesses that print results there turn it off
+};
+
+OtaHostOptions& otaHostOptions();
+
+// Reads a whole file into a NUL-terminated heap buffer; nullptr on failure.
+char* otaHostReadFile(const char* path, size_t* length = nullptr);
+
+// Makes the heap model repeatable, for programs that measure it. glibc's
+// per-thread cache keeps freed chunks and reports them as in use, and which
+// chunks it holds varies from run to run, so the program re-executes itself
+// (with `argv`) with the cache turned off. Buffers of `mmapThreshold` bytes
+// and more then come from mmap() and leave the model alone, so a harness's
+// images and responses do not count. Call first thing in main().
+void otaHostStableHeap(char** argv, size_t mmapThreshold);
+
+// Thrown by ESP.restart(); the runner decides whether to exit or boot again.
+struct OtaHostRestart {};
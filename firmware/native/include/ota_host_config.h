@@ -0,0 +1,18 @@
+#pragma once
+
+// Stand-in for secrets/config.h in the native build. Values a test needs to
+// vary come from otaHostOptions(), which the runner fills from its command line.
+
+#include "ota_host.h"
+
+#define WIFI_SSID "native"
+#define WIFI_PASSWORD ""
+#define MANIFEST_URL "https://ota.test/manifest.json"
+#define MANIFEST_ROOT_CA ""
+#define FIRMWARE_VERSION (otaHostOptions().firmwareVersion)
+#define PUBLIC_KEY (otaHostOptions().publicKey)
+#define ALLOW_INSECURE_OTA false
+#define SERIAL_BAUD_RATE 115200
+#define UPDATE_CHECK_INTERVAL (60UL * 60 * 1000)
+#define VERSION_PRINT_INTERVAL (60UL * 1000)
+#define OTA_DOWNLOAD_BUFFER_MAX (otaHostOptions().downloadBufferMax)
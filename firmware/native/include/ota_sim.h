@@ -0,0 +1,211 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "ota_host.h"
+
+// ====================================================================================
+// SIMULATED LINK, SERVER AND FLASH
+// ====================================================================================
+//
+// In-process models for the host HAL seams, so the real download pipeline can
+// be timed without a network or a board:
+//
+//   OtaSimServer   answers GET and HEAD from an in-memory file table
+//   OtaSimNetwork  delivers its responses through an OtaSimLink: bandwidth,
+//                  round trip, jitter, segment loss, periodic stalls and the
+//                  device's TCP receive window
+//   OtaSimFlash    keeps the partition in RAM and charges erase and program
+//                  latency per sector and per page
+//   OtaSimTrace    a download recorded on a device (ota_nettrace.h), to be
+//                  replayed through a response's `arrivals`
+//
+// All waiting goes through otaHostClock(), and the randomness comes from a
+// seeded generator, so with a virtual clock a run is exactly reproducible.
+
+// ------------------------------------------------------------------------------------
+// Models
+// ------------------------------------------------------------------------------------
+
+struct OtaSimLink {
+  const char* name;
+  uint32_t bandwidthKbps;   // Bottleneck rate, kilobits per second
+  uint32_t rttUs;           // Round trip without queueing
+  uint32_t jitterUs;        // Extra one-way delay, uniform in [0, jitterUs]
+  float lossRate;           // Chance a segment needs a retransmission timeout
+  uint32_t stallEveryBytes; // 0 = no stalls
+  uint32_t stallUs;         // Sender pause once every stallEveryBytes
+  uint32_t windowBytes;     // Device receive window (lwIP TCP_WND)
+};
+
+struct OtaSimFlashModel {
+  const char* name;
+  uint32_t eraseUsPerSector; // 4 KB sector erase
+  uint32_t programUsPerPage; // 256-byte page program
+};
+
+#define OTA_SIM_SEGMENT_SIZE 1460 // TCP MSS on the device's WiFi interface
+#define OTA_SIM_FLASH_PAGE_SIZE 256
+#define OTA_SIM_MIN_RTO_US 200000 // lwIP's minimum retransmission timeout
+
+// Built-in profiles; the first entry of each table is the default.
+extern const OtaSimLink otaSimLinks[];
+extern const size_t otaSimLinkCount;
+extern const OtaSimFlashModel otaSimFlashModels[];
+extern const size_t otaSimFlashModelCount;
+
+const OtaSimLink* otaSimFindLink(const char* name);
+const OtaSimFlashModel* otaSimFindFlashModel(const char* name);
+
+// ------------------------------------------------------------------------------------
+// Server
+// ------------------------------------------------------------------------------------
+
+struct OtaSimRequest {
+  std::string method;
+  std::string path;
+  std::map<std::string, std::string> headers; // Names lower-cased
+  std::string body;
+};
+
+struct OtaSimResponse {
+  int status = 200;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  bool close = false; // Close the connection after this response
+  // Faults: the connection drops once this many body bytes are sent, and the
+  // sender pauses for `pauses[i].second` us before body offset `pauses[i].first`
+  size_t cutAfter = std::string::npos;
+  std::vector<std::pair<size_t, uint32_t>> pauses;
+  // Replay: the body bytes before offset `arrivals[i].first` arrive no earlier
+  // than `arrivals[i].second` us after the headers. The receive window still
+  // applies to them; the link's rate, jitter, loss and stalls do not.
+  std::vector<std::pair<size_t, uint32_t>> arrivals;
+};
+
+class OtaSimServer {
+ public:
+  virtual ~OtaSimServer() = default;
+
+  void put(const std::string& path, const std::string& content) { files[path] = content; }
+  const std::string* find(const std::string& path) const;
+
+  // Builds the response for one request. The default serves `files`; HEAD
+  // gets the headers of the matching GET.
+  virtual OtaSimResponse handle(const OtaSimRequest& request);
+
+  // Serialises a response, adding Content-Length and Connection headers.
+  // `bodyStart` receives the offset of the body in the result.
+  static std::string encode(const OtaSimResponse& response, bool headOnly, size_t* bodyStart = nullptr);
+
+ protected:
+  std::map<std::string, std::string> files;
+};
+
+// ------------------------------------------------------------------------------------
+// Network
+// ------------------------------------------------------------------------------------
+
+// Counters over every connection the network has opened.
+struct OtaSimNetworkStats {
+  uint32_t connections;
+  uint32_t requests;
+  uint64_t bytesDelivered; // Response bytes the device read
+  uint32_t lostSegments;
+};
+
+class OtaSimNetwork : public OtaHostNetwork {
+ public:
+  OtaSimNetwork(OtaSimServer& server, const OtaSimLink& link, uint32_t seed) : server(server), link(link), random(seed) {}
+
+  // Every host name reaches `server`. Port 443 adds the two round trips of a
+  // full TLS 1.2 handshake; cipher CPU time is not modelled.
+  std::unique_ptr<OtaHostSocket> connect(const char* host, uint16_t port, uint32_t timeoutMs) override;
+  bool resolve(const char* host, uint32_t& address) override;
+
+  OtaSimServer& server;
+  const OtaSimLink& link;
+  std::mt19937 random;
+  OtaSimNetworkStats stats = {};
+};
+
+// ------------------------------------------------------------------------------------
+// Flash
+// ------------------------------------------------------------------------------------
+
+class OtaSimFlash : public OtaHostFlash {
+ public:
+  explicit OtaSimFlash(const OtaSimFlashModel& model) : model(model) {}
+
+  size_t size() override { return otaHostOptions().flashSize; }
+  bool erase(size_t offset, size_t length) override;
+  bool program(size_t offset, const uint8_t* data, size_t length) override;
+  bool activate(size_t imageSize) override;
+
+  // Contents of the partition up to the last activated image.
+  const std::vector<uint8_t>& contents() const { return data; }
+  size_t activatedSize() const { return activated; }
+
+ private:
+  const OtaSimFlashModel& model;
+  std::vector<uint8_t> data;
+  size_t activated = 0;
+};
+
+// ------------------------------------------------------------------------------------
+// Releases
+// ------------------------------------------------------------------------------------
+
+// Where otaSimPublish() puts a release; ota_host_config.h points MANIFEST_URL here
+#define OTA_SIM_HOST "ota.test"
+#define OTA_SIM_MANIFEST_PATH "/manifest.json"
+#define OTA_SIM_IMAGE_PATH "/fw.bin"
+#define OTA_SIM_SIGNATURE_PATH "/fw.sig"
+#define OTA_SIM_BUNDLE_PATH "/fw.otab"
+
+// A release as the build publishes it: a random image, its detached signature
+// and the same image as a bundle, all signed with a throwaway P-256 key.
+struct OtaSimRelease {
+  std::string version;
+  std::string publicKeyPem; // For otaHostOptions().publicKey
+  std::string image;
+  std::string signature;
+  std::string bundle;
+};
+
+bool otaSimMakeRelease(OtaSimRelease& release, size_t imageSize, const char* version, uint32_t seed);
+
+// Puts the release on `server` with a manifest that names either the split
+// artifacts or the bundle.
+void otaSimPublish(OtaSimServer& server, const OtaSimRelease& release, bool bundle);
+
+// Runs one checkForUpdates(); true if it ended in ESP.restart(), i.e. the
+// update was installed.
+bool otaSimRunCheck();
+
+// ------------------------------------------------------------------------------------
+// Network traces
+// ------------------------------------------------------------------------------------
+
+// A download recorded by firmware built with -DOTA_NET_TRACE=1
+struct OtaSimTrace {
+  uint32_t imageLength;
+  uint32_t bytesRecorded;
+  uint32_t rttUs;
+  bool truncated; // The recording stopped before the download did
+  // Image bytes read by then, and us since the download started; the form
+  // OtaSimResponse::arrivals takes
+  std::vector<std::pair<size_t, uint32_t>> arrivals;
+};
+
+// Reads a .otnt file. On failure returns false and says why in `error`.
+bool otaSimLoadTrace(const char* path, OtaSimTrace& trace, std::string& error);
+
+// A link with the trace's round trip and average rate, for the requests
+// around the recorded download.
+OtaSimLink otaSimTraceLink(const OtaSimTrace& trace);
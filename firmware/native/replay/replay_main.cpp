@@ -0,0 +1,198 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string>
+#include <vector>
+#include "ota_error.h"
+#include "ota_host.h"
+#include "ota_sim.h"
+#include "ota_telemetry.h"
+
+// ====================================================================================
+// NETWORK TRACE REPLAY
+// ====================================================================================
+//
+// Plays a download recorded in the field (-DOTA_NET_TRACE=1, cut out of the
+// serial log by tools/extract_trace.py) back into the real update check, so a
+// change to the pipeline or the chunk size can be judged against that site's
+// WiFi rather than a synthetic profile. The image is a random one of the
+// recorded length; its bytes reach the device no earlier than the trace says,
+// and no faster than the device reads them through its receive window. The
+// manifest and signature requests use a link with the trace's round trip and
+// average rate.
+//
+// One run per --buffers value; one JSON line each, bench fields plus
+// recorded_ms, the length of the download on the recording device. Time is
+// virtual unless --clock real is given, so a replay repeats exactly.
+//
+// The recording device read its bytes when its own pipeline was ready for
+// them, so a replay cannot show a pipeline running faster than the one
+// recorded. The trace is an upper bound on the arrival times, not the
+// network's capacity.
+
+#define REPLAY_RELEASE_VERSION "2.0"
+
+// Serves the release, with the trace's arrival times on the image bytes
+class ReplayServer : public OtaSimServer {
+ public:
+  ReplayServer(const OtaSimTrace& trace, const OtaSimRelease& release, bool bundle) : trace(trace), bundle(bundle) {
+    imageOffset = bundle ? release.bundle.size() - release.image.size() : 0;
+  }
+
+  OtaSimResponse handle(const OtaSimRequest& request) override {
+    OtaSimResponse response = OtaSimServer::handle(request);
+    std::string path = request.path.substr(0, request.path.find('?'));
+    if (path != (bundle ? OTA_SIM_BUNDLE_PATH : OTA_SIM_IMAGE_PATH) || response.status != 200) return response;
+    // The bundle's header and signature are read before the recorded download starts
+    if (imageOffset > 0) response.arrivals.push_back({imageOffset, 0});
+    for (const auto& arrival : trace.arrivals) response.arrivals.push_back({imageOffset + arrival.first, arrival.second});
+    return response;
+  }
+
+ private:
+  const OtaSimTrace& trace;
+  bool bundle;
+  size_t imageOffset;
+};
+
+static std::vector<uint32_t> parseBuffers(const char* text) {
+  std::vector<uint32_t> buffers;
+  for (const char* c = text; *c != '\0';) {
+    char* end;
+    uint32_t buffer = strtoul(c, &end, 0);
+    if (end == c) return {};
+    buffers.push_back(buffer);
+    c = *end == ',' ? end + 1 : end;
+  }
+  return buffers;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s --trace FILE [--mode split|bundle] [--buffers 1024,4096] [--flash esp32|none]\n"
+          "          [--seed N] [--output FILE] [--clock virtual|real]\n",
+          program);
+}
+
+static double toMs(uint32_t us) {
+  return us / 1000.0;
+}
+
+int main(int argc, char** argv) {
+  const char* tracePath = nullptr;
+  bool bundle = false;
+  std::vector<uint32_t> buffers = {1024, 4096, 16384};
+  const OtaSimFlashModel* model = otaSimFindFlashModel("esp32");
+  uint32_t seed = 1;
+  const char* output = nullptr;
+  bool virtualClock = true;
+
+  for (int i = 1; i < argc; i += 2) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(arg, "--trace") == 0) {
+      tracePath = value;
+    } else if (strcmp(arg, "--mode") == 0 && (strcmp(value, "split") == 0 || strcmp(value, "bundle") == 0)) {
+      bundle = strcmp(value, "bundle") == 0;
+    } else if (strcmp(arg, "--buffers") == 0) {
+      buffers = parseBuffers(value);
+    } else if (strcmp(arg, "--flash") == 0 && otaSimFindFlashModel(value) != nullptr) {
+      model = otaSimFindFlashModel(value);
+    } else if (strcmp(arg, "--seed") == 0) {
+      seed = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--output") == 0) {
+      output = value;
+    } else if (strcmp(arg, "--clock") == 0 && (strcmp(value, "real") == 0 || strcmp(value, "virtual") == 0)) {
+      virtualClock = strcmp(value, "virtual") == 0;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  for (uint32_t buffer : buffers) {
+    // otaAttempt.downloadBufferSize is 16 bits wide
+    if (buffer < 1024 || buffer > 32768) {
+      fprintf(stderr, "buffer sizes must be within 1024..32768\n");
+      return 2;
+    }
+  }
+  if (tracePath == nullptr || buffers.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  OtaSimTrace trace;
+  std::string error;
+  if (!otaSimLoadTrace(tracePath, trace, error)) {
+    fprintf(stderr, "%s: %s\n", tracePath, error.c_str());
+    return 2;
+  }
+  if (trace.truncated || trace.bytesRecorded < trace.imageLength) {
+    fprintf(stderr, "%s: %u of %u bytes recorded; the rest arrive at the trace's average rate\n", tracePath,
+            trace.bytesRecorded, trace.imageLength);
+  }
+  OtaSimLink link = otaSimTraceLink(trace);
+  uint32_t recordedUs = trace.arrivals.empty() ? 0 : trace.arrivals.back().second;
+
+  OtaSimRelease release;
+  if (!otaSimMakeRelease(release, trace.imageLength, REPLAY_RELEASE_VERSION, seed)) {
+    fprintf(stderr, "could not create the signed test image\n");
+    return 1;
+  }
+  if (otaHostOptions().flashSize < release.image.size()) otaHostOptions().flashSize = release.image.size();
+  otaHostOptions().publicKey = release.publicKeyPem.c_str();
+  otaHostOptions().serialOutput = false; // stdout carries the results
+
+  FILE* out = stdout;
+  if (output != nullptr && (out = fopen(output, "w")) == nullptr) {
+    fprintf(stderr, "cannot write %s\n", output);
+    return 2;
+  }
+
+  OtaHostVirtualClock clock;
+  if (virtualClock) otaHostSetClock(&clock);
+
+  WiFi.begin("replay");
+  int failures = 0;
+  for (uint32_t buffer : buffers) {
+    ReplayServer server(trace, release, bundle);
+    otaSimPublish(server, release, bundle);
+    OtaSimNetwork network(server, link, seed);
+    OtaSimFlash flash(*model);
+    otaHostSetNetwork(&network);
+    otaHostSetFlash(&flash);
+    otaHostOptions().downloadBufferMax = buffer;
+    bool restarted = otaSimRunCheck();
+    otaHostSetNetwork(nullptr);
+    otaHostSetFlash(nullptr);
+
+    bool imageMatches = restarted && flash.activatedSize() == release.image.size() &&
+                        memcmp(flash.contents().data(), release.image.data(), release.image.size()) == 0;
+    if (!imageMatches) failures++;
+    const OtaAttemptTiming& timing = otaAttempt.timing;
+    double downloadS = timing.downloadUs / 1e6;
+
+    fprintf(out, "{\"trace\":\"%s\",\"flash\":\"%s\",\"mode\":\"%s\",\"buffer\":%u,", tracePath, model->name,
+            bundle ? "bundle" : "split", buffer);
+    fprintf(out, "\"ok\":%s,\"error\":\"%s\",\"image_bytes\":%u,\"chunk_bytes\":%u,", imageMatches ? "true" : "false",
+            otaErrorName((OtaError)otaAttempt.lastError), (unsigned)release.image.size(),
+            otaAttempt.downloadBufferSize);
+    fprintf(out, "\"recorded_ms\":%.3f,\"total_ms\":%.3f,\"download_ms\":%.3f,\"flash_ms\":%.3f,\"sha256_ms\":%.3f,",
+            toMs(recordedUs), toMs(timing.totalUs), toMs(timing.downloadUs), toMs(timing.flashWriteUs),
+            toMs(timing.sha256Us));
+    fprintf(out, "\"throughput_kBps\":%.2f,\"stalls\":%u,\"requests\":%u,\"connections\":%u,",
+            downloadS > 0 ? release.image.size() / 1024.0 / downloadS : 0.0, timing.stalls, network.stats.requests,
+            network.stats.connections);
+    fprintf(out, "\"phase_ms\":{");
+    for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) {
+      fprintf(out, "%s\"%s\":%.3f", phase > 0 ? "," : "", otaPhaseName((OtaPhase)phase), toMs(timing.phaseUs[phase]));
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+  }
+  if (out != stdout) fclose(out);
+  return failures == 0 ? 0 : 1;
+}
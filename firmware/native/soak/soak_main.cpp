@@ -0,0 +1,234 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <random>
+#include <string>
+#include "ota_bundle.h"
+#include "ota_error.h"
+#include "ota_host.h"
+#include "ota_host_config.h"
+#include "ota_sim.h"
+#include "ota_telemetry.h"
+
+// ====================================================================================
+// HEAP SOAK
+// ====================================================================================
+//
+// Runs thousands of update checks back to back, as a device would over months
+// of uptime, and records the free heap and the largest allocatable block after
+// each one. Every check is drawn at random (seeded) from
+//
+//   success        a new release, installed (the restart is caught)
+//   no-update      the manifest names the running version
+//   failure        manifest 404, artifact 503, a reset mid-download or a bad
+//                  signature, in turn
+//
+// Writes one JSON line per cycle and a summary line. The gate compares the
+// lowest values seen in the first --window cycles with those in the last
+// --window cycles; the exit status is 1 if either dropped by more than
+// --max-drop bytes, or if a check ended differently than its cycle intended.
+//
+// Buffers of 32 KB and more are served from mmap() and leave the modelled heap
+// alone, so the harness's images and responses do not count; the firmware's
+// own allocations are far smaller. glibc's per-thread cache would read as a
+// slow leak, so otaHostStableHeap() turns it off.
+
+#define SOAK_RELEASE_VERSION "2.0"
+#define SOAK_MMAP_THRESHOLD (32 * 1024)
+
+enum SoakCycle {
+  SOAK_SUCCESS,
+  SOAK_NO_UPDATE,
+  SOAK_MANIFEST_MISSING,
+  SOAK_SERVER_ERROR,
+  SOAK_RESET,
+  SOAK_BAD_SIGNATURE,
+};
+
+static const char* const soakCycleNames[] = {"success", "no-update", "manifest-404", "http-503", "reset",
+                                             "bad-signature"};
+
+#define SOAK_FIRST_FAILURE SOAK_MANIFEST_MISSING
+#define SOAK_FAILURE_KINDS 4
+
+// Serves the release, with the behaviour of the current cycle
+class SoakServer : public OtaSimServer {
+ public:
+  SoakServer(const OtaSimRelease& release, bool bundle) : bundle(bundle) {
+    OtaSimRelease running = release;
+    running.version = otaHostOptions().firmwareVersion;
+    otaSimPublish(*this, running, bundle);
+    runningManifest = *find(OTA_SIM_MANIFEST_PATH);
+    otaSimPublish(*this, release, bundle);
+  }
+
+  SoakCycle cycle = SOAK_SUCCESS;
+
+  OtaSimResponse handle(const OtaSimRequest& request) override {
+    std::string path = request.path.substr(0, request.path.find('?'));
+    const char* artifact = bundle ? OTA_SIM_BUNDLE_PATH : OTA_SIM_IMAGE_PATH;
+    if (path == OTA_SIM_MANIFEST_PATH && cycle == SOAK_NO_UPDATE) {
+      OtaSimResponse response;
+      response.body = runningManifest;
+      return response;
+    }
+    if (path == OTA_SIM_MANIFEST_PATH && cycle == SOAK_MANIFEST_MISSING) {
+      OtaSimResponse response;
+      response.status = 404;
+      response.body = "not found\n";
+      return response;
+    }
+
+    OtaSimResponse response = OtaSimServer::handle(request);
+    if (cycle == SOAK_SERVER_ERROR && path == artifact) {
+      response.status = 503;
+      response.body = "unavailable\n";
+    } else if (cycle == SOAK_RESET && path == artifact) {
+      response.cutAfter = response.body.size() / 2;
+    } else if (cycle == SOAK_BAD_SIGNATURE && !bundle && path == OTA_SIM_SIGNATURE_PATH) {
+      response.body[response.body.size() / 2] ^= 0x01;
+    } else if (cycle == SOAK_BAD_SIGNATURE && bundle && path == artifact) {
+      response.body[OTA_BUNDLE_HEADER_SIZE + 8] ^= 0x01; // The signature follows the header
+    }
+    return response;
+  }
+
+ private:
+  bool bundle;
+  std::string runningManifest;
+};
+
+// Lowest values over a range of cycles
+struct SoakLow {
+  uint32_t freeHeap = UINT32_MAX;
+  uint32_t largestBlock = UINT32_MAX;
+
+  void add(uint32_t free, uint32_t largest) {
+    if (free < freeHeap) freeHeap = free;
+    if (largest < largestBlock) largestBlock = largest;
+  }
+};
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [--cycles N] [--mix SUCCESS,NO_UPDATE,FAILURE] [--mode split|bundle]\n"
+          "          [--image-size BYTES] [--window N] [--max-drop BYTES] [--seed N] [--output FILE]\n"
+          "          [--clock virtual|real]\n",
+          program);
+}
+
+int main(int argc, char** argv) {
+  otaHostStableHeap(argv, SOAK_MMAP_THRESHOLD);
+
+  uint32_t cycles = 2000;
+  uint32_t weights[3] = {1, 8, 1}; // success, no-update, failure
+  bool bundle = false;
+  size_t imageSize = 64 * 1024;
+  uint32_t window = 100;
+  uint32_t maxDrop = 1024;
+  uint32_t seed = 1;
+  const char* output = nullptr;
+  bool virtualClock = true;
+
+  for (int i = 1; i < argc; i += 2) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(arg, "--cycles") == 0) {
+      cycles = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--mix") == 0 &&
+               sscanf(value, "%u,%u,%u", &weights[0], &weights[1], &weights[2]) == 3) {
+    } else if (strcmp(arg, "--mode") == 0 && (strcmp(value, "split") == 0 || strcmp(value, "bundle") == 0)) {
+      bundle = strcmp(value, "bundle") == 0;
+    } else if (strcmp(arg, "--image-size") == 0 && strtoul(value, nullptr, 0) > 2048) {
+      imageSize = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--window") == 0) {
+      window = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--max-drop") == 0) {
+      maxDrop = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--seed") == 0) {
+      seed = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--output") == 0) {
+      output = value;
+    } else if (strcmp(arg, "--clock") == 0 && (strcmp(value, "real") == 0 || strcmp(value, "virtual") == 0)) {
+      virtualClock = strcmp(value, "virtual") == 0;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (window == 0 || cycles < 2 * window || weights[0] + weights[1] + weights[2] == 0) {
+    fprintf(stderr, "need --cycles of at least twice --window, and a non-zero --mix\n");
+    return 2;
+  }
+
+  OtaSimRelease release;
+  if (!otaSimMakeRelease(release, imageSize, SOAK_RELEASE_VERSION, seed)) {
+    fprintf(stderr, "could not create the signed test image\n");
+    return 1;
+  }
+  if (otaHostOptions().flashSize < imageSize) otaHostOptions().flashSize = imageSize;
+  otaHostOptions().publicKey = release.publicKeyPem.c_str();
+  otaHostOptions().serialOutput = false; // stdout carries the results
+
+  FILE* out = stdout;
+  if (output != nullptr && (out = fopen(output, "w")) == nullptr) {
+    fprintf(stderr, "cannot write %s\n", output);
+    return 2;
+  }
+
+  OtaHostVirtualClock clock;
+  if (virtualClock) otaHostSetClock(&clock);
+
+  // Shared by every cycle, so their buffers are allocated once, before the
+  // first measurement
+  SoakServer server(release, bundle);
+  OtaSimNetwork network(server, *otaSimFindLink("lan"), seed);
+  OtaSimFlash flash(*otaSimFindFlashModel("none"));
+  otaHostSetNetwork(&network);
+  otaHostSetFlash(&flash);
+  std::mt19937 random(seed);
+  std::discrete_distribution<int> pick({(double)weights[0], (double)weights[1], (double)weights[2]});
+
+  WiFi.begin("soak");
+  SoakLow first, last;
+  uint32_t unexpected = 0;
+  uint32_t failureTurn = 0;
+  for (uint32_t cycle = 0; cycle < cycles; cycle++) {
+    int draw = pick(random);
+    server.cycle = draw == 0   ? SOAK_SUCCESS
+                   : draw == 1 ? SOAK_NO_UPDATE
+                               : (SoakCycle)(SOAK_FIRST_FAILURE + failureTurn++ % SOAK_FAILURE_KINDS);
+    bool installed = otaSimRunCheck();
+    OtaError error = (OtaError)otaAttempt.lastError;
+    bool asIntended = server.cycle == SOAK_SUCCESS     ? installed
+                      : server.cycle == SOAK_NO_UPDATE ? !installed && error == OTA_OK
+                                                       : !installed && error != OTA_OK;
+    if (!asIntended) unexpected++;
+
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largestBlock = ESP.getMaxAllocHeap();
+    if (cycle < window) first.add(freeHeap, largestBlock);
+    if (cycle >= cycles - window) last.add(freeHeap, largestBlock);
+    fprintf(out, "{\"cycle\":%u,\"kind\":\"%s\",\"error\":\"%s\",\"as_intended\":%s,\"free_heap\":%u,\"largest_block\":%u}\n",
+            cycle, soakCycleNames[server.cycle], otaErrorName(error), asIntended ? "true" : "false", freeHeap,
+            largestBlock);
+  }
+  otaHostSetNetwork(nullptr);
+  otaHostSetFlash(nullptr);
+
+  int64_t freeDrop = (int64_t)first.freeHeap - last.freeHeap;
+  int64_t largestDrop = (int64_t)first.largestBlock - last.largestBlock;
+  bool pass = unexpected == 0 && freeDrop <= maxDrop && largestDrop <= maxDrop;
+  fprintf(out, "{\"summary\":true,\"cycles\":%u,\"mode\":\"%s\",\"unexpected\":%u,", cycles, bundle ? "bundle" : "split",
+          unexpected);
+  fprintf(out, "\"free_heap_first\":%u,\"free_heap_last\":%u,\"free_heap_drop\":%lld,", first.freeHeap,
+          last.freeHeap, (long long)freeDrop);
+  fprintf(out, "\"largest_block_first\":%u,\"largest_block_last\":%u,\"largest_block_drop\":%lld,",
+          first.largestBlock, last.largestBlock, (long long)largestDrop);
+  fprintf(out, "\"max_drop\":%u,\"pass\":%s}\n", maxDrop, pass ? "true" : "false");
+  if (out != stdout) fclose(out);
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+
+// mbedtls error codes are negative; the callers only test for non-zero
+#define HOST_CRYPTO_ERROR (-1)
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+  ctx->digest = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+  EVP_MD_CTX_free((EVP_MD_CTX*)ctx->digest);
+  ctx->digest = nullptr;
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224) {
+  if (ctx->digest == nullptr) return HOST_CRYPTO_ERROR;
+  return EVP_DigestInit_ex((EVP_MD_CTX*)ctx->digest, is224 ? EVP_sha224() : EVP_sha256(), nullptr) == 1
+             ? 0
+             : HOST_CRYPTO_ERROR;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* input, size_t length) {
+  return EVP_DigestUpdate((EVP_MD_CTX*)ctx->digest, input, length) == 1 ? 0 : HOST_CRYPTO_ERROR;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+  return EVP_DigestFinal_ex((EVP_MD_CTX*)ctx->digest, output, nullptr) == 1 ? 0 : HOST_CRYPTO_ERROR;
+}
+
+int mbedtls_sha256_ret(const unsigned char* input, size_t length, unsigned char output[32], int is224) {
+  return EVP_Digest(input, length, output, nullptr, is224 ? EVP_sha224() : EVP_sha256(), nullptr) == 1
+             ? 0
+             : HOST_CRYPTO_ERROR;
+}
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx) {
+  ctx->key = nullptr;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx) {
+  EVP_PKEY_free((EVP_PKEY*)ctx->key);
+  ctx->key = nullptr;
+}
+
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keyLength) {
+  // mbedtls counts the terminating NUL of PEM input
+  if (keyLength > 0 && key[keyLength - 1] == '\0') keyLength--;
+  BIO* input = BIO_new_mem_buf(key, (int)keyLength);
+  if (input == nullptr) return HOST_CRYPTO_ERROR;
+  ctx->key = PEM_read_bio_PUBKEY(input, nullptr, nullptr, nullptr);
+  BIO_free(input);
+  return ctx->key != nullptr ? 0 : HOST_CRYPTO_ERROR;
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t mdType, const unsigned char* hash, size_t hashLength,
+                      const unsigned char* signature, size_t signatureLength) {
+  if (ctx->key == nullptr || mdType != MBEDTLS_MD_SHA256) return HOST_CRYPTO_ERROR;
+  EVP_PKEY_CTX* verifier = EVP_PKEY_CTX_new((EVP_PKEY*)ctx->key, nullptr);
+  bool valid = verifier != nullptr && EVP_PKEY_verify_init(verifier) == 1 &&
+               EVP_PKEY_CTX_set_signature_md(verifier, EVP_sha256()) == 1 &&
+               EVP_PKEY_verify(verifier, signature, signatureLength, hash, hashLength) == 1;
+  EVP_PKEY_CTX_free(verifier);
+  return valid ? 0 : HOST_CRYPTO_ERROR;
+}
@@ -0,0 +1,232 @@
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <malloc.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "ota_host.h"
+
+// ====================================================================================
+// DEFAULT CLOCK
+// ====================================================================================
+
+class SteadyClock : public OtaHostClock {
+ public:
+  SteadyClock() : boot(std::chrono::steady_clock::now()) {}
+
+  uint64_t nowUs() override {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+  }
+
+  void sleepUs(uint64_t us) override { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+ private:
+  std::chrono::steady_clock::time_point boot;
+};
+
+// ====================================================================================
+// VIRTUAL CLOCK
+// ====================================================================================
+
+#define VIRTUAL_CLOCK_SPINS 20000
+
+uint64_t OtaHostVirtualClock::nowUs() {
+  return now.load();
+}
+
+void OtaHostVirtualClock::sleepUs(uint64_t us) {
+  std::unique_lock<std::mutex> lock(mutex);
+  // Until the first sleep nobody holds the turn, so the first sleeper has it
+  std::thread::id self = std::this_thread::get_id();
+  waitTurn(lock, now + us, runningThread == std::thread::id() || runningThread == self);
+}
+
+void OtaHostVirtualClock::taskCreating() {
+  std::lock_guard<std::mutex> lock(mutex);
+  starting++;
+}
+
+void OtaHostVirtualClock::taskStarted() {
+  std::unique_lock<std::mutex> lock(mutex);
+  starting--;
+  turnChanged.notify_all();
+  waitTurn(lock, now, false);
+}
+
+void OtaHostVirtualClock::waitTurn(std::unique_lock<std::mutex>& lock, uint64_t wakeUs, bool holdsTurn) {
+  uint64_t ticket = nextTicket++;
+  sleepers.push_back({wakeUs, ticket, std::this_thread::get_id()});
+  if (holdsTurn) {
+    // Tasks created during this turn join the queue first, so the order does
+    // not depend on how quickly the host started their threads
+    turnChanged.wait(lock, [this] { return starting == 0; });
+    auto next = std::min_element(sleepers.begin(), sleepers.end(), [](const Sleeper& a, const Sleeper& b) {
+      return a.wakeUs != b.wakeUs ? a.wakeUs < b.wakeUs : a.ticket < b.ticket;
+    });
+    if (next->wakeUs > now) now = next->wakeUs;
+    runningTicket = next->ticket;
+    runningThread = next->thread;
+    sleepers.erase(next);
+    turnChanged.notify_all();
+  }
+  // Turns pass every few microseconds of host time; waking a blocked thread
+  // takes far longer, so spin for a while before blocking
+  if (runningTicket != ticket) {
+    lock.unlock();
+    for (int spin = 0; spin < VIRTUAL_CLOCK_SPINS && runningTicket.load() != ticket; spin++) std::this_thread::yield();
+    lock.lock();
+  }
+  turnChanged.wait(lock, [this, ticket] { return runningTicket == ticket; });
+}
+
+// ====================================================================================
+// INSTALLATION
+// ====================================================================================
+
+OtaHostNetwork& otaHostPosixNetwork();
+OtaHostFlash& otaHostFileFlash();
+
+static OtaHostClock* installedClock = nullptr;
+static OtaHostNetwork* installedNetwork = nullptr;
+static OtaHostFlash* installedFlash = nullptr;
+
+void otaHostSetClock(OtaHostClock* clock) { installedClock = clock; }
+void otaHostSetNetwork(OtaHostNetwork* network) { installedNetwork = network; }
+void otaHostSetFlash(OtaHostFlash* flash) { installedFlash = flash; }
+
+OtaHostClock& otaHostClock() {
+  static SteadyClock steadyClock;
+  return installedClock != nullptr ? *installedClock : steadyClock;
+}
+
+OtaHostNetwork& otaHostNetwork() {
+  return installedNetwork != nullptr ? *installedNetwork : otaHostPosixNetwork();
+}
+
+OtaHostFlash& otaHostFlash() {
+  return installedFlash != nullptr ? *installedFlash : otaHostFileFlash();
+}
+
+OtaHostOptions& otaHostOptions() {
+  static OtaHostOptions options;
+  return options;
+}
+
+char* otaHostReadFile(const char* path, size_t* length) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) return nullptr;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char* data = size >= 0 ? (char*)malloc(size + 1) : nullptr;
+  if (data != nullptr && fread(data, 1, size, file) != (size_t)size) {
+    free(data);
+    data = nullptr;
+  }
+  fclose(file);
+  if (data == nullptr) return nullptr;
+  data[size] = '\0';
+  if (length != nullptr) *length = size;
+  return data;
+}
+
+// ====================================================================================
+// ARDUINO CORE
+// ====================================================================================
+
+HardwareSerial Serial;
+EspClass ESP;
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (!otaHostOptions().serialOutput) return size;
+  return fwrite(buffer, 1, size, stdout);
+}
+
+unsigned long millis() {
+  return (unsigned long)(otaHostClock().nowUs() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)otaHostClock().nowUs();
+}
+
+void delay(unsigned long ms) {
+  otaHostClock().sleepUs((uint64_t)ms * 1000);
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+int Stream::timedRead() {
+  unsigned long start = millis();
+  do {
+    int c = read();
+    if (c >= 0) return c;
+    delay(1);
+  } while (millis() - start < timeout);
+  return -1;
+}
+
+// The device heap is modelled as heapSize bytes of which everything the
+// process allocated since the first query is in use. glibc cannot report its
+// largest free chunk, so the largest allocatable block is the space above the
+// highest chunk still in use: free holes below a live allocation count as
+// free heap but not as allocatable, which is what fragmentation costs.
+static size_t heapBaseline = 0;
+static size_t extentBaseline = 0;
+static uint32_t minFreeHeap = UINT32_MAX;
+
+static uint32_t modelledBytes(size_t bytes, size_t baseline) {
+  size_t used = bytes > baseline ? bytes - baseline : 0;
+  uint32_t heapSize = otaHostOptions().heapSize;
+  return used < heapSize ? heapSize - (uint32_t)used : 0;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  struct mallinfo2 info = mallinfo2();
+  if (heapBaseline == 0) {
+    heapBaseline = info.uordblks;
+    extentBaseline = info.arena - info.keepcost; // keepcost is the free top chunk
+  }
+  uint32_t freeHeap = modelledBytes(info.uordblks, heapBaseline);
+  if (freeHeap < minFreeHeap) minFreeHeap = freeHeap;
+  return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  getFreeHeap();
+  return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  uint32_t freeHeap = getFreeHeap();
+  struct mallinfo2 info = mallinfo2();
+  uint32_t aboveExtent = modelledBytes(info.arena - info.keepcost, extentBaseline);
+  return aboveExtent < freeHeap ? aboveExtent : freeHeap;
+}
+
+#define NO_MALLOC_CACHE "glibc.malloc.tcache_count=0"
+
+void otaHostStableHeap(char** argv, size_t mmapThreshold) {
+  const char* tunables = getenv("GLIBC_TUNABLES");
+  if (tunables == nullptr || strstr(tunables, NO_MALLOC_CACHE) == nullptr) {
+    std::string value = tunables != nullptr ? std::string(tunables) + ":" NO_MALLOC_CACHE : NO_MALLOC_CACHE;
+    setenv("GLIBC_TUNABLES", value.c_str(), 1);
+    execv("/proc/self/exe", argv);
+    fprintf(stderr, "could not turn off the malloc cache; heap numbers will drift\n");
+  }
+  // One arena, and large buffers outside it
+  mallopt(M_ARENA_MAX, 1);
+  mallopt(M_MMAP_THRESHOLD, (int)mmapThreshold);
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(otaHostClock().nowUs() * getCpuFreqMHz());
+}
+
+void EspClass::restart() {
+  fflush(stdout);
+  throw OtaHostRestart();
+}
@@ -0,0 +1,152 @@
+#include <HTTPClient.h>
+#include <strings.h>
+
+// Splits "scheme://host[:port]/path" like the device HTTPClient does
+bool HTTPClient::begin(WiFiClient& client, const char* url) {
+  this->client = &client;
+  extraHeaders.clear();
+  collected.clear();
+  size = -1;
+  canReuse = false;
+
+  const char* schemeEnd = strstr(url, "://");
+  if (schemeEnd == nullptr) return false;
+  bool https = strncmp(url, "https", 5) == 0;
+  const char* hostStart = schemeEnd + 3;
+  const char* pathStart = strchr(hostStart, '/');
+  std::string authority = pathStart == nullptr ? std::string(hostStart) : std::string(hostStart, pathStart);
+  uri = pathStart == nullptr ? "/" : pathStart;
+
+  size_t colon = authority.find(':');
+  if (colon == std::string::npos) {
+    host = authority;
+    port = https ? 443 : 80;
+  } else {
+    host = authority.substr(0, colon);
+    port = (uint16_t)atoi(authority.c_str() + colon + 1);
+  }
+  return !host.empty();
+}
+
+void HTTPClient::end() {
+  if (client == nullptr) return;
+  if (client->connected()) {
+    client->flush();
+    if (!reuse || !canReuse) client->stop();
+  }
+  client = nullptr;
+}
+
+void HTTPClient::addHeader(const char* name, const char* value) {
+  extraHeaders += name;
+  extraHeaders += ": ";
+  extraHeaders += value;
+  extraHeaders += "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], size_t count) {
+  collected.clear();
+  for (size_t i = 0; i < count; i++) collected.emplace_back(headerKeys[i], "");
+}
+
+String HTTPClient::header(const char* name) {
+  for (const auto& entry : collected) {
+    if (strcasecmp(entry.first.c_str(), name) == 0) return String(entry.second);
+  }
+  return String();
+}
+
+bool HTTPClient::hasHeader(const char* name) {
+  for (const auto& entry : collected) {
+    if (strcasecmp(entry.first.c_str(), name) == 0) return !entry.second.empty();
+  }
+  return false;
+}
+
+int HTTPClient::sendRequest(const char* method, uint8_t* payload, size_t payloadSize) {
+  if (client == nullptr) return HTTPC_ERROR_NOT_CONNECTED;
+  for (auto& entry : collected) entry.second.clear();
+  size = -1;
+  canReuse = false;
+
+  // Like the device client, an open connection is reused whatever it points at
+  if (!client->connected()) {
+    client->setTimeout(timeout);
+    if (!client->connect(host.c_str(), port)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  client->setTimeout(timeout);
+
+  std::string request = std::string(method) + " " + uri + " HTTP/1.1\r\nHost: " + host;
+  if (port != 80 && port != 443) request += ":" + std::to_string(port);
+  request += "\r\nUser-Agent: " + userAgent + "\r\nConnection: " + (reuse ? "keep-alive" : "close") + "\r\n";
+  if (payload != nullptr || strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0) {
+    request += "Content-Length: " + std::to_string(payloadSize) + "\r\n";
+  }
+  request += extraHeaders + "\r\n";
+  if (client->write((const uint8_t*)request.data(), request.size()) != request.size()) {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (payload != nullptr && payloadSize > 0 && client->write(payload, payloadSize) != payloadSize) {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  int code = readResponseHeaders();
+  if (code > 0 && strcmp(method, "HEAD") == 0) size = 0;
+  return code;
+}
+
+bool HTTPClient::readLine(std::string& line) {
+  line.clear();
+  while (true) {
+    uint8_t c;
+    if (client->readBytes(&c, 1) != 1) return false;
+    if (c == '\n') break;
+    if (c != '\r') line += (char)c;
+  }
+  return true;
+}
+
+int HTTPClient::readResponseHeaders() {
+  std::string line;
+  int code = 0;
+  bool http11 = false;
+  bool keepAlive = false;
+  bool closeRequested = false;
+  bool chunked = false;
+  while (true) {
+    if (!readLine(line)) return client->connected() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    if (code == 0) {
+      // Status line; skip any interim 1xx response
+      if (strncmp(line.c_str(), "HTTP/1.", 7) != 0) return HTTPC_ERROR_NO_HTTP_SERVER;
+      http11 = line[7] == '1';
+      code = atoi(line.c_str() + 9);
+      if (code >= 100 && code < 200) {
+        while (readLine(line) && !line.empty()) {
+        }
+        code = 0;
+      }
+      continue;
+    }
+    if (line.empty()) break;
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name = line.substr(0, colon);
+    size_t valueStart = line.find_first_not_of(' ', colon + 1);
+    std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+    if (strcasecmp(name.c_str(), "Content-Length") == 0) size = atoi(value.c_str());
+    if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0 && strcasecmp(value.c_str(), "chunked") == 0) {
+      chunked = true;
+    }
+    if (strcasecmp(name.c_str(), "Connection") == 0) {
+      keepAlive = strcasecmp(value.c_str(), "keep-alive") == 0;
+      closeRequested = strcasecmp(value.c_str(), "close") == 0;
+    }
+    for (auto& entry : collected) {
+      if (strcasecmp(entry.first.c_str(), name.c_str()) == 0) entry.second = value;
+    }
+  }
+  if (chunked) size = -1;
+  canReuse = !closeRequested && (http11 || keepAlive);
+  return code;
+}
@@ -0,0 +1,259 @@
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiClass WiFi;
+
+// ====================================================================================
+// POSIX NETWORK
+// ====================================================================================
+
+class PosixSocket : public OtaHostSocket {
+ public:
+  explicit PosixSocket(int fd) : fd(fd) {}
+  ~PosixSocket() override { close(); }
+
+  int available() override {
+    if (fd < 0) return 0;
+    int pending = 0;
+    if (ioctl(fd, FIONREAD, &pending) != 0) return 0;
+    return pending;
+  }
+
+  int read(uint8_t* buffer, size_t size, uint32_t timeoutMs) override {
+    if (fd < 0 || peerClosed) return -1;
+    pollfd waiter = {fd, POLLIN, 0};
+    int ready = poll(&waiter, 1, (int)timeoutMs);
+    if (ready <= 0) return 0;
+    ssize_t count = recv(fd, buffer, size, MSG_DONTWAIT);
+    if (count > 0) return (int)count;
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    peerClosed = true;
+    return -1;
+  }
+
+  bool write(const uint8_t* data, size_t size) override {
+    while (fd >= 0 && size > 0) {
+      ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR) continue;
+      if (sent <= 0) return false;
+      data += sent;
+      size -= sent;
+    }
+    return fd >= 0;
+  }
+
+  bool connected() override {
+    if (fd < 0) return false;
+    if (available() > 0) return true;
+    if (peerClosed) return false;
+    uint8_t probe;
+    ssize_t count = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) peerClosed = true;
+    return !peerClosed;
+  }
+
+  void close() override {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+  }
+
+ private:
+  int fd;
+  bool peerClosed = false;
+};
+
+class PosixNetwork : public OtaHostNetwork {
+ public:
+  std::unique_ptr<OtaHostSocket> connect(const char* host, uint16_t port, uint32_t timeoutMs) override {
+    const OtaHostOptions& options = otaHostOptions();
+    if (options.serverHost != nullptr) {
+      host = options.serverHost;
+      port = options.serverPort;
+    }
+    uint32_t address;
+    if (!resolveDirect(host, address)) return nullptr;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) return nullptr;
+    sockaddr_in peer = {};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(port);
+    peer.sin_addr.s_addr = address;
+    if (::connect(fd, (sockaddr*)&peer, sizeof(peer)) != 0 && errno != EINPROGRESS) {
+      ::close(fd);
+      return nullptr;
+    }
+    pollfd waiter = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t errorLength = sizeof(error);
+    if (poll(&waiter, 1, (int)timeoutMs) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) != 0 ||
+        error != 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return std::unique_ptr<OtaHostSocket>(new PosixSocket(fd));
+  }
+
+  bool resolve(const char* host, uint32_t& address) override {
+    const OtaHostOptions& options = otaHostOptions();
+    return resolveDirect(options.serverHost != nullptr ? options.serverHost : host, address);
+  }
+
+ private:
+  static bool resolveDirect(const char* host, uint32_t& address) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0 || result == nullptr) return false;
+    address = ((sockaddr_in*)result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+    return true;
+  }
+};
+
+OtaHostNetwork& otaHostPosixNetwork() {
+  static PosixNetwork network;
+  return network;
+}
+
+// ====================================================================================
+// WIFI CLIENT
+// ====================================================================================
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  stop();
+  socket = otaHostNetwork().connect(host, port, getTimeout() > 0 ? getTimeout() : 5000);
+  return socket != nullptr ? 1 : 0;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  char host[16];
+  snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return connect(host, port);
+}
+
+void WiFiClient::stop() {
+  if (socket != nullptr) socket->close();
+  socket.reset();
+  peeked = -1;
+}
+
+uint8_t WiFiClient::connected() {
+  return socket != nullptr && (peeked >= 0 || socket->connected());
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  return socket != nullptr && socket->write(buffer, size) ? size : 0;
+}
+
+int WiFiClient::available() {
+  if (socket == nullptr) return 0;
+  return (peeked >= 0 ? 1 : 0) + socket->available();
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (socket == nullptr || size == 0) return -1;
+  size_t count = 0;
+  if (peeked >= 0) {
+    buffer[count++] = (uint8_t)peeked;
+    peeked = -1;
+  }
+  if (count < size && socket->available() > 0) {
+    int more = socket->read(buffer + count, size - count, 0);
+    if (more > 0) count += more;
+  }
+  return count > 0 ? (int)count : -1;
+}
+
+int WiFiClient::peek() {
+  if (peeked < 0) {
+    uint8_t c;
+    if (socket != nullptr && socket->read(&c, 1, 0) == 1) peeked = c;
+  }
+  return peeked;
+}
+
+size_t WiFiClient::readBytes(uint8_t* buffer, size_t length) {
+  if (socket == nullptr) return 0;
+  size_t count = 0;
+  if (peeked >= 0 && length > 0) {
+    buffer[count++] = (uint8_t)peeked;
+    peeked = -1;
+  }
+  while (count < length) {
+    int more = socket->read(buffer + count, length - count, getTimeout());
+    if (more <= 0) break;
+    count += more;
+  }
+  return count;
+}
+
+void WiFiClient::flush() {
+  uint8_t discard[256];
+  while (available() > 0 && read(discard, sizeof(discard)) > 0) {
+  }
+}
+
+// ====================================================================================
+// WIFI SERVER
+// ====================================================================================
+
+WiFiServer::~WiFiServer() {
+  if (listenFd >= 0) ::close(listenFd);
+}
+
+void WiFiServer::begin() {
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (listenFd < 0) return;
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listenFd, (sockaddr*)&local, sizeof(local)) != 0 || listen(listenFd, 4) != 0) {
+    ::close(listenFd);
+    listenFd = -1;
+  }
+}
+
+WiFiClient WiFiServer::available() {
+  if (listenFd < 0) return WiFiClient();
+  int fd = accept(listenFd, nullptr, nullptr);
+  if (fd < 0) return WiFiClient();
+  return WiFiClient(std::make_shared<PosixSocket>(fd));
+}
+
+// ====================================================================================
+// WIFI
+// ====================================================================================
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+  uint32_t address;
+  if (!otaHostNetwork().resolve(host, address)) return 0;
+  result = IPAddress(address);
+  return 1;
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  static const uint8_t hostMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}; // locally administered
+  memcpy(mac, hostMac, sizeof(hostMac));
+  return mac;
+}
@@ -0,0 +1,67 @@
+#include <Preferences.h>
+#include <sys/stat.h>
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  std::string root = otaHostOptions().nvsDir;
+  directory = root + "/" + name;
+  this->readOnly = readOnly;
+  struct stat info;
+  if (stat(directory.c_str(), &info) != 0) {
+    // As on the device, a read-only open of a namespace that was never written fails
+    if (readOnly) return false;
+    mkdir(root.c_str(), 0755);
+    if (mkdir(directory.c_str(), 0755) != 0) return false;
+  }
+  open = true;
+  return true;
+}
+
+void Preferences::end() {
+  open = false;
+}
+
+std::string Preferences::path(const char* key) const {
+  return directory + "/" + key;
+}
+
+uint32_t Preferences::getULong(const char* key, uint32_t defaultValue) {
+  uint32_t value;
+  return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putULong(const char* key, uint32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  struct stat info;
+  if (!open || stat(path(key).c_str(), &info) != 0) return 0;
+  return (size_t)info.st_size;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t length) {
+  if (!open) return 0;
+  size_t stored = getBytesLength(key);
+  if (stored == 0 || stored > length) return 0;
+  FILE* file = fopen(path(key).c_str(), "rb");
+  if (file == nullptr) return 0;
+  size_t count = fread(buffer, 1, stored, file);
+  fclose(file);
+  return count;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+  if (!open || readOnly) return 0;
+  // Written to a temporary and renamed, so a crash never leaves half a value
+  std::string target = path(key);
+  std::string temporary = target + ".tmp";
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) return 0;
+  size_t count = fwrite(value, 1, length, file);
+  bool ok = fclose(file) == 0 && count == length && rename(temporary.c_str(), target.c_str()) == 0;
+  return ok ? length : 0;
+}
+
+bool Preferences::remove(const char* key) {
+  return open && !readOnly && ::remove(path(key).c_str()) == 0;
+}
@@ -0,0 +1,55 @@
+#include <Arduino.h>
+#include <string>
+#include <thread>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ota_host.h"
+
+struct OtaHostTask {
+  std::string name;
+  uint32_t stackDepth;
+};
+
+// The thread that runs setup() and loop()
+static OtaHostTask loopTask = {"loopTask", 8192};
+static thread_local OtaHostTask* currentTask = &loopTask;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                       UBaseType_t, TaskHandle_t* handle) {
+  // Tasks live until the process ends, like the firmware's own tasks
+  OtaHostTask* task = new OtaHostTask{name, stackDepth};
+  OtaHostClock* clock = &otaHostClock();
+  clock->taskCreating();
+  std::thread([task, function, parameter, clock] {
+    clock->taskStarted();
+    currentTask = task;
+    function(parameter);
+  }).detach();
+  if (handle != nullptr) *handle = task;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t) {
+  return xTaskCreate(function, name, stackDepth, parameter, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask;
+}
+
+const char* pcTaskGetTaskName(TaskHandle_t task) {
+  return (task != nullptr ? task : currentTask)->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return (task != nullptr ? task : currentTask)->stackDepth;
+}
+
+BaseType_t xPortGetCoreID() {
+  return currentTask == &loopTask ? 1 : 0; // The Arduino loop task runs on core 1
+}
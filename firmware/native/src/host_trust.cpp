@@ -0,0 +1,36 @@
+#include "ota_trust.h"
+
+#include <string.h>
+#include "ota_log.h"
+
+// Host replacement for ota_trust.cpp. The host transport has no TLS, so the
+// table only records policies for the log; every peer is accepted.
+
+static OtaTrustEntry defaultEntry = {0, "", OTA_TRUST_BUNDLE, nullptr, nullptr, nullptr, {}};
+
+void otaTrustSetDefault(OtaTrustMode mode, const char* pem) {
+  defaultEntry.mode = mode;
+  defaultEntry.pem = pem;
+}
+
+bool otaTrustAddHost(const char*, OtaTrustMode, const char*) { return true; }
+bool otaTrustAddPinnedHost(const char*, const char* spkiSha256Hex) { return strlen(spkiSha256Hex) == 64; }
+bool otaTrustAddPskHost(const char*, const char*, const char*) { return true; }
+const OtaTrustEntry* otaTrustLookup(const char*) { return &defaultEntry; }
+void otaTrustApply(WiFiClientSecure&, const char*) {}
+bool otaTrustVerifyPeer(WiFiClientSecure&, const char*) { return true; }
+
+const char* otaTrustModeName(OtaTrustMode mode) {
+  switch (mode) {
+    case OTA_TRUST_BUNDLE: return "bundle";
+    case OTA_TRUST_PEM: return "pem";
+    case OTA_TRUST_INSECURE: return "insecure";
+    case OTA_TRUST_SPKI_PIN: return "pin";
+    case OTA_TRUST_PSK: return "psk";
+  }
+  return "unknown";
+}
+
+void otaTrustBenchmark(const char*, uint16_t, const char*, int) {
+  OTA_LOGW("TLS benchmark is not available in the native build.");
+}
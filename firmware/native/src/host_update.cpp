@@ -0,0 +1,120 @@
+#include <Update.h>
+
+// ====================================================================================
+// FILE-BACKED PARTITION
+// ====================================================================================
+
+class FileFlash : public OtaHostFlash {
+ public:
+  ~FileFlash() override {
+    if (file != nullptr) fclose(file);
+  }
+
+  size_t size() override { return otaHostOptions().flashSize; }
+
+  bool erase(size_t offset, size_t length) override {
+    if (!open() || offset + length > size()) return false;
+    uint8_t ones[OTA_HOST_FLASH_SECTOR_SIZE];
+    memset(ones, 0xFF, sizeof(ones));
+    fseek(file, (long)offset, SEEK_SET);
+    for (size_t done = 0; done < length; done += sizeof(ones)) {
+      size_t chunk = length - done < sizeof(ones) ? length - done : sizeof(ones);
+      if (fwrite(ones, 1, chunk, file) != chunk) return false;
+    }
+    return true;
+  }
+
+  bool program(size_t offset, const uint8_t* data, size_t length) override {
+    if (!open() || offset + length > size()) return false;
+    fseek(file, (long)offset, SEEK_SET);
+    return fwrite(data, 1, length, file) == length;
+  }
+
+  bool activate(size_t) override { return open() && fflush(file) == 0; }
+
+ private:
+  bool open() {
+    if (file == nullptr) file = fopen(otaHostOptions().flashPath, "w+b");
+    return file != nullptr;
+  }
+
+  FILE* file = nullptr;
+};
+
+OtaHostFlash& otaHostFileFlash() {
+  static FileFlash flash;
+  return flash;
+}
+
+// ====================================================================================
+// UPDATE
+// ====================================================================================
+
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size) {
+  if (running) abort();
+  error = "No Error";
+  if (size == 0 || size == UPDATE_SIZE_UNKNOWN || size > otaHostFlash().size()) {
+    error = "Not Enough Space";
+    return false;
+  }
+  imageSize = size;
+  written = 0;
+  sectorFill = 0;
+  running = true;
+  return true;
+}
+
+bool UpdateClass::flushSector() {
+  size_t offset = written - sectorFill;
+  OtaHostFlash& flash = otaHostFlash();
+  if (!flash.erase(offset, OTA_HOST_FLASH_SECTOR_SIZE) || !flash.program(offset, sector, sectorFill)) {
+    error = "Flash Write Failed";
+    running = false;
+    return false;
+  }
+  sectorFill = 0;
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t length) {
+  if (!running) return 0;
+  if (length > imageSize - written) {
+    error = "Flash Write Failed";
+    abort();
+    return 0;
+  }
+  size_t consumed = 0;
+  while (consumed < length) {
+    size_t chunk = length - consumed;
+    if (chunk > sizeof(sector) - sectorFill) chunk = sizeof(sector) - sectorFill;
+    memcpy(sector + sectorFill, data + consumed, chunk);
+    sectorFill += chunk;
+    written += chunk;
+    consumed += chunk;
+    if ((sectorFill == sizeof(sector) || written == imageSize) && !flushSector()) return 0;
+  }
+  return consumed;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+  if (!running) return false;
+  if (written < imageSize && !evenIfRemaining) {
+    error = "Premature END";
+    abort();
+    return false;
+  }
+  if (sectorFill > 0 && !flushSector()) return false;
+  running = false;
+  if (!otaHostFlash().activate(written)) {
+    error = "Activation Failed";
+    return false;
+  }
+  return true;
+}
+
+void UpdateClass::abort() {
+  running = false;
+  sectorFill = 0;
+}
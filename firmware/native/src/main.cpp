@@ -0,0 +1,131 @@
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ota_host.h"
+#include "ota_trace.h"
+
+// ====================================================================================
+// NATIVE RUNNER
+// ====================================================================================
+//
+// Boots the firmware on the host: setup() once, then loop() until the device
+// restarts (an update was installed) or --run-ms elapses.
+//
+//   .pio/build/native/program --server 127.0.0.1:8080 --public-key public.pem
+//
+// With --clock virtual, millis() and delay() run on simulated time: the loop
+// timers, check interval and backoff play out without waiting, so
+// `--clock virtual --run-ms 86400000` covers a day of polling. Socket waits
+// still take real time.
+//
+// With --trace FILE (needs a build with -DOTA_TRACE=1, e.g. pio run -e
+// native_trace) the timeline of every check goes to FILE as one Chrome trace
+// instead of stdout; open it in chrome://tracing or ui.perfetto.dev.
+//
+// Exit status: 0 after a restart or when the time is up, 2 on bad arguments.
+
+void setup();
+void loop();
+
+// Print over a stdio file, for the trace output
+class FilePrint : public Print {
+ public:
+  explicit FilePrint(FILE* file) : file(file) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, file); }
+  using Print::write;
+  void flush() override { fflush(file); }
+
+ private:
+  FILE* file;
+};
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [--server HOST:PORT] [--version VERSION] [--public-key FILE]\n"
+          "          [--flash FILE] [--flash-size BYTES] [--nvs DIR] [--run-ms MS] [--clock real|virtual]\n"
+          "          [--trace FILE]\n",
+          program);
+}
+
+int main(int argc, char** argv) {
+  setvbuf(stdout, nullptr, _IOLBF, 0); // Serial output interleaves with the server's log
+  OtaHostOptions& options = otaHostOptions();
+  unsigned long runMs = 0; // 0 = until restart
+  OtaHostVirtualClock virtualClock;
+  FILE* traceFile = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+
+    if (strcmp(arg, "--server") == 0) {
+      const char* colon = strrchr(value, ':');
+      if (colon == nullptr) {
+        usage(argv[0]);
+        return 2;
+      }
+      options.serverHost = strndup(value, colon - value);
+      options.serverPort = (uint16_t)atoi(colon + 1);
+    } else if (strcmp(arg, "--version") == 0) {
+      options.firmwareVersion = value;
+    } else if (strcmp(arg, "--public-key") == 0) {
+      options.publicKey = otaHostReadFile(value);
+      if (options.publicKey == nullptr) {
+        fprintf(stderr, "cannot read %s\n", value);
+        return 2;
+      }
+    } else if (strcmp(arg, "--flash") == 0) {
+      options.flashPath = value;
+    } else if (strcmp(arg, "--flash-size") == 0) {
+      options.flashSize = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--nvs") == 0) {
+      options.nvsDir = value;
+    } else if (strcmp(arg, "--run-ms") == 0) {
+      runMs = strtoul(value, nullptr, 0);
+    } else if (strcmp(arg, "--clock") == 0 && (strcmp(value, "real") == 0 || strcmp(value, "virtual") == 0)) {
+      otaHostSetClock(strcmp(value, "virtual") == 0 ? &virtualClock : nullptr);
+    } else if (strcmp(arg, "--trace") == 0) {
+      if (!OTA_TRACE) {
+        fprintf(stderr, "--trace needs a build with -DOTA_TRACE=1 (pio run -e native_trace)\n");
+        return 2;
+      }
+      if ((traceFile = fopen(value, "w")) == nullptr) {
+        fprintf(stderr, "cannot write %s\n", value);
+        return 2;
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+#if OTA_TRACE
+  FilePrint trace(traceFile);
+  if (traceFile != nullptr) {
+    fputs("[\n", traceFile);
+    otaTraceSetOutput(&trace);
+  }
+#endif
+
+  try {
+    setup();
+    while (runMs == 0 || millis() < runMs) {
+      loop();
+      delay(1);
+    }
+  } catch (const OtaHostRestart&) {
+    fprintf(stderr, "[native] device restarted\n");
+  }
+  fflush(stdout);
+  if (traceFile != nullptr) {
+    fputs("\n]\n", traceFile);
+    fclose(traceFile);
+  }
+  return 0;
+}
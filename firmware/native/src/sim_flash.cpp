@@ -0,0 +1,29 @@
+#include <string.h>
+#include "ota_sim.h"
+
+// ====================================================================================
+// SIMULATED FLASH
+// ====================================================================================
+
+bool OtaSimFlash::erase(size_t offset, size_t length) {
+  if (offset + length > size()) return false;
+  if (data.size() < offset + length) data.resize(offset + length, 0xFF);
+  memset(data.data() + offset, 0xFF, length);
+  size_t sectors = (length + OTA_HOST_FLASH_SECTOR_SIZE - 1) / OTA_HOST_FLASH_SECTOR_SIZE;
+  otaHostClock().sleepUs((uint64_t)sectors * model.eraseUsPerSector);
+  return true;
+}
+
+bool OtaSimFlash::program(size_t offset, const uint8_t* bytes, size_t length) {
+  if (offset + length > data.size()) return false;
+  // NOR flash can only clear bits
+  for (size_t i = 0; i < length; i++) data[offset + i] &= bytes[i];
+  size_t pages = (length + OTA_SIM_FLASH_PAGE_SIZE - 1) / OTA_SIM_FLASH_PAGE_SIZE;
+  otaHostClock().sleepUs((uint64_t)pages * model.programUsPerPage);
+  return true;
+}
+
+bool OtaSimFlash::activate(size_t imageSize) {
+  activated = imageSize;
+  return true;
+}
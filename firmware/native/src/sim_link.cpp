@@ -0,0 +1,355 @@
+#include <string.h>
+#include <strings.h>
+#include "ota_sim.h"
+
+// ====================================================================================
+// PROFILES
+// ====================================================================================
+
+// The window is lwIP's default TCP_WND on the ESP32 (4 segments), which is
+// what caps throughput on links with any real round trip.
+const OtaSimLink otaSimLinks[] = {
+    // name      kbps   rtt     jitter  loss    stall every  stall     window
+    {"wifi", 12000, 20000, 4000, 0.002f, 0, 0, 5744},
+    {"lan", 80000, 1000, 0, 0.0f, 0, 0, 5744},
+    {"cellular", 4000, 90000, 20000, 0.005f, 0, 0, 5744},
+    {"weak", 1000, 150000, 40000, 0.02f, 256 * 1024, 2000000, 5744},
+};
+const size_t otaSimLinkCount = sizeof(otaSimLinks) / sizeof(otaSimLinks[0]);
+
+const OtaSimFlashModel otaSimFlashModels[] = {
+    // name    erase/sector  program/page
+    {"esp32", 30000, 500},
+    {"none", 0, 0},
+};
+const size_t otaSimFlashModelCount = sizeof(otaSimFlashModels) / sizeof(otaSimFlashModels[0]);
+
+const OtaSimLink* otaSimFindLink(const char* name) {
+  for (size_t i = 0; i < otaSimLinkCount; i++) {
+    if (strcmp(otaSimLinks[i].name, name) == 0) return &otaSimLinks[i];
+  }
+  return nullptr;
+}
+
+const OtaSimFlashModel* otaSimFindFlashModel(const char* name) {
+  for (size_t i = 0; i < otaSimFlashModelCount; i++) {
+    if (strcmp(otaSimFlashModels[i].name, name) == 0) return &otaSimFlashModels[i];
+  }
+  return nullptr;
+}
+
+// ====================================================================================
+// SERVER
+// ====================================================================================
+
+const std::string* OtaSimServer::find(const std::string& path) const {
+  auto file = files.find(path.substr(0, path.find('?')));
+  return file != files.end() ? &file->second : nullptr;
+}
+
+OtaSimResponse OtaSimServer::handle(const OtaSimRequest& request) {
+  OtaSimResponse response;
+  if (request.method != "GET" && request.method != "HEAD") {
+    response.status = 405;
+    return response;
+  }
+  const std::string* file = find(request.path);
+  if (file == nullptr) {
+    response.status = 404;
+    response.body = "not found\n";
+    return response;
+  }
+  response.headers.emplace_back("Content-Type", "application/octet-stream");
+  response.body = *file;
+  return response;
+}
+
+static const char* reasonPhrase(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    default: return "Status";
+  }
+}
+
+std::string OtaSimServer::encode(const OtaSimResponse& response, bool headOnly, size_t* bodyStart) {
+  std::string wire = "HTTP/1.1 " + std::to_string(response.status) + " " + reasonPhrase(response.status) + "\r\n";
+  bool hasLength = false;
+  for (const auto& header : response.headers) {
+    if (strcasecmp(header.first.c_str(), "Content-Length") == 0 ||
+        strcasecmp(header.first.c_str(), "Transfer-Encoding") == 0) {
+      hasLength = true;
+    }
+    wire += header.first + ": " + header.second + "\r\n";
+  }
+  if (!hasLength) wire += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+  if (response.close) wire += "Connection: close\r\n";
+  wire += "\r\n";
+  if (bodyStart != nullptr) *bodyStart = wire.size();
+  if (!headOnly) wire += response.body;
+  return wire;
+}
+
+// ====================================================================================
+// CONNECTION
+// ====================================================================================
+
+// One connection to the simulated server. Response bytes leave the server in
+// segments at the link rate, but never more than the receive window ahead of
+// what the device has read (as acknowledged half a round trip later), and
+// arrive in order after half a round trip plus jitter. Replayed body bytes
+// leave as soon as the window allows and arrive at their recorded time.
+class SimSocket : public OtaHostSocket {
+ public:
+  explicit SimSocket(OtaSimNetwork& network) : network(network), link(network.link) {
+    nextStall = link.stallEveryBytes;
+  }
+
+  int available() override {
+    if (closed) return 0;
+    schedule();
+    return (int)(arrivedEnd(otaHostClock().nowUs()) - readOffset);
+  }
+
+  int read(uint8_t* buffer, size_t size, uint32_t timeoutMs) override {
+    if (closed) return -1;
+    OtaHostClock& clock = otaHostClock();
+    uint64_t deadline = clock.nowUs() + (uint64_t)timeoutMs * 1000;
+    while (true) {
+      schedule();
+      uint64_t now = clock.nowUs();
+      size_t arrived = arrivedEnd(now);
+      if (arrived > readOffset) {
+        size_t count = arrived - readOffset < size ? arrived - readOffset : size;
+        memcpy(buffer, outbound.data() + readOffset, count);
+        readOffset += count;
+        acks.push_back({readOffset, now + link.rttUs / 2});
+        network.stats.bytesDelivered += count;
+        while (!inFlight.empty() && inFlight.front().end <= readOffset) inFlight.pop_front();
+        return (int)count;
+      }
+      if (drained()) return -1;
+      if (now >= deadline) return 0;
+
+      uint64_t wake = deadline;
+      if (!inFlight.empty() && inFlight.front().arrivalUs < wake) wake = inFlight.front().arrivalUs;
+      clock.sleepUs(wake - now);
+    }
+  }
+
+  bool write(const uint8_t* data, size_t size) override {
+    if (closed || closeAt != std::string::npos) return false;
+    inbound.append((const char*)data, size);
+    while (closeAt == std::string::npos && serveOneRequest()) {
+    }
+    return true;
+  }
+
+  bool connected() override {
+    if (closed) return false;
+    schedule();
+    return !drained();
+  }
+
+  void close() override { closed = true; }
+
+ private:
+  struct Segment {
+    size_t end;
+    uint64_t arrivalUs;
+  };
+  struct Ack {
+    size_t offset;
+    uint64_t atUs;
+  };
+  struct Pause {
+    size_t offset;
+    uint32_t us;
+  };
+  struct Arrival {
+    size_t start;
+    size_t end;
+    uint64_t atUs;
+  };
+
+  bool drained() const { return closeAt != std::string::npos && readOffset >= closeAt; }
+
+  // Handles the first complete request in `inbound`, if there is one
+  bool serveOneRequest() {
+    size_t headerEnd = inbound.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) return false;
+
+    OtaSimRequest request;
+    size_t lineEnd = inbound.find("\r\n");
+    std::string requestLine = inbound.substr(0, lineEnd);
+    size_t methodEnd = requestLine.find(' ');
+    size_t pathEnd = requestLine.find(' ', methodEnd + 1);
+    request.method = requestLine.substr(0, methodEnd);
+    request.path = requestLine.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+    for (size_t start = lineEnd + 2; start < headerEnd;) {
+      size_t end = inbound.find("\r\n", start);
+      std::string line = inbound.substr(start, end - start);
+      size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        std::string name = line.substr(0, colon);
+        for (char& c : name) c = (char)tolower((unsigned char)c);
+        size_t valueStart = line.find_first_not_of(' ', colon + 1);
+        request.headers[name] = valueStart == std::string::npos ? "" : line.substr(valueStart);
+      }
+      start = end + 2;
+    }
+    size_t bodyLength = 0;
+    auto length = request.headers.find("content-length");
+    if (length != request.headers.end()) bodyLength = strtoul(length->second.c_str(), nullptr, 10);
+    if (inbound.size() < headerEnd + 4 + bodyLength) return false;
+    request.body = inbound.substr(headerEnd + 4, bodyLength);
+    inbound.erase(0, headerEnd + 4 + bodyLength);
+
+    network.stats.requests++;
+    OtaSimResponse response = network.server.handle(request);
+    auto connection = request.headers.find("connection");
+    if (connection != request.headers.end() && strcasecmp(connection->second.c_str(), "close") == 0) {
+      response.close = true;
+    }
+    // The request reaches the server half a round trip after it was sent
+    uint64_t receivedUs = otaHostClock().nowUs() + link.rttUs / 2;
+    size_t bodyStart;
+    std::string wire = OtaSimServer::encode(response, request.method == "HEAD", &bodyStart);
+    bodyStart += outbound.size();
+    if (request.method != "HEAD") {
+      for (const auto& pause : response.pauses) pauses.push_back({bodyStart + pause.first, pause.second});
+      // The recorded times count from when the headers reached the device
+      size_t start = bodyStart;
+      for (const auto& arrival : response.arrivals) {
+        size_t end = bodyStart + arrival.first;
+        arrivals.push_back({start, end, receivedUs + link.rttUs / 2 + arrival.second});
+        start = end;
+      }
+      if (response.cutAfter < response.body.size()) {
+        wire.resize(wire.size() - response.body.size() + response.cutAfter);
+        response.close = true;
+      }
+    }
+    outbound += wire;
+    readyUs = receivedUs;
+    if (response.close) closeAt = outbound.size();
+    return true;
+  }
+
+  // Puts every segment the sender may transmit by now on the wire
+  void schedule() {
+    while (scheduledEnd < outbound.size()) {
+      size_t length = outbound.size() - scheduledEnd;
+      if (length > OTA_SIM_SEGMENT_SIZE) length = OTA_SIM_SEGMENT_SIZE;
+      uint64_t departUs = senderFreeUs > readyUs ? senderFreeUs : readyUs;
+
+      // A pause point starts a new segment, and so do replayed arrivals
+      if (!pauses.empty() && pauses.front().offset > scheduledEnd && pauses.front().offset < scheduledEnd + length) {
+        length = pauses.front().offset - scheduledEnd;
+      }
+      while (!arrivals.empty() && arrivals.front().end <= scheduledEnd) arrivals.pop_front();
+      const Arrival* replayed = nullptr;
+      if (!arrivals.empty() && arrivals.front().start <= scheduledEnd) {
+        replayed = &arrivals.front();
+        if (replayed->end < scheduledEnd + length) length = replayed->end - scheduledEnd;
+      } else if (!arrivals.empty() && arrivals.front().start < scheduledEnd + length) {
+        length = arrivals.front().start - scheduledEnd;
+      }
+      size_t end = scheduledEnd + length;
+      if (end > link.windowBytes) {
+        size_t needed = end - link.windowBytes;
+        if (needed > readOffset) break; // Window full until the device reads more
+        while (acks.front().offset < needed) acks.pop_front();
+        if (acks.front().atUs > departUs) departUs = acks.front().atUs;
+      }
+      if (link.stallEveryBytes > 0 && scheduledEnd >= nextStall) {
+        departUs += link.stallUs;
+        nextStall += link.stallEveryBytes;
+      }
+      while (!pauses.empty() && pauses.front().offset <= scheduledEnd) {
+        departUs += pauses.front().us;
+        pauses.pop_front();
+      }
+
+      if (replayed != nullptr) {
+        uint64_t arrivalUs = departUs + link.rttUs / 2;
+        if (arrivalUs < replayed->atUs) arrivalUs = replayed->atUs;
+        if (arrivalUs < lastArrivalUs) arrivalUs = lastArrivalUs;
+        senderFreeUs = departUs;
+        lastArrivalUs = arrivalUs;
+        scheduledEnd = end;
+        inFlight.push_back({end, arrivalUs});
+        continue;
+      }
+
+      uint64_t sentUs = departUs + (uint64_t)length * 8 * 1000 / link.bandwidthKbps;
+      uint64_t arrivalUs = sentUs + link.rttUs / 2;
+      if (link.jitterUs > 0) arrivalUs += std::uniform_int_distribution<uint32_t>(0, link.jitterUs)(network.random);
+      if (link.lossRate > 0 && std::uniform_real_distribution<float>(0, 1)(network.random) < link.lossRate) {
+        arrivalUs += link.rttUs * 2 > OTA_SIM_MIN_RTO_US ? link.rttUs * 2 : OTA_SIM_MIN_RTO_US;
+        network.stats.lostSegments++;
+      }
+      if (arrivalUs < lastArrivalUs) arrivalUs = lastArrivalUs; // Delivered in order
+
+      senderFreeUs = sentUs;
+      lastArrivalUs = arrivalUs;
+      scheduledEnd = end;
+      inFlight.push_back({end, arrivalUs});
+    }
+  }
+
+  // End of the contiguous data that has arrived by `nowUs`
+  size_t arrivedEnd(uint64_t nowUs) const {
+    size_t end = readOffset;
+    for (const Segment& segment : inFlight) {
+      if (segment.arrivalUs > nowUs) break;
+      end = segment.end;
+    }
+    return end;
+  }
+
+  OtaSimNetwork& network;
+  const OtaSimLink& link;
+  std::string inbound;
+  std::string outbound; // Every response byte sent on this connection
+  size_t readOffset = 0;
+  size_t scheduledEnd = 0;
+  size_t closeAt = std::string::npos;
+  size_t nextStall;
+  uint64_t readyUs = 0;
+  uint64_t senderFreeUs = 0;
+  uint64_t lastArrivalUs = 0;
+  std::deque<Segment> inFlight;
+  std::deque<Ack> acks;
+  std::deque<Pause> pauses;
+  std::deque<Arrival> arrivals;
+  bool closed = false;
+};
+
+// ====================================================================================
+// NETWORK
+// ====================================================================================
+
+std::unique_ptr<OtaHostSocket> OtaSimNetwork::connect(const char*, uint16_t port, uint32_t timeoutMs) {
+  uint64_t handshakeUs = link.rttUs;
+  if (port == 443) handshakeUs += 2 * (uint64_t)link.rttUs;
+  if (handshakeUs > (uint64_t)timeoutMs * 1000) {
+    otaHostClock().sleepUs((uint64_t)timeoutMs * 1000);
+    return nullptr;
+  }
+  otaHostClock().sleepUs(handshakeUs);
+  stats.connections++;
+  return std::unique_ptr<OtaHostSocket>(new SimSocket(*this));
+}
+
+bool OtaSimNetwork::resolve(const char*, uint32_t& address) {
+  otaHostClock().sleepUs(link.rttUs); // One query to the access point's resolver
+  address = 0x0100007F;                // 127.0.0.1 in network order
+  return true;
+}
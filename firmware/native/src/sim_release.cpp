@@ -0,0 +1,113 @@
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <string.h>
+#include "ota_bundle.h"
+#include "ota_sim.h"
+
+void checkForUpdates();
+
+// ====================================================================================
+// SIGNED RELEASES
+// ====================================================================================
+
+// DER-encoded ECDSA signatures are 70 to 72 bytes depending on the random
+// nonce; always produce the longest, so every run sends the same number of bytes
+#define SIM_SIGNATURE_SIZE 72
+
+static std::string signOnce(EVP_PKEY* key, const std::string& data) {
+  EVP_MD_CTX* signer = EVP_MD_CTX_new();
+  size_t length = 0;
+  std::string signature;
+  if (EVP_DigestSignInit(signer, nullptr, EVP_sha256(), nullptr, key) == 1 &&
+      EVP_DigestSign(signer, nullptr, &length, (const uint8_t*)data.data(), data.size()) == 1) {
+    signature.resize(length);
+    if (EVP_DigestSign(signer, (uint8_t*)&signature[0], &length, (const uint8_t*)data.data(), data.size()) == 1) {
+      signature.resize(length);
+    } else {
+      signature.clear();
+    }
+  }
+  EVP_MD_CTX_free(signer);
+  return signature;
+}
+
+static std::string signSha256(EVP_PKEY* key, const std::string& data) {
+  std::string signature;
+  do {
+    signature = signOnce(key, data);
+  } while (!signature.empty() && signature.size() != SIM_SIGNATURE_SIZE);
+  return signature;
+}
+
+static void putLittleEndian(std::string& out, size_t offset, uint32_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) out[offset + i] = (char)((value >> (8 * i)) & 0xFF);
+}
+
+// Layout as documented in ota_bundle.h
+static std::string makeBundle(EVP_PKEY* key, const std::string& image, const std::string& version) {
+  std::string header(OTA_BUNDLE_HEADER_SIZE, '\0');
+  memcpy(&header[0], OTA_BUNDLE_MAGIC, 4);
+  header[4] = OTA_BUNDLE_FORMAT_V1;
+  header[5] = OTA_BUNDLE_HASH_SHA256;
+  header[6] = OTA_BUNDLE_COMPRESSION_NONE;
+  putLittleEndian(header, 8, (uint32_t)image.size(), 4);
+  memcpy(&header[16], version.data(), version.size() < OTA_BUNDLE_VERSION_LEN ? version.size() : OTA_BUNDLE_VERSION_LEN);
+  EVP_Digest(image.data(), image.size(), (uint8_t*)&header[48], nullptr, EVP_sha256(), nullptr);
+
+  // The length field is part of the signed bytes
+  putLittleEndian(header, 12, SIM_SIGNATURE_SIZE, 2);
+  std::string signature = signSha256(key, header);
+  if (signature.empty()) return std::string();
+  return header + signature + image;
+}
+
+bool otaSimMakeRelease(OtaSimRelease& release, size_t imageSize, const char* version, uint32_t seed) {
+  EVP_PKEY* key = nullptr;
+  EVP_PKEY_CTX* generator = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  bool ok = generator != nullptr && EVP_PKEY_keygen_init(generator) == 1 &&
+            EVP_PKEY_CTX_set_ec_paramgen_curve_nid(generator, NID_X9_62_prime256v1) == 1 &&
+            EVP_PKEY_keygen(generator, &key) == 1;
+  EVP_PKEY_CTX_free(generator);
+  if (!ok) return false;
+
+  BIO* pem = BIO_new(BIO_s_mem());
+  PEM_write_bio_PUBKEY(pem, key);
+  char* pemData = nullptr;
+  long pemLength = BIO_get_mem_data(pem, &pemData);
+  release.publicKeyPem.assign(pemData, pemLength);
+  BIO_free(pem);
+
+  std::mt19937 random(seed);
+  release.version = version;
+  release.image.resize(imageSize);
+  for (char& byte : release.image) byte = (char)(random() & 0xFF);
+  release.signature = signSha256(key, release.image);
+  release.bundle = makeBundle(key, release.image, release.version);
+  EVP_PKEY_free(key);
+  return !release.signature.empty() && !release.bundle.empty();
+}
+
+void otaSimPublish(OtaSimServer& server, const OtaSimRelease& release, bool bundle) {
+  server.put(OTA_SIM_IMAGE_PATH, release.image);
+  server.put(OTA_SIM_SIGNATURE_PATH, release.signature);
+  server.put(OTA_SIM_BUNDLE_PATH, release.bundle);
+  std::string manifest = "{\"version\":\"" + release.version + "\",";
+  if (bundle) {
+    manifest += "\"bundle_url\":\"https://" OTA_SIM_HOST OTA_SIM_BUNDLE_PATH "\"}";
+  } else {
+    manifest += "\"file_url\":\"https://" OTA_SIM_HOST OTA_SIM_IMAGE_PATH "\",\"signature_url\":\"https://" OTA_SIM_HOST
+                OTA_SIM_SIGNATURE_PATH "\"}";
+  }
+  server.put(OTA_SIM_MANIFEST_PATH, manifest);
+}
+
+bool otaSimRunCheck() {
+  try {
+    checkForUpdates();
+  } catch (const OtaHostRestart&) {
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include "ota_nettrace.h"
+#include "ota_sim.h"
+
+// ====================================================================================
+// NETWORK TRACES
+// ====================================================================================
+
+static uint32_t getLittleEndian(const uint8_t* in) {
+  return in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+// Reads one LEB128 value at `offset`, advancing it; false if the data ends first
+static bool getVarint(const std::string& data, size_t& offset, uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 35 && offset < data.size(); shift += 7) {
+    uint8_t byte = (uint8_t)data[offset++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+bool otaSimLoadTrace(const char* path, OtaSimTrace& trace, std::string& error) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    error = std::string("cannot read ") + path;
+    return false;
+  }
+  std::string data;
+  char chunk[4096];
+  size_t count;
+  while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) data.append(chunk, count);
+  fclose(file);
+
+  const uint8_t* header = (const uint8_t*)data.data();
+  if (data.size() < OTA_NET_TRACE_HEADER_SIZE || memcmp(header, OTA_NET_TRACE_MAGIC, 4) != 0) {
+    error = "not a network trace";
+    return false;
+  }
+  if (header[4] != OTA_NET_TRACE_FORMAT_V1) {
+    error = "unsupported trace format " + std::to_string(header[4]);
+    return false;
+  }
+  trace.truncated = (header[5] & OTA_NET_TRACE_TRUNCATED) != 0;
+  trace.imageLength = getLittleEndian(header + 8);
+  trace.bytesRecorded = getLittleEndian(header + 12);
+  trace.rttUs = getLittleEndian(header + 16);
+  uint32_t records = getLittleEndian(header + 20);
+
+  trace.arrivals.clear();
+  size_t offset = OTA_NET_TRACE_HEADER_SIZE;
+  size_t bytes = 0;
+  uint32_t atUs = 0;
+  for (uint32_t i = 0; i < records; i++) {
+    uint32_t gapUs, length;
+    if (!getVarint(data, offset, gapUs) || !getVarint(data, offset, length)) {
+      error = "trace ends after " + std::to_string(i) + " of " + std::to_string(records) + " records";
+      return false;
+    }
+    atUs += gapUs;
+    bytes += length;
+    trace.arrivals.push_back({bytes, atUs});
+  }
+  if (bytes != trace.bytesRecorded || bytes > trace.imageLength) {
+    error = "records cover " + std::to_string(bytes) + " bytes, header says " + std::to_string(trace.bytesRecorded) +
+            " of " + std::to_string(trace.imageLength);
+    return false;
+  }
+  return true;
+}
+
+OtaSimLink otaSimTraceLink(const OtaSimTrace& trace) {
+  OtaSimLink link = *otaSimFindLink("wifi");
+  link.name = "trace";
+  link.jitterUs = 0;
+  link.lossRate = 0;
+  if (trace.rttUs > 0) link.rttUs = trace.rttUs;
+  uint32_t elapsedUs = trace.arrivals.empty() ? 0 : trace.arrivals.back().second;
+  if (elapsedUs > 0) {
+    uint64_t kbps = (uint64_t)trace.bytesRecorded * 8 * 1000 / elapsedUs;
+    link.bandwidthKbps = kbps > 0 ? (uint32_t)kbps : 1;
+  }
+  return link;
+}
@@ -5,16 +5,67 @@
 #include <ArduinoJson.h>
 #include "mbedtls/pk.h"
 #include "mbedtls/sha256.h"
+#ifdef OTA_HOST
+#include "ota_host_config.h"
+#else
 #include "../../secrets/config.h"
+#endif
+#include "ota_arena.h"
+#include "ota_bundle.h"
+#include "ota_error.h"
+#include "ota_log.h"
+#include "ota_http.h"
+#include "ota_metrics.h"
+#include "ota_nettrace.h"
+#include "ota_profile.h"
+#include "ota_replay.h"
+#include "ota_stats.h"
+#include "ota_telemetry.h"
+#include "ota_text.h"
+#include "ota_tls_pool.h"
+#include "ota_trace.h"
+#include "ota_trust.h"
+#include "ota_uplink.h"
+
+// Optional settings; override in secrets/config.h
+#ifndef OTA_SIGNED_MANIFEST
+#define OTA_SIGNED_MANIFEST false // Trust carried by signatures; allows plain HTTP mirrors
+#endif
+// Largest download chunk; smaller chunks are used if the arena is short
+#ifndef OTA_DOWNLOAD_BUFFER_MAX
+#define OTA_DOWNLOAD_BUFFER_MAX 4096
+#endif
+#define OTA_MANIFEST_MAX_SIZE 1024
+#define OTA_MANIFEST_JSON_CAPACITY 512
+#define OTA_DOWNLOAD_BUFFER_MIN 1024
+
+// Manifest documents keep their pool in the per-attempt arena
+typedef BasicJsonDocument<OtaArenaJsonAllocator> OtaJsonDocument;
+
+// Transient state of one image download and verification
+struct UpdateScratch {
+  mbedtls_sha256_context shaCtx;
+  uint8_t shaResult[32];
+  uint8_t signature[OTA_BUNDLE_MAX_SIG_LEN];
+  uint8_t rawHeader[OTA_BUNDLE_HEADER_SIZE];
+};
 
 // Forward declarations for all functions
 void checkForUpdates();
-void performSecureUpdate(WiFiClientSecure& client, const String& firmwareUrl, const String& signatureUrl);
+void runUpdateCheck(OtaSession& session);
+bool fetchSignedManifest(OtaSession& session, JsonDocument& doc);
+void performSecureUpdate(OtaSession& session, const char* firmwareUrl, const char* signatureUrl,
+                         const uint8_t* expectedDigest, size_t expectedSize);
+bool parseImageBinding(JsonDocument& doc, uint8_t* digest, size_t& size);
+void performBundleUpdate(OtaSession& session, const char* bundleUrl, const char* expectedVersion);
+OtaError streamImageToFlash(WiFiClient* stream, size_t length, mbedtls_sha256_context* shaCtx);
 bool verify_signature(uint8_t* sha256_hash, uint8_t* signature, size_t sig_len);
-void handleErrorState(String errorCode);
+void handleErrorState(OtaError error);
 bool connectWiFi();
-int compareVersionStrings(const String& leftVersion, const String& rightVersion);
+int compareVersionStrings(const char* leftVersion, const char* rightVersion);
 bool validateConfiguration();
+void configureTrust();
+void uploadTelemetry(OtaSession& session, bool force);
 
 // Global variables for timers
 unsigned long previousMillisUpdate = 0;
@@ -25,20 +76,43 @@ unsigned long previousMillisPrint = 0;
 // ====================================================================================
 void setup() {
   Serial.begin(SERIAL_BAUD_RATE);
-  Serial.println("\n\nBooting Secure OTA Client (Manifest Method)...");
-  Serial.println("Current Firmware Version: " + String(FIRMWARE_VERSION));
+  if (!otaLogBegin()) {
+    Serial.println("WARNING: Log task could not be started; messages stay buffered.");
+  }
+  if (OTA_LOW_MEMORY_TLS && !otaTlsPoolInstall()) {
+    OTA_LOGW("WARNING: Low-memory TLS pool could not be installed; using the heap.");
+  }
+  OTA_LOGI("Booting Secure OTA Client (Manifest Method)...");
+  OTA_LOGI("Current Firmware Version: %s", FIRMWARE_VERSION);
+  otaStatsBegin();
 
   if (!validateConfiguration()) {
-    Serial.println("FATAL: Configuration validation failed!");
-    handleErrorState("CONFIG_VALIDATION_FAILED");
+    OTA_LOGE("FATAL: Configuration validation failed!");
+    handleErrorState(OTA_ERR_CONFIG_VALIDATION_FAILED);
     while (true) { delay(1000); } // Halt execution on bad config
   }
+  configureTrust();
+  otaHttpAllowPlainHttp(OTA_SIGNED_MANIFEST);
+  if (!otaMetricsBegin(FIRMWARE_VERSION)) {
+    OTA_LOGW("WARNING: Metrics server task could not be started.");
+  }
 
   if (!connectWiFi()) {
-    Serial.println("Initial WiFi connection failed. Will retry in the main loop.");
+    OTA_LOGW("Initial WiFi connection failed. Will retry in the main loop.");
+  }
+  // Manifest expiry needs wall-clock time; only wait for it with a network
+  if (OTA_SIGNED_MANIFEST &&
+      !otaReplayClockBegin(WiFi.status() == WL_CONNECTED ? OTA_CLOCK_SYNC_TIMEOUT_MS : 0)) {
+    OTA_LOGW("WARNING: Clock not set by SNTP yet; manifest age is not checked until it is.");
   }
 
   if (WiFi.status() == WL_CONNECTED) {
+#ifdef OTA_TRUST_BENCHMARK
+    OtaTextView manifestHost = otaUrlHost(MANIFEST_URL);
+    OtaFixedString<OTA_HOST_MAX> host;
+    host.assign(manifestHost.data, manifestHost.length);
+    otaTrustBenchmark(host.c_str(), 443, MANIFEST_ROOT_CA, OTA_TRUST_BENCHMARK);
+#endif
     checkForUpdates();
   }
 }
@@ -52,21 +126,24 @@ void loop() {
   // Timer 1: Check for updates periodically
   if (currentMillis - previousMillisUpdate >= UPDATE_CHECK_INTERVAL) {
     previousMillisUpdate = currentMillis;
-    Serial.println("--------------------");
-    Serial.println("Checking for a new firmware version...");
+    OTA_LOGI("--------------------");
+    OTA_LOGI("Checking for a new firmware version...");
     if (WiFi.status() != WL_CONNECTED) connectWiFi();
     if (WiFi.status() == WL_CONNECTED) {
       checkForUpdates();
     } else {
-      Serial.println("Skipped update check: WiFi is not connected.");
+      OTA_LOGI("Skipped update check: WiFi is not connected.");
     }
   }
 
   // Timer 2: Print a heartbeat message
   if (currentMillis - previousMillisPrint >= VERSION_PRINT_INTERVAL) {
     previousMillisPrint = currentMillis;
-    Serial.println("Status: Alive. Running firmware version: " + String(FIRMWARE_VERSION));
+    OTA_LOGI("Status: Alive. Running firmware version: %s", FIRMWARE_VERSION);
   }
+
+  // Batched NVS write of the OTA history, kept off the update path
+  otaStatsPoll();
 }
 
 // ====================================================================================
@@ -74,232 +151,614 @@ void loop() {
 // ====================================================================================
 
 void checkForUpdates() {
-  WiFiClientSecure client;
-  // Configure TLS: if insecure mode is enabled, force it; otherwise use provided Root CA
-  if (ALLOW_INSECURE_OTA) {
-    client.setInsecure();
-  } else if (strlen(MANIFEST_ROOT_CA) > 0) {
-    client.setCACert(MANIFEST_ROOT_CA);
+  // TLS trust is applied per host by the transport (see configureTrust())
+#if OTA_LOW_MEMORY_TLS
+  // Only the client objects are reused; the connections and their TLS state
+  // are closed below after every check
+  static OtaSession session;
+#else
+  OtaSession session;
+#endif
+  otaTelemetryBeginAttempt();
+  {
+    // Everything the check takes from the arena is released here, even on failure
+    OtaArenaScope arenaScope;
+    runUpdateCheck(session);
   }
+  uploadTelemetry(session, false); // rides on the connections the check opened
+  otaSessionClose(session);
+  otaTelemetryEndAttempt();
+}
 
-  HTTPClient http;
-  Serial.println("Fetching manifest from: " + String(MANIFEST_URL));
-  http.begin(client, MANIFEST_URL);
-  http.addHeader("User-Agent", "ESP32-OTA-Client/1.0");
+void runUpdateCheck(OtaSession& session) {
+  OTA_LOGI("Fetching manifest from: %s", MANIFEST_URL);
+  // The manifest is small; its document lives until the check ends
+  OtaJsonDocument doc(OTA_MANIFEST_JSON_CAPACITY);
+  if (OTA_SIGNED_MANIFEST) {
+    if (!fetchSignedManifest(session, doc)) return;
+  } else {
+    HTTPClient http;
+    int httpCode = otaHttpGet(http, session, MANIFEST_URL);
+    if (httpCode != HTTP_CODE_OK) {
+      OTA_LOGE("PROBLEM: Failed to fetch manifest. HTTP Code: %d", httpCode);
+      otaHttpAbort(http);
+      handleErrorState(OTA_ERR_MANIFEST_FETCH_FAILED);
+      return;
+    }
 
-  int httpCode = http.GET();
-  if (httpCode != HTTP_CODE_OK) {
-    Serial.println("PROBLEM: Failed to fetch manifest. HTTP Code: " + String(httpCode));
-    http.end();
-    handleErrorState("MANIFEST_FETCH_FAILED");
+    uint32_t parseStart = micros();
+    DeserializationError error = deserializeJson(doc, http.getStream());
+    otaTelemetryAddTime(otaAttempt.timing.parseUs, parseStart);
+    // End connection as soon as parsing is done; keep it only if nothing of
+    // the body is left behind for the next request to read
+    if (error || http.getStream().available() > 0) {
+      otaHttpAbort(http);
+    } else {
+      http.end();
+    }
+
+    if (error) {
+      OTA_LOGE("PROBLEM: Failed to parse manifest JSON. Error: %s", error.c_str());
+      handleErrorState(OTA_ERR_MANIFEST_PARSE_FAILED);
+      return;
+    }
+  }
+
+  // The strings stay inside `doc`; nothing is copied to the heap
+  const char* newVersion = doc["version"] | "";
+  const char* firmwareUrl = doc["file_url"] | "";
+  const char* signatureUrl = doc["signature_url"] | "";
+  // Optional: a single signed bundle replaces the separate firmware/signature downloads
+  const char* bundleUrl = doc["bundle_url"] | "";
+  bool hasSplitArtifacts = *firmwareUrl && *signatureUrl;
+
+  if (!*newVersion || (!*bundleUrl && !hasSplitArtifacts)) {
+    OTA_LOGE("PROBLEM: Manifest is missing required fields (version, and bundle_url or file_url + signature_url).");
+    handleErrorState(OTA_ERR_MANIFEST_INVALID);
     return;
   }
+  if (strlen(newVersion) >= OTA_VERSION_MAX || strlen(firmwareUrl) >= OTA_URL_MAX ||
+      strlen(signatureUrl) >= OTA_URL_MAX || strlen(bundleUrl) >= OTA_URL_MAX) {
+    OTA_LOGE("PROBLEM: Manifest version or URL is too long.");
+    handleErrorState(OTA_ERR_MANIFEST_INVALID);
+    return;
+  }
+
+  // A signed manifest over plain HTTP must pin the split image itself: the
+  // detached image signature says nothing about which version it is, so an
+  // older signed firmware.bin could otherwise be served in its place. A bundle
+  // is pinned by its own signed header instead.
+  uint8_t imageDigest[32];
+  size_t imageSize = 0;
+  if (OTA_SIGNED_MANIFEST && !*bundleUrl && !parseImageBinding(doc, imageDigest, imageSize)) {
+    OTA_LOGE("PROBLEM: Signed manifest names file_url without a valid sha256 and size.");
+    handleErrorState(OTA_ERR_MANIFEST_INVALID);
+    return;
+  }
+
+  if (newVersion[0] == 'v') newVersion++;
+
+  OTA_LOGI("Update Check: Current version is %s, manifest version is %s", FIRMWARE_VERSION, newVersion);
+
+  if (compareVersionStrings(newVersion, FIRMWARE_VERSION) > 0) {
+    OTA_LOGI("Action: New version found. Starting secure update process.");
+    // Pass the same session to reuse its clients and open connections
+    if (*bundleUrl) {
+      performBundleUpdate(session, bundleUrl, newVersion);
+    } else {
+      performSecureUpdate(session, firmwareUrl, signatureUrl, imageSize ? imageDigest : nullptr, imageSize);
+    }
+  } else {
+    OTA_LOGI("Action: No new version available.");
+  }
+}
+
+// Signed-manifest mode: the manifest and its detached signature may come over
+// plain HTTP, so nothing in it is used before the signature and the anti-replay
+// fields have been checked.
+bool fetchSignedManifest(OtaSession& session, JsonDocument& doc) {
+  // Parsed in place, so `doc` points into this buffer; both stay in the
+  // caller's arena scope
+  char* manifest = (char*)otaArenaAlloc(OTA_MANIFEST_MAX_SIZE + 1);
+  uint8_t* signature = (uint8_t*)otaArenaAlloc(OTA_BUNDLE_MAX_SIG_LEN);
+  if (manifest == nullptr || signature == nullptr) {
+    handleErrorState(OTA_ERR_ARENA_EXHAUSTED);
+    return false;
+  }
+
+  HTTPClient http;
+  http.setTimeout(15000);
+  int httpCode = otaHttpGet(http, session, MANIFEST_URL);
+  int manifestSize = http.getSize();
+  if (httpCode != HTTP_CODE_OK || manifestSize <= 0 || manifestSize > OTA_MANIFEST_MAX_SIZE ||
+      http.getStream().readBytes(manifest, manifestSize) != (size_t)manifestSize) {
+    OTA_LOGE("PROBLEM: Failed to fetch manifest. HTTP Code: %d, size: %d", httpCode, manifestSize);
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_MANIFEST_FETCH_FAILED);
+    return false;
+  }
+  http.end();
+  manifest[manifestSize] = '\0';
+
+#ifdef OTA_MANIFEST_SIGNATURE_URL
+  const char* manifestSignatureUrl = OTA_MANIFEST_SIGNATURE_URL;
+#else
+  const char* manifestSignatureUrl = MANIFEST_URL ".sig";
+#endif
+  httpCode = otaHttpGet(http, session, manifestSignatureUrl);
+  int sigLen = http.getSize();
+  if (httpCode != HTTP_CODE_OK || sigLen <= 0 || sigLen > OTA_BUNDLE_MAX_SIG_LEN ||
+      http.getStream().readBytes(signature, sigLen) != (size_t)sigLen) {
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_MANIFEST_SIGNATURE_INVALID);
+    return false;
+  }
+  http.end();
 
-  // Use a reasonably sized static document for the simple manifest
-  StaticJsonDocument<512> doc;
-  DeserializationError error = deserializeJson(doc, http.getStream());
-  http.end(); // End connection as soon as parsing is done
+  uint8_t manifestHash[32];
+  mbedtls_sha256_ret((const uint8_t*)manifest, manifestSize, manifestHash, 0);
+  if (!verify_signature(manifestHash, signature, sigLen)) {
+    OTA_LOGE("PROBLEM: MANIFEST SIGNATURE VERIFICATION FAILED! Major security alert.");
+    handleErrorState(OTA_ERR_MANIFEST_SIGNATURE_INVALID);
+    return false;
+  }
 
+  uint32_t parseStart = micros();
+  DeserializationError error = deserializeJson(doc, manifest, manifestSize);
+  otaTelemetryAddTime(otaAttempt.timing.parseUs, parseStart);
   if (error) {
-    Serial.println("PROBLEM: Failed to parse manifest JSON. Error: " + String(error.c_str()));
-    handleErrorState("MANIFEST_PARSE_FAILED");
+    OTA_LOGE("PROBLEM: Failed to parse manifest JSON. Error: %s", error.c_str());
+    handleErrorState(OTA_ERR_MANIFEST_PARSE_FAILED);
+    return false;
+  }
+
+  uint32_t sequence = doc["sequence"].as<uint32_t>();
+  uint32_t timestamp = doc["timestamp"].as<uint32_t>();
+  if (sequence == 0 || timestamp == 0) {
+    OTA_LOGE("PROBLEM: Signed manifest is missing sequence or timestamp.");
+    handleErrorState(OTA_ERR_MANIFEST_INVALID);
+    return false;
+  }
+  OtaReplayResult replay = otaReplayCheck(sequence, timestamp);
+  if (replay != OTA_REPLAY_OK) {
+    OTA_LOGE("PROBLEM: Signed manifest rejected as stale or replayed. Reason: %d", (int)replay);
+    handleErrorState(OTA_ERR_MANIFEST_REPLAYED);
+    return false;
+  }
+  otaReplayAccept(sequence, timestamp);
+  return true;
+}
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Reads the manifest's "sha256" (64 hex characters) and "size" of the split
+// firmware image. False if either is missing or malformed.
+bool parseImageBinding(JsonDocument& doc, uint8_t* digest, size_t& size) {
+  const char* digestHex = doc["sha256"] | "";
+  size = doc["size"].as<uint32_t>();
+  if (strlen(digestHex) != 64 || size == 0) return false;
+  for (int i = 0; i < 32; i++) {
+    int high = hexNibble(digestHex[2 * i]);
+    int low = hexNibble(digestHex[2 * i + 1]);
+    if (high < 0 || low < 0) return false;
+    digest[i] = (uint8_t)(high << 4 | low);
+  }
+  return true;
+}
+
+// `expectedDigest` and `expectedSize` come from a signed manifest and pin the
+// image; without one (nullptr) the detached signature alone is trusted.
+void performSecureUpdate(OtaSession& session, const char* firmwareUrl, const char* signatureUrl,
+                         const uint8_t* expectedDigest, size_t expectedSize) {
+  otaTelemetryEnterPhase(OTA_PHASE_DOWNLOAD);
+  OtaArenaScope arenaScope;
+  UpdateScratch* scratch = otaArenaNew<UpdateScratch>();
+  if (scratch == nullptr) { handleErrorState(OTA_ERR_ARENA_EXHAUSTED); return; }
+
+  HTTPClient http;
+  http.setTimeout(30000); // 30s overall HTTP timeout
+
+  OTA_LOGI("Downloading firmware from: %s", firmwareUrl);
+  otaSessionSetTimeout(session, 15000); // 15s socket timeout
+
+  // Resolve the signature's redirect while still connected to the release host, so
+  // both downloads below go straight to the CDN over one connection.
+  otaHttpResolve(session, signatureUrl);
+
+  int httpCode = otaHttpGet(http, session, firmwareUrl);
+  if (httpCode != HTTP_CODE_OK) {
+    OTA_LOGE("PROBLEM: Failed to download firmware file. HTTP Code: %d", httpCode);
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_FIRMWARE_DOWNLOAD_FAILED);
     return;
   }
 
-  String newVersion = doc["version"].as<String>();
-  String firmwareUrl = doc["file_url"].as<String>();
-  String signatureUrl = doc["signature_url"].as<String>();
+  int contentLength = http.getSize();
+  if (contentLength <= 0 || (expectedDigest != nullptr && (size_t)contentLength != expectedSize)) {
+    OTA_LOGE("PROBLEM: Invalid firmware size from server: %d bytes.", contentLength);
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_INVALID_FIRMWARE_SIZE);
+    return;
+  }
 
-  if (newVersion.isEmpty() || firmwareUrl.isEmpty() || signatureUrl.isEmpty()) {
-    Serial.println("PROBLEM: Manifest is missing required fields (version, file_url, or signature_url).");
-    handleErrorState("MANIFEST_INVALID");
+  if (!Update.begin(contentLength)) {
+    OTA_LOGE("Update error: %s", Update.errorString());
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_INSUFFICIENT_SPACE);
     return;
   }
 
-  if (newVersion.startsWith("v")) {
-    newVersion.remove(0, 1);
+  OTA_LOGI("Downloading new firmware... (this may take a moment)");
+  WiFiClient* stream = http.getStreamPtr();
+
+  // Initialize the SHA-256 context for hashing
+  mbedtls_sha256_init(&scratch->shaCtx);
+  mbedtls_sha256_starts_ret(&scratch->shaCtx, 0); // 0 for SHA-256
+
+  OtaError streamError = streamImageToFlash(stream, (size_t)contentLength, &scratch->shaCtx);
+  if (streamError != OTA_OK) {
+    mbedtls_sha256_free(&scratch->shaCtx);
+    otaHttpAbort(http); Update.abort(); handleErrorState(streamError); return;
   }
+  
+  http.end();
 
-  Serial.println("Update Check: Current version is " + String(FIRMWARE_VERSION) + ", manifest version is " + newVersion);
+  // Finalize the hash calculation
+  mbedtls_sha256_finish_ret(&scratch->shaCtx, scratch->shaResult);
+  mbedtls_sha256_free(&scratch->shaCtx);
 
-  if (compareVersionStrings(newVersion, String(FIRMWARE_VERSION)) > 0) {
-    Serial.println("Action: New version found. Starting secure update process.");
-    // Pass the same client object to save memory from re-creating it
-    performSecureUpdate(client, firmwareUrl, signatureUrl);
+  if (expectedDigest != nullptr && memcmp(scratch->shaResult, expectedDigest, sizeof(scratch->shaResult)) != 0) {
+    OTA_LOGE("PROBLEM: Image digest does not match the signed manifest.");
+    Update.abort(); handleErrorState(OTA_ERR_SIGNATURE_VERIFICATION_FAILED); return;
+  }
+
+  // Download the signature file
+  otaTelemetryEnterPhase(OTA_PHASE_SIGNATURE);
+  OTA_LOGI("Downloading signature from: %s", signatureUrl);
+  http.setTimeout(15000);
+  httpCode = otaHttpGet(http, session, signatureUrl);
+  if (httpCode != HTTP_CODE_OK) {
+    Update.abort(); otaHttpAbort(http); handleErrorState(OTA_ERR_SIGNATURE_DOWNLOAD_FAILED); return;
+  }
+  
+  // Read no more than the server sent: on a kept-alive connection a short read
+  // would otherwise wait out the whole stream timeout
+  int sigSize = http.getSize();
+  size_t sigWanted = sigSize > 0 && sigSize < (int)sizeof(scratch->signature) ? (size_t)sigSize : sizeof(scratch->signature);
+  int sigLen = http.getStream().readBytes(scratch->signature, sigWanted);
+  if (sigSize <= 0 || sigLen != sigSize) {
+    otaHttpAbort(http);
   } else {
-    Serial.println("Action: No new version available.");
+    http.end();
+  }
+  otaAttempt.timing.bytesReceived += sigLen;
+
+  // Verify the signature against the hash we just calculated
+  otaTelemetryEnterPhase(OTA_PHASE_VERIFY);
+  if (!verify_signature(scratch->shaResult, scratch->signature, sigLen)) {
+    OTA_LOGE("PROBLEM: SIGNATURE VERIFICATION FAILED! Major security alert.");
+    Update.abort(); handleErrorState(OTA_ERR_SIGNATURE_VERIFICATION_FAILED); return;
+  }
+  OTA_LOGI("SIGNATURE VERIFIED SUCCESSFULLY!");
+
+  // If everything is okay, finalize the update
+  otaTelemetryEnterPhase(OTA_PHASE_FINALIZE);
+  uint32_t finalizeStart = micros();
+  bool finalized = Update.end();
+  otaTelemetryAddTime(otaAttempt.timing.finalizeUs, finalizeStart);
+  if (!finalized) {
+    OTA_LOGE("Update error: %s", Update.errorString()); handleErrorState(OTA_ERR_UPDATE_FINALIZE_FAILED); return;
   }
+
+  OTA_LOGI("UPDATE SUCCESSFUL! Rebooting into new firmware...");
+  otaTelemetryEndAttempt();
+  otaStatsFlush();
+  uploadTelemetry(session, true); // the queue does not survive the restart
+  otaLogFlush(); // the drain task would not get to run before the reset
+  ESP.restart();
 }
 
-void performSecureUpdate(WiFiClientSecure& client, const String& firmwareUrl, const String& signatureUrl) {
+void performBundleUpdate(OtaSession& session, const char* bundleUrl, const char* expectedVersion) {
+  otaTelemetryEnterPhase(OTA_PHASE_DOWNLOAD);
+  OtaArenaScope arenaScope;
+  UpdateScratch* scratch = otaArenaNew<UpdateScratch>();
+  if (scratch == nullptr) { handleErrorState(OTA_ERR_ARENA_EXHAUSTED); return; }
+
   HTTPClient http;
-  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS); // Crucial for GitHub release files
   http.setTimeout(30000); // 30s overall HTTP timeout
 
-  Serial.println("Downloading firmware from: " + firmwareUrl);
-  // Ensure insecure mode also applies to subsequent hosts if enabled
-  if (ALLOW_INSECURE_OTA) {
-    client.setInsecure();
-  }
-  client.setTimeout(15000); // 15s socket timeout
-  http.begin(client, firmwareUrl);
-  int httpCode = http.GET();
+  OTA_LOGI("Downloading update bundle from: %s", bundleUrl);
+  otaSessionSetTimeout(session, 15000); // 15s socket timeout
+  int httpCode = otaHttpGet(http, session, bundleUrl);
   if (httpCode != HTTP_CODE_OK) {
-    Serial.println("PROBLEM: Failed to download firmware file. HTTP Code: " + String(httpCode));
-    http.end();
-    handleErrorState("FIRMWARE_DOWNLOAD_FAILED");
+    OTA_LOGE("PROBLEM: Failed to download update bundle. HTTP Code: %d", httpCode);
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_BUNDLE_DOWNLOAD_FAILED);
+    return;
+  }
+
+  WiFiClient* stream = http.getStreamPtr();
+
+  // Header and signature are small; read them fully before touching flash
+  if (stream->readBytes(scratch->rawHeader, sizeof(scratch->rawHeader)) != sizeof(scratch->rawHeader)) {
+    otaHttpAbort(http); handleErrorState(OTA_ERR_BUNDLE_HEADER_INVALID); return;
+  }
+
+  OtaBundleHeader header;
+  OtaBundleParseResult parseResult = otaBundleParseHeader(scratch->rawHeader, header);
+  if (parseResult != OTA_BUNDLE_OK) {
+    OTA_LOGE("PROBLEM: Bundle header rejected. Reason: %d", (int)parseResult);
+    otaHttpAbort(http);
+    handleErrorState(parseResult == OTA_BUNDLE_UNSUPPORTED ? OTA_ERR_BUNDLE_UNSUPPORTED : OTA_ERR_BUNDLE_HEADER_INVALID);
     return;
   }
 
   int contentLength = http.getSize();
-  if (contentLength <= 0) {
-    Serial.println("PROBLEM: Invalid firmware size from server.");
-    http.end();
-    handleErrorState("INVALID_FIRMWARE_SIZE");
+  if (contentLength > 0 && (size_t)contentLength != otaBundleTotalSize(header)) {
+    OTA_LOGE("PROBLEM: Bundle size mismatch. Server reports %d bytes.", contentLength);
+    otaHttpAbort(http); handleErrorState(OTA_ERR_INVALID_FIRMWARE_SIZE); return;
+  }
+
+  if (strcmp(header.version, expectedVersion) != 0) {
+    OTA_LOGE("PROBLEM: Bundle version %s does not match manifest version %s", header.version, expectedVersion);
+    otaHttpAbort(http); handleErrorState(OTA_ERR_BUNDLE_VERSION_MISMATCH); return;
+  }
+
+  if (stream->readBytes(scratch->signature, header.signatureLength) != header.signatureLength) {
+    otaHttpAbort(http); handleErrorState(OTA_ERR_SIGNATURE_DOWNLOAD_FAILED); return;
+  }
+  otaAttempt.timing.bytesReceived += OTA_BUNDLE_HEADER_SIZE + header.signatureLength;
+
+  // The signature covers the header, which in turn pins the image digest
+  otaTelemetryEnterPhase(OTA_PHASE_VERIFY);
+  mbedtls_sha256_ret(scratch->rawHeader, sizeof(scratch->rawHeader), scratch->shaResult, 0);
+  if (!verify_signature(scratch->shaResult, scratch->signature, header.signatureLength)) {
+    OTA_LOGE("PROBLEM: BUNDLE SIGNATURE VERIFICATION FAILED! Major security alert.");
+    otaHttpAbort(http); handleErrorState(OTA_ERR_SIGNATURE_VERIFICATION_FAILED); return;
+  }
+  OTA_LOGI("Bundle header signature verified.");
+
+  if (!Update.begin(header.imageSize)) {
+    OTA_LOGE("Update error: %s", Update.errorString());
+    otaHttpAbort(http);
+    handleErrorState(OTA_ERR_INSUFFICIENT_SPACE);
     return;
   }
 
-  if (!Update.begin(contentLength)) {
-    Update.printError(Serial);
+  OTA_LOGI("Downloading new firmware... (this may take a moment)");
+  otaTelemetryEnterPhase(OTA_PHASE_DOWNLOAD);
+  mbedtls_sha256_init(&scratch->shaCtx);
+  mbedtls_sha256_starts_ret(&scratch->shaCtx, 0); // 0 for SHA-256
+
+  OtaError streamError = streamImageToFlash(stream, header.imageSize, &scratch->shaCtx);
+  // Without a Content-Length the end of the body is not known either
+  if (streamError != OTA_OK || contentLength <= 0) {
+    otaHttpAbort(http);
+  } else {
     http.end();
-    handleErrorState("INSUFFICIENT_SPACE");
-    return;
+  }
+  if (streamError != OTA_OK) {
+    mbedtls_sha256_free(&scratch->shaCtx);
+    Update.abort(); handleErrorState(streamError); return;
   }
 
-  Serial.println("Downloading new firmware... (this may take a moment)");
-  WiFiClient* stream = http.getStreamPtr();
+  mbedtls_sha256_finish_ret(&scratch->shaCtx, scratch->shaResult);
+  mbedtls_sha256_free(&scratch->shaCtx);
 
-  // Initialize the SHA-256 context for hashing
-  mbedtls_sha256_context shaCtx;
-  mbedtls_sha256_init(&shaCtx);
-  mbedtls_sha256_starts_ret(&shaCtx, 0); // 0 for SHA-256
+  otaTelemetryEnterPhase(OTA_PHASE_VERIFY);
+  if (memcmp(scratch->shaResult, header.imageDigest, sizeof(scratch->shaResult)) != 0) {
+    OTA_LOGE("PROBLEM: Image digest does not match the signed bundle header.");
+    Update.abort(); handleErrorState(OTA_ERR_SIGNATURE_VERIFICATION_FAILED); return;
+  }
+  OTA_LOGI("SIGNATURE VERIFIED SUCCESSFULLY!");
+
+  otaTelemetryEnterPhase(OTA_PHASE_FINALIZE);
+  uint32_t finalizeStart = micros();
+  bool finalized = Update.end();
+  otaTelemetryAddTime(otaAttempt.timing.finalizeUs, finalizeStart);
+  if (!finalized) {
+    OTA_LOGE("Update error: %s", Update.errorString()); handleErrorState(OTA_ERR_UPDATE_FINALIZE_FAILED); return;
+  }
+
+  OTA_LOGI("UPDATE SUCCESSFUL! Rebooting into new firmware...");
+  otaTelemetryEndAttempt();
+  otaStatsFlush();
+  uploadTelemetry(session, true); // the queue does not survive the restart
+  otaLogFlush(); // the drain task would not get to run before the reset
+  ESP.restart();
+}
 
-  // Use a static buffer to avoid stack overflow crashes. This is critical.
-  static uint8_t buffer[1024];
+// Streams exactly `length` image bytes into the OTA partition while hashing them.
+// Returns OTA_OK or the error code to report.
+OtaError streamImageToFlash(WiFiClient* stream, size_t length, mbedtls_sha256_context* shaCtx) {
+  // Never on the stack: that overflows the loop task. Larger chunks mean fewer
+  // reads and flash writes, so take the largest one the arena has room for.
+  OtaArenaScope arenaScope;
+  size_t bufferSize = OTA_DOWNLOAD_BUFFER_MAX;
+  while (bufferSize > OTA_DOWNLOAD_BUFFER_MIN && bufferSize > otaArenaAvailable()) bufferSize /= 2;
+  uint8_t* buffer = (uint8_t*)otaArenaAlloc(bufferSize);
+  if (buffer == nullptr) return OTA_ERR_ARENA_EXHAUSTED;
+  otaAttempt.downloadBufferSize = bufferSize;
+
+  OtaAttemptTiming& timing = otaAttempt.timing;
+  uint32_t downloadStart = micros();
+  OTA_NET_TRACE_BEGIN(length);
   size_t totalWritten = 0;
+  OtaError result = OTA_OK;
 
   // Read the stream chunk by chunk, write to flash, and update the hash
   unsigned long lastProgress = millis();
-  while (totalWritten < (size_t)contentLength) {
+  bool stalled = false;
+  while (totalWritten < length) {
     int availableBytes = stream->available();
     if (availableBytes <= 0) {
+      // A closed connection will not deliver the rest; fail now, not at the stall timeout
+      if (!stream->connected()) {
+        result = OTA_ERR_FIRMWARE_WRITE_INCOMPLETE;
+        break;
+      }
       // Allow some time for more data to arrive
       delay(10);
+      if (!stalled && millis() - lastProgress > OTA_STALL_THRESHOLD_MS) {
+        stalled = true;
+        timing.stalls++;
+      }
       // Bail out if we have been stalled too long
       if (millis() - lastProgress > 30000) { // 30s stall timeout
-        http.end(); Update.abort(); handleErrorState("FIRMWARE_WRITE_INCOMPLETE"); return;
+        result = OTA_ERR_FIRMWARE_WRITE_INCOMPLETE;
+        break;
       }
       continue;
     }
 
-    size_t chunkSize = availableBytes > (int)sizeof(buffer) ? sizeof(buffer) : (size_t)availableBytes;
-    size_t bytesRead = stream->readBytes(buffer, chunkSize);
+    // Never read past the image: a bundle stream may carry trailing data
+    size_t remaining = length - totalWritten;
+    size_t chunkSize = availableBytes > (int)bufferSize ? bufferSize : (size_t)availableBytes;
+    if (chunkSize > remaining) chunkSize = remaining;
+    OTA_TRACE_SCOPE("chunk");
+    size_t bytesRead;
+    {
+      OTA_TRACE_SCOPE("read");
+      OTA_PROBE_SCOPE(OTA_PROBE_NET_READ);
+      bytesRead = stream->readBytes(buffer, chunkSize);
+    }
     if (bytesRead == 0) {
       // No bytes read despite availability; small backoff
       delay(5);
       continue;
     }
-
-    size_t bytesWritten = Update.write(buffer, bytesRead);
+    OTA_NET_TRACE_ARRIVAL(bytesRead);
+
+    uint32_t stepStart = micros();
+    size_t bytesWritten;
+    {
+      OTA_TRACE_SCOPE("flash");
+      OTA_PROBE_SCOPE(OTA_PROBE_FLASH_WRITE);
+      bytesWritten = Update.write(buffer, bytesRead);
+    }
+    otaTelemetryAddTime(timing.flashWriteUs, stepStart);
     if (bytesWritten != bytesRead) {
-      Update.printError(Serial);
-      Update.abort(); http.end(); handleErrorState("FIRMWARE_WRITE_ERROR"); return;
+      OTA_LOGE("Update error: %s", Update.errorString());
+      result = OTA_ERR_FIRMWARE_WRITE_ERROR;
+      break;
     }
 
-    mbedtls_sha256_update_ret(&shaCtx, buffer, bytesRead);
+    stepStart = micros();
+    {
+      OTA_TRACE_SCOPE("sha256");
+      OTA_PROBE_SCOPE(OTA_PROBE_SHA256);
+      mbedtls_sha256_update_ret(shaCtx, buffer, bytesRead);
+    }
+    otaTelemetryAddTime(timing.sha256Us, stepStart);
     totalWritten += bytesRead;
+    timing.bytesReceived += bytesRead;
     lastProgress = millis();
+    stalled = false;
+    otaTelemetrySampleHeap();
   }
-  
-  http.end();
-
-  if (totalWritten != (size_t)contentLength) {
-    Serial.println("PROBLEM: Firmware download incomplete. Wrote " + String(totalWritten) + " of " + String(contentLength) + " bytes.");
-    Update.abort(); handleErrorState("FIRMWARE_WRITE_INCOMPLETE"); return;
-  }
-
-  // Finalize the hash calculation
-  uint8_t shaResult[32];
-  mbedtls_sha256_finish_ret(&shaCtx, shaResult);
-  mbedtls_sha256_free(&shaCtx);
+  otaTelemetryAddTime(timing.downloadUs, downloadStart);
 
-  // Download the signature file
-  Serial.println("Downloading signature from: " + signatureUrl);
-  http.begin(client, signatureUrl);
-  http.setTimeout(15000);
-  httpCode = http.GET();
-  if (httpCode != HTTP_CODE_OK) {
-    Update.abort(); http.end(); handleErrorState("SIGNATURE_DOWNLOAD_FAILED"); return;
+  if (result == OTA_OK && totalWritten != length) result = OTA_ERR_FIRMWARE_WRITE_INCOMPLETE;
+  if (result == OTA_ERR_FIRMWARE_WRITE_INCOMPLETE) {
+    OTA_LOGE("PROBLEM: Firmware download incomplete. Wrote %u of %u bytes.", (unsigned)totalWritten, (unsigned)length);
   }
-  
-  uint8_t signature[256];
-  int sigLen = http.getStream().readBytes(signature, 256);
-  http.end();
-
-  // Verify the signature against the hash we just calculated
-  if (!verify_signature(shaResult, signature, sigLen)) {
-    Serial.println("PROBLEM: SIGNATURE VERIFICATION FAILED! Major security alert.");
-    Update.abort(); handleErrorState("SIGNATURE_VERIFICATION_FAILED"); return;
-  }
-  Serial.println("SIGNATURE VERIFIED SUCCESSFULLY!");
-
-  // If everything is okay, finalize the update
-  if (!Update.end()) {
-    Update.printError(Serial); handleErrorState("UPDATE_FINALIZE_FAILED"); return;
-  }
-
-  Serial.println("UPDATE SUCCESSFUL! Rebooting into new firmware...");
-  ESP.restart();
+  return result;
 }
 
 // ====================================================================================
 // HELPER FUNCTIONS
 // ====================================================================================
 
-int compareVersionStrings(const String& leftVersion, const String& rightVersion) {
-  int leftIdx = 0;
-  int rightIdx = 0;
+int compareVersionStrings(const char* leftVersion, const char* rightVersion) {
+  const char* left = leftVersion;
+  const char* right = rightVersion;
   while (true) {
     long leftPart = 0;
     long rightPart = 0;
-    while (leftIdx < (int)leftVersion.length() && isDigit(leftVersion[leftIdx])) {
-      leftPart = leftPart * 10 + (leftVersion[leftIdx] - '0');
-      leftIdx++;
+    while (isDigit(*left)) {
+      leftPart = leftPart * 10 + (*left - '0');
+      left++;
     }
-    if (leftIdx < (int)leftVersion.length() && leftVersion[leftIdx] == '.') leftIdx++;
+    if (*left == '.') left++;
 
-    while (rightIdx < (int)rightVersion.length() && isDigit(rightVersion[rightIdx])) {
-      rightPart = rightPart * 10 + (rightVersion[rightIdx] - '0');
-      rightIdx++;
+    while (isDigit(*right)) {
+      rightPart = rightPart * 10 + (*right - '0');
+      right++;
     }
-    if (rightIdx < (int)rightVersion.length() && rightVersion[rightIdx] == '.') rightIdx++;
+    if (*right == '.') right++;
 
     if (leftPart > rightPart) return 1;
     if (leftPart < rightPart) return -1;
 
-    bool leftDone = leftIdx >= (int)leftVersion.length();
-    bool rightDone = rightIdx >= (int)rightVersion.length();
+    bool leftDone = *left == '\0';
+    bool rightDone = *right == '\0';
     if (leftDone && rightDone) return 0;
   }
 }
 
 bool verify_signature(uint8_t* sha256_hash, uint8_t* signature, size_t sig_len) {
+  uint32_t verifyStart = micros(); // includes parsing the public key
   mbedtls_pk_context pk;
   mbedtls_pk_init(&pk);
   int ret = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)PUBLIC_KEY, strlen(PUBLIC_KEY) + 1);
   if (ret != 0) {
-    Serial.println("Internal Error: Failed to parse public key.");
+    OTA_LOGE("Internal Error: Failed to parse public key.");
     mbedtls_pk_free(&pk);
     return false;
   }
   ret = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, sha256_hash, 32, signature, sig_len);
   mbedtls_pk_free(&pk);
+  otaTelemetryAddTime(otaAttempt.timing.verifyUs, verifyStart);
   return ret == 0;
 }
 
-void handleErrorState(String errorCode) {
-  Serial.println("An error occurred. Error Code: " + errorCode);
-  Serial.println("Device will not attempt another update until rebooted.");
+// Builds the per-host TLS trust table. Redirect targets (release CDNs) are not
+// listed and fall back to the compiled-in root bundle.
+void configureTrust() {
+  if (ALLOW_INSECURE_OTA) {
+    otaTrustSetDefault(OTA_TRUST_INSECURE);
+    return;
+  }
+  otaTrustSetDefault(OTA_TRUST_BUNDLE);
+  // A Root CA configured for the manifest keeps applying to the manifest host only
+  if (strlen(MANIFEST_ROOT_CA) > 0) {
+    OtaTextView manifestHost = otaUrlHost(MANIFEST_URL);
+    OtaFixedString<OTA_HOST_MAX> host;
+    host.assign(manifestHost.data, manifestHost.length);
+    otaTrustAddHost(host.c_str(), OTA_TRUST_PEM, MANIFEST_ROOT_CA);
+  }
+  // Optional on-premises mirror: skip chain validation with a pinned key or TLS-PSK
+#if defined(OTA_MIRROR_HOST) && defined(OTA_MIRROR_PSK_IDENTITY) && defined(OTA_MIRROR_PSK_KEY)
+  if (!otaTrustAddPskHost(OTA_MIRROR_HOST, OTA_MIRROR_PSK_IDENTITY, OTA_MIRROR_PSK_KEY)) {
+    OTA_LOGE("ERROR: Could not register TLS-PSK for OTA_MIRROR_HOST");
+  }
+#elif defined(OTA_MIRROR_HOST) && defined(OTA_MIRROR_SPKI_SHA256)
+  if (!otaTrustAddPinnedHost(OTA_MIRROR_HOST, OTA_MIRROR_SPKI_SHA256)) {
+    OTA_LOGE("ERROR: OTA_MIRROR_SPKI_SHA256 must be 64 hex characters");
+  }
+#endif
+}
+
+// Sends queued attempt records to OTA_COLLECTOR_URL once a batch is due, or
+// now when `force` is set.
+void uploadTelemetry(OtaSession& session, bool force) {
+#ifdef OTA_COLLECTOR_URL
+  if (force || otaUplinkDue()) otaUplinkSend(session, OTA_COLLECTOR_URL, FIRMWARE_VERSION);
+#else
+  (void)session;
+  (void)force;
+#endif
+}
+
+void handleErrorState(OtaError error) {
+  otaAttempt.lastError = error;
+  OTA_LOGE("An error occurred. Error Code: %s", otaErrorName(error));
+  OTA_LOGI("Device will not attempt another update until rebooted.");
 }
 
 bool connectWiFi() {
@@ -311,27 +770,29 @@ bool connectWiFi() {
   
   WiFi.mode(WIFI_STA);
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  Serial.print("Connecting to WiFi");
+  OTA_LOGI("Connecting to WiFi");
   unsigned long start = millis();
   while (WiFi.status() != WL_CONNECTED && millis() - start < 15000) { // 15s timeout
-    Serial.print(".");
     delay(500);
   }
-  Serial.println();
   if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("WiFi Connected! IP: " + WiFi.localIP().toString());
+    IPAddress ip = WiFi.localIP();
+    OTA_LOGI("WiFi Connected! IP: %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
     return true;
   } else {
-    Serial.println("WiFi connection failed.");
+    OTA_LOGW("WiFi connection failed.");
     return false;
   }
 }
 
 bool validateConfiguration() {
   bool valid = true;
-  if (strlen(WIFI_SSID) == 0) { Serial.println("ERROR: WIFI_SSID is empty"); valid = false; }
-  if (strlen(MANIFEST_URL) == 0) { Serial.println("ERROR: MANIFEST_URL is empty"); valid = false; }
-  if (strlen(FIRMWARE_VERSION) == 0) { Serial.println("ERROR: FIRMWARE_VERSION is empty"); valid = false; }
-  if (strlen(PUBLIC_KEY) < 100) { Serial.println("ERROR: PUBLIC_KEY is missing or too short"); valid = false; }
+  if (strlen(WIFI_SSID) == 0) { OTA_LOGE("ERROR: WIFI_SSID is empty"); valid = false; }
+  if (strlen(MANIFEST_URL) == 0) { OTA_LOGE("ERROR: MANIFEST_URL is empty"); valid = false; }
+  if (!OTA_SIGNED_MANIFEST && strncmp(MANIFEST_URL, "https://", 8) != 0) {
+    OTA_LOGE("ERROR: MANIFEST_URL must use https:// unless OTA_SIGNED_MANIFEST is enabled"); valid = false;
+  }
+  if (strlen(FIRMWARE_VERSION) == 0) { OTA_LOGE("ERROR: FIRMWARE_VERSION is empty"); valid = false; }
+  if (strlen(PUBLIC_KEY) < 100) { OTA_LOGE("ERROR: PUBLIC_KEY is missing or too short"); valid = false; }
   return valid;
 }
\ No newline at end of file
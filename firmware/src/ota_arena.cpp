@@ -0,0 +1,27 @@
+#include "ota_arena.h"
+
+alignas(OTA_ARENA_ALIGN) static uint8_t arena[OTA_ARENA_SIZE];
+static size_t arenaUsed = 0;
+static size_t arenaPeak = 0;
+static uint32_t arenaFailures = 0;
+
+void* otaArenaAlloc(size_t size) {
+  size_t rounded = (size + OTA_ARENA_ALIGN - 1) & ~(size_t)(OTA_ARENA_ALIGN - 1);
+  if (rounded < size || rounded > sizeof(arena) - arenaUsed) {
+    arenaFailures++;
+    return nullptr;
+  }
+  void* memory = arena + arenaUsed;
+  arenaUsed += rounded;
+  if (arenaUsed > arenaPeak) arenaPeak = arenaUsed;
+  return memory;
+}
+
+size_t otaArenaAvailable() { return sizeof(arena) - arenaUsed; }
+size_t otaArenaPeak() { return arenaPeak; }
+void otaArenaResetPeak() { arenaPeak = arenaUsed; }
+uint32_t otaArenaFailures() { return arenaFailures; }
+
+OtaArenaScope::OtaArenaScope() : mark(arenaUsed) {}
+
+OtaArenaScope::~OtaArenaScope() { arenaUsed = mark; }
@@ -0,0 +1,44 @@
+#include "ota_bundle.h"
+
+#include <string.h>
+
+static uint16_t readLe16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OtaBundleParseResult otaBundleParseHeader(const uint8_t* raw, OtaBundleHeader& out) {
+  if (memcmp(raw, OTA_BUNDLE_MAGIC, 4) != 0) return OTA_BUNDLE_BAD_MAGIC;
+
+  out.format = raw[4];
+  out.hashAlgorithm = raw[5];
+  out.compression = raw[6];
+  if (out.format != OTA_BUNDLE_FORMAT_V1 || raw[7] != 0 || readLe16(raw + 14) != 0) {
+    return OTA_BUNDLE_BAD_FORMAT;
+  }
+  // Only plain SHA-256 images are understood by this firmware; newer packers may
+  // emit other combinations, which must be rejected before anything is flashed.
+  if (out.hashAlgorithm != OTA_BUNDLE_HASH_SHA256 || out.compression != OTA_BUNDLE_COMPRESSION_NONE) {
+    return OTA_BUNDLE_UNSUPPORTED;
+  }
+
+  out.imageSize = readLe32(raw + 8);
+  out.signatureLength = readLe16(raw + 12);
+  if (out.imageSize == 0 || out.signatureLength == 0 || out.signatureLength > OTA_BUNDLE_MAX_SIG_LEN) {
+    return OTA_BUNDLE_BAD_SIZE;
+  }
+
+  memcpy(out.version, raw + 16, OTA_BUNDLE_VERSION_LEN);
+  out.version[OTA_BUNDLE_VERSION_LEN] = '\0';
+  if (out.version[0] == '\0') return OTA_BUNDLE_BAD_FORMAT;
+
+  memcpy(out.imageDigest, raw + 48, OTA_BUNDLE_DIGEST_LEN);
+  return OTA_BUNDLE_OK;
+}
+
+size_t otaBundleTotalSize(const OtaBundleHeader& header) {
+  return OTA_BUNDLE_HEADER_SIZE + header.signatureLength + header.imageSize;
+}
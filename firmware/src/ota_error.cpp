@@ -0,0 +1,28 @@
+#include "ota_error.h"
+
+const char* otaErrorName(OtaError error) {
+  switch (error) {
+    case OTA_OK: return "OK";
+    case OTA_ERR_CONFIG_VALIDATION_FAILED: return "CONFIG_VALIDATION_FAILED";
+    case OTA_ERR_MANIFEST_FETCH_FAILED: return "MANIFEST_FETCH_FAILED";
+    case OTA_ERR_MANIFEST_PARSE_FAILED: return "MANIFEST_PARSE_FAILED";
+    case OTA_ERR_MANIFEST_INVALID: return "MANIFEST_INVALID";
+    case OTA_ERR_MANIFEST_SIGNATURE_INVALID: return "MANIFEST_SIGNATURE_INVALID";
+    case OTA_ERR_MANIFEST_REPLAYED: return "MANIFEST_REPLAYED";
+    case OTA_ERR_FIRMWARE_DOWNLOAD_FAILED: return "FIRMWARE_DOWNLOAD_FAILED";
+    case OTA_ERR_INVALID_FIRMWARE_SIZE: return "INVALID_FIRMWARE_SIZE";
+    case OTA_ERR_INSUFFICIENT_SPACE: return "INSUFFICIENT_SPACE";
+    case OTA_ERR_FIRMWARE_WRITE_ERROR: return "FIRMWARE_WRITE_ERROR";
+    case OTA_ERR_FIRMWARE_WRITE_INCOMPLETE: return "FIRMWARE_WRITE_INCOMPLETE";
+    case OTA_ERR_SIGNATURE_DOWNLOAD_FAILED: return "SIGNATURE_DOWNLOAD_FAILED";
+    case OTA_ERR_SIGNATURE_VERIFICATION_FAILED: return "SIGNATURE_VERIFICATION_FAILED";
+    case OTA_ERR_UPDATE_FINALIZE_FAILED: return "UPDATE_FINALIZE_FAILED";
+    case OTA_ERR_BUNDLE_DOWNLOAD_FAILED: return "BUNDLE_DOWNLOAD_FAILED";
+    case OTA_ERR_BUNDLE_HEADER_INVALID: return "BUNDLE_HEADER_INVALID";
+    case OTA_ERR_BUNDLE_UNSUPPORTED: return "BUNDLE_UNSUPPORTED";
+    case OTA_ERR_BUNDLE_VERSION_MISMATCH: return "BUNDLE_VERSION_MISMATCH";
+    case OTA_ERR_ARENA_EXHAUSTED: return "ARENA_EXHAUSTED";
+    case OTA_ERR_COUNT: break;
+  }
+  return "UNKNOWN";
+}
@@ -0,0 +1,375 @@
+#include "ota_http.h"
+
+#include <WiFi.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ota_arena.h"
+#include "ota_log.h"
+#include "ota_telemetry.h"
+#include "ota_trust.h"
+
+struct RedirectCacheEntry {
+  char source[OTA_REDIRECT_SOURCE_MAX]; // empty when the slot is free
+  OtaUrl target;
+  unsigned long expiresAt; // millis() timestamp
+};
+
+static RedirectCacheEntry redirectCache[OTA_REDIRECT_CACHE_SIZE];
+static bool plainHttpAllowed = false;
+
+// ====================================================================================
+// URL AND DATE HELPERS
+// ====================================================================================
+
+static bool isRedirect(int httpCode) {
+  return httpCode == HTTP_CODE_MOVED_PERMANENTLY || httpCode == HTTP_CODE_FOUND ||
+         httpCode == HTTP_CODE_SEE_OTHER || httpCode == HTTP_CODE_TEMPORARY_REDIRECT ||
+         httpCode == HTTP_CODE_PERMANENT_REDIRECT;
+}
+
+// Length of the "scheme://host[:port]" prefix of `url`, or 0 without a scheme
+static size_t originLength(const char* url) {
+  const char* schemeEnd = strstr(url, "://");
+  if (schemeEnd == nullptr) return 0;
+  const char* pathStart = strchr(schemeEnd + 3, '/');
+  return pathStart == nullptr ? strlen(url) : (size_t)(pathStart - url);
+}
+
+OtaTextView otaUrlHost(const char* url) {
+  const char* schemeEnd = strstr(url, "://");
+  const char* hostStart = schemeEnd == nullptr ? url : schemeEnd + 3;
+  const char* hostEnd = hostStart;
+  while (*hostEnd && *hostEnd != ':' && *hostEnd != '/' && *hostEnd != '?') hostEnd++;
+  return {hostStart, (size_t)(hostEnd - hostStart)};
+}
+
+static uint16_t urlPort(const char* url) {
+  OtaTextView host = otaUrlHost(url);
+  const char* afterHost = host.data + host.length;
+  if (*afterHost == ':') return (uint16_t)atoi(afterHost + 1);
+  return otaStartsWith(url, "https://") ? 443 : 80;
+}
+
+// Makes a Location header absolute. Returns false if it is empty or too long.
+static bool resolveLocation(const char* base, const char* location, OtaUrl& resolved) {
+  resolved.clear();
+  if (*location == '\0') return false;
+  if (strstr(location, "://") == nullptr) {
+    resolved.append(base, originLength(base));
+    if (location[0] != '/') resolved.append('/');
+  }
+  return resolved.append(location);
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Copies the URL-decoded value of query parameter `name` into `value`.
+// Returns false if the parameter is missing or its value does not fit.
+static bool queryParam(const char* url, const char* name, char* value, size_t size) {
+  const char* query = strchr(url, '?');
+  if (query == nullptr) return false;
+  size_t nameLen = strlen(name);
+  const char* pos = query + 1;
+  while (*pos) {
+    const char* end = strchr(pos, '&');
+    if (end == nullptr) end = pos + strlen(pos);
+    if (end - pos > (long)nameLen && pos[nameLen] == '=' && strncmp(pos, name, nameLen) == 0) {
+      size_t out = 0;
+      for (const char* p = pos + nameLen + 1; p < end; p++) {
+        if (out + 1 >= size) return false;
+        if (*p == '%' && p + 2 < end && hexValue(p[1]) >= 0 && hexValue(p[2]) >= 0) {
+          value[out++] = (char)(hexValue(p[1]) * 16 + hexValue(p[2]));
+          p += 2;
+        } else {
+          value[out++] = *p;
+        }
+      }
+      value[out] = '\0';
+      return true;
+    }
+    pos = *end ? end + 1 : end;
+  }
+  return false;
+}
+
+// Days since 1970-01-01 for a Gregorian calendar date
+static long daysFromCivil(long year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  unsigned yearOfEra = (unsigned)(year - era * 400);
+  unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (long)dayOfEra - 719468;
+}
+
+// Parses "2024-05-01T12:34:56Z" or the compact "20240501T123456Z" into Unix seconds.
+static bool parseIsoTimestamp(const char* text, long long& epoch) {
+  int digits[14];
+  int count = 0;
+  for (const char* p = text; *p && count < 14; p++) {
+    if (isDigit(*p)) digits[count++] = *p - '0';
+  }
+  if (count < 14) return false;
+  long year = digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+  unsigned month = digits[4] * 10 + digits[5];
+  unsigned day = digits[6] * 10 + digits[7];
+  int hour = digits[8] * 10 + digits[9];
+  int minute = digits[10] * 10 + digits[11];
+  int second = digits[12] * 10 + digits[13];
+  if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+  epoch = (long long)daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  return true;
+}
+
+// Parses an HTTP Date header ("Wed, 01 May 2024 12:34:56 GMT") into Unix seconds.
+static bool parseHttpDate(const char* text, long long& epoch) {
+  static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  int day, year, hour, minute, second;
+  char monthName[4];
+  if (sscanf(text, "%*3s, %d %3s %d %d:%d:%d", &day, monthName, &year, &hour, &minute, &second) != 6) {
+    return false;
+  }
+  const char* found = strstr(months, monthName);
+  if (found == nullptr || (found - months) % 3 != 0) return false;
+  unsigned month = (found - months) / 3 + 1;
+  epoch = (long long)daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  return true;
+}
+
+// Seconds a signed redirect target remains valid, judged against the server's
+// Date header so that no device clock is needed.
+static long redirectLifetime(const char* target, const char* dateHeader) {
+  long long now = 0;
+  bool haveNow = parseHttpDate(dateHeader, now);
+  char value[32];
+
+  // Azure SAS expiry, used by GitHub release asset downloads
+  long long expiry;
+  if (queryParam(target, "se", value, sizeof(value)) && haveNow && parseIsoTimestamp(value, expiry)) {
+    return (long)(expiry - now);
+  }
+
+  // AWS SigV4 presigned URL: lifetime counted from the signing time
+  if (queryParam(target, "X-Amz-Expires", value, sizeof(value))) {
+    long lifetime = atol(value);
+    long long signedAt;
+    if (haveNow && queryParam(target, "X-Amz-Date", value, sizeof(value)) && parseIsoTimestamp(value, signedAt)) {
+      lifetime -= (long)(now - signedAt);
+    }
+    return lifetime;
+  }
+
+  // CloudFront / S3 v2 style absolute expiry in Unix seconds
+  if (queryParam(target, "Expires", value, sizeof(value)) && haveNow) {
+    return (long)(atoll(value) - now);
+  }
+
+  return OTA_REDIRECT_DEFAULT_TTL_S;
+}
+
+// ====================================================================================
+// REDIRECT CACHE
+// ====================================================================================
+
+static const char* lookupRedirect(const char* source) {
+  unsigned long now = millis();
+  for (RedirectCacheEntry& entry : redirectCache) {
+    if (entry.source[0] == '\0' || strcmp(entry.source, source) != 0) continue;
+    if ((long)(entry.expiresAt - now) <= 0) {
+      entry.source[0] = '\0';
+      return nullptr;
+    }
+    return entry.target.c_str();
+  }
+  return nullptr;
+}
+
+static void forgetRedirect(const char* source) {
+  for (RedirectCacheEntry& entry : redirectCache) {
+    if (strcmp(entry.source, source) == 0) entry.source[0] = '\0';
+  }
+}
+
+static void rememberRedirect(const char* source, const OtaUrl& target, const char* dateHeader) {
+  if (strlen(source) >= OTA_REDIRECT_SOURCE_MAX) return;
+  long lifetime = redirectLifetime(target.c_str(), dateHeader) - OTA_REDIRECT_EXPIRY_MARGIN_S;
+  if (lifetime <= 0) return;
+
+  unsigned long now = millis();
+  // Reuse the entry for this source, else an empty one, else the one expiring first
+  RedirectCacheEntry* slot = &redirectCache[0];
+  for (RedirectCacheEntry& entry : redirectCache) {
+    if (strcmp(entry.source, source) == 0) { slot = &entry; break; }
+    if (entry.source[0] == '\0') { slot = &entry; continue; }
+    if (slot->source[0] != '\0' && (long)(entry.expiresAt - slot->expiresAt) < 0) slot = &entry;
+  }
+  strcpy(slot->source, source);
+  slot->target = target;
+  slot->expiresAt = now + (unsigned long)lifetime * 1000UL;
+}
+
+void otaRedirectCacheClear() {
+  for (RedirectCacheEntry& entry : redirectCache) entry.source[0] = '\0';
+}
+
+// ====================================================================================
+// REQUESTS
+// ====================================================================================
+
+void otaSessionSetTimeout(OtaSession& session, uint32_t timeoutMs) {
+  session.secure.setTimeout(timeoutMs);
+  session.plain.setTimeout(timeoutMs);
+}
+
+void otaSessionClose(OtaSession& session) {
+  session.secure.stop();
+  session.plain.stop();
+  session.secureOrigin.clear();
+  session.plainOrigin.clear();
+}
+
+void otaHttpAllowPlainHttp(bool allow) {
+  plainHttpAllowed = allow;
+}
+
+static int sendRequest(HTTPClient& http, OtaSession& session, const char* url, const char* method,
+                       const uint8_t* body = nullptr, size_t bodyLength = 0, const char* contentType = nullptr) {
+  static const char* headerKeys[] = {"Location", "Date"};
+
+  bool https = otaStartsWith(url, "https://");
+  if (!https && !plainHttpAllowed) return OTA_HTTP_ERROR_INSECURE_SCHEME;
+  WiFiClient& client = https ? session.secure : session.plain;
+  OtaFixedString<OTA_ORIGIN_MAX>& connectedOrigin = https ? session.secureOrigin : session.plainOrigin;
+
+  // HTTPClient reuses any open socket regardless of host, so a connection to
+  // another origin has to be dropped before the request is sent. New
+  // connections are opened here rather than inside HTTPClient so that a pinned
+  // key is checked before any request bytes go out.
+  size_t originLen = originLength(url);
+  bool sameOrigin = connectedOrigin.length == originLen && strncmp(connectedOrigin.c_str(), url, originLen) == 0;
+  if (!client.connected() || !sameOrigin) {
+    if (client.connected()) client.stop();
+    connectedOrigin.clear();
+    OtaTextView hostView = otaUrlHost(url);
+    OtaFixedString<OTA_HOST_MAX> host;
+    if (!host.assign(hostView.data, hostView.length)) return HTTPC_ERROR_CONNECTION_REFUSED;
+    if (https) otaTrustApply(session.secure, host.c_str());
+    otaAttempt.connections++;
+    if (https) otaAttempt.tlsHandshakes++;
+
+    // Resolve separately so DNS shows up on its own in the timing record; the
+    // TLS client's own lookup then hits the lwIP cache
+    uint32_t stepStart = micros();
+    IPAddress address;
+    if (!WiFi.hostByName(host.c_str(), address)) return HTTPC_ERROR_CONNECTION_REFUSED;
+    otaTelemetryAddTime(otaAttempt.timing.dnsUs, stepStart);
+    stepStart = micros();
+    bool connected = https ? client.connect(host.c_str(), urlPort(url)) : client.connect(address, urlPort(url));
+    otaTelemetryAddTime(https ? otaAttempt.timing.tlsUs : otaAttempt.timing.tcpUs, stepStart);
+    if (!connected) return HTTPC_ERROR_CONNECTION_REFUSED;
+    if (https && !otaTrustVerifyPeer(session.secure, host.c_str())) {
+      client.stop();
+      return OTA_HTTP_ERROR_PIN_MISMATCH;
+    }
+    otaTelemetrySampleHeap(); // an established TLS session holds its record buffers
+    connectedOrigin.assign(url, originLen);
+  }
+
+  http.setFollowRedirects(HTTPC_DISABLE_FOLLOW_REDIRECTS);
+  http.setUserAgent(OTA_USER_AGENT);
+  // HTTPClient keeps its own String copies of the URL and headers; they are
+  // released again by http.end()
+  if (!http.begin(client, url)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  http.collectHeaders(headerKeys, 2);
+  if (contentType != nullptr) http.addHeader("Content-Type", contentType); // after begin(), which clears headers
+  otaAttempt.httpRequests++;
+  uint32_t requestStart = micros();
+  // HTTPClient takes a non-const pointer but only reads the body
+  int httpCode = http.sendRequest(method, const_cast<uint8_t*>(body), bodyLength);
+  otaTelemetryAddTime(otaAttempt.timing.ttfbUs, requestStart);
+  return httpCode;
+}
+
+int otaHttpGet(HTTPClient& http, OtaSession& session, const char* url) {
+  // A signed CDN URL is close to 1 KB, too much for the loop task's stack
+  OtaArenaScope arenaScope;
+  OtaUrl* current = otaArenaNew<OtaUrl>();
+  OtaUrl* location = otaArenaNew<OtaUrl>();
+  if (current == nullptr || location == nullptr) return OTA_HTTP_ERROR_OUT_OF_MEMORY;
+  OtaFixedString<40> dateHeader;
+
+  const char* cached = lookupRedirect(url);
+  bool fromCache = cached != nullptr;
+  current->assign(fromCache ? cached : url);
+  if (fromCache) otaAttempt.redirectCacheHits++;
+
+  int hops = 0;
+  while (true) {
+    uint32_t requestStart = micros();
+    int httpCode = sendRequest(http, session, current->c_str(), "GET");
+
+    if (fromCache && httpCode != HTTP_CODE_OK) {
+      // The cached target was rejected (revoked early, clock skew, CDN error);
+      // forget it and resolve the original URL again.
+      OTA_LOGW("Cached redirect target failed (HTTP %d), resolving again.", httpCode);
+      otaHttpAbort(http);
+      forgetRedirect(url);
+      current->assign(url);
+      fromCache = false;
+      continue;
+    }
+
+    if (!isRedirect(httpCode)) return httpCode;
+
+    if (!resolveLocation(current->c_str(), http.header("Location").c_str(), *location)) return httpCode;
+    dateHeader.assign(http.header("Date").c_str());
+    // Redirects normally carry no body; keep the connection only then
+    if (http.getSize() == 0) {
+      http.end();
+    } else {
+      otaHttpAbort(http);
+    }
+    otaTelemetryAddTime(otaAttempt.timing.redirectUs, requestStart);
+
+    if (++hops > OTA_MAX_REDIRECTS) return OTA_HTTP_ERROR_TOO_MANY_REDIRECTS;
+    otaAttempt.redirectHops++;
+    rememberRedirect(url, *location, dateHeader.c_str());
+    *current = *location;
+  }
+}
+
+void otaHttpAbort(HTTPClient& http) {
+  http.setReuse(false);
+  http.end();
+  http.setReuse(true); // the client object may be used for another request
+}
+
+bool otaHttpResolve(OtaSession& session, const char* url) {
+  if (lookupRedirect(url) != nullptr) return true;
+
+  OtaArenaScope arenaScope;
+  OtaUrl* location = otaArenaNew<OtaUrl>();
+  if (location == nullptr) return false;
+  HTTPClient http;
+  http.setTimeout(15000);
+  uint32_t requestStart = micros();
+  int httpCode = sendRequest(http, session, url, "HEAD");
+  bool redirected = isRedirect(httpCode) && resolveLocation(url, http.header("Location").c_str(), *location);
+  if (redirected) {
+    otaAttempt.redirectHops++;
+    rememberRedirect(url, *location, http.header("Date").c_str());
+  }
+  http.end();
+  if (redirected) otaTelemetryAddTime(otaAttempt.timing.redirectUs, requestStart);
+  return lookupRedirect(url) != nullptr;
+}
+
+int otaHttpPost(HTTPClient& http, OtaSession& session, const char* url, const uint8_t* body, size_t length,
+                const char* contentType) {
+  return sendRequest(http, session, url, "POST", body, length, contentType);
+}
@@ -0,0 +1,270 @@
+#include "ota_log.h"
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static_assert((OTA_LOG_RING_SIZE & (OTA_LOG_RING_SIZE - 1)) == 0, "OTA_LOG_RING_SIZE must be a power of two");
+
+#define LOG_LINE_MAX 320
+#define LOG_DRAIN_INTERVAL_MS 20
+
+// Bounded multi-producer queue (Vyukov). A slot's sequence says whose turn it
+// is: equal to a producer's ticket when free, ticket + 1 once published. The
+// stored value is offset by the slot index so that the zeroed .bss is already
+// the initial state, and logging works before otaLogBegin().
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  OtaLogRecord record;
+};
+
+static LogSlot ring[OTA_LOG_RING_SIZE];
+static std::atomic<uint32_t> enqueuePos(0);
+static std::atomic<uint32_t> dequeuePos(0);
+static std::atomic<uint32_t> droppedRecords(0);
+static std::atomic<uint32_t> reportedDrops(0); // otaLogFlush() may drain alongside the task
+static TaskHandle_t drainTaskHandle = nullptr;
+
+// The pinned slot. Its ticket is the enqueue position when it was claimed, so
+// the records queued before it are written first.
+enum PinnedState : uint8_t { PINNED_FREE, PINNED_WRITING, PINNED_READY, PINNED_READING };
+static std::atomic<uint8_t> pinnedState(PINNED_FREE);
+static OtaLogRecord pinnedRecord;
+static uint32_t pinnedTicket = 0;
+
+static uint32_t slotSequence(uint32_t index) {
+  return ring[index].sequence.load(std::memory_order_acquire) + index;
+}
+
+static void setSlotSequence(uint32_t index, uint32_t sequence) {
+  ring[index].sequence.store(sequence - index, std::memory_order_release);
+}
+
+OtaLogRecord* otaLogClaim(uint8_t level, const char* format, uint32_t& ticket) {
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+  while (true) {
+    uint32_t index = pos & (OTA_LOG_RING_SIZE - 1);
+    int32_t diff = (int32_t)(slotSequence(index) - pos);
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      droppedRecords.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  ticket = pos;
+  OtaLogRecord& record = ring[pos & (OTA_LOG_RING_SIZE - 1)].record;
+  record.timestampMs = millis();
+  record.format = format;
+  record.level = level;
+  record.length = 0;
+  return &record;
+}
+
+void otaLogPublish(uint32_t ticket) {
+  setSlotSequence(ticket & (OTA_LOG_RING_SIZE - 1), ticket + 1);
+}
+
+OtaLogRecord* otaLogClaimPinned(uint8_t level, const char* format) {
+  uint8_t expected = PINNED_FREE;
+  if (!pinnedState.compare_exchange_strong(expected, PINNED_WRITING, std::memory_order_acquire)) {
+    droppedRecords.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  pinnedTicket = enqueuePos.load(std::memory_order_relaxed);
+  pinnedRecord.timestampMs = millis();
+  pinnedRecord.format = format;
+  pinnedRecord.level = level;
+  pinnedRecord.length = 0;
+  return &pinnedRecord;
+}
+
+void otaLogPublishPinned() {
+  pinnedState.store(PINNED_READY, std::memory_order_release);
+}
+
+// Copies the pinned record out once everything queued before it has been taken.
+static bool takePinned(OtaLogRecord& out) {
+  uint8_t expected = PINNED_READY;
+  if (pinnedState.load(std::memory_order_acquire) != PINNED_READY) return false;
+  if ((int32_t)(dequeuePos.load(std::memory_order_relaxed) - pinnedTicket) < 0) return false;
+  if (!pinnedState.compare_exchange_strong(expected, PINNED_READING, std::memory_order_acquire)) return false;
+  out = pinnedRecord;
+  pinnedState.store(PINNED_FREE, std::memory_order_release);
+  return true;
+}
+
+// Copies the oldest published record out and frees its slot.
+static bool takeRecord(OtaLogRecord& out) {
+  uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+  while (true) {
+    uint32_t index = pos & (OTA_LOG_RING_SIZE - 1);
+    int32_t diff = (int32_t)(slotSequence(index) - (pos + 1));
+    if (diff == 0) {
+      if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = dequeuePos.load(std::memory_order_relaxed);
+    }
+  }
+  uint32_t index = pos & (OTA_LOG_RING_SIZE - 1);
+  out = ring[index].record;
+  setSlotSequence(index, pos + OTA_LOG_RING_SIZE);
+  return true;
+}
+
+// ====================================================================================
+// DEFERRED FORMATTING
+// ====================================================================================
+
+static bool isUnsignedConversion(char conversion) {
+  return conversion == 'u' || conversion == 'x' || conversion == 'X' || conversion == 'o';
+}
+
+// Formats one conversion of `spec` (without length modifier) using the next
+// argument. The argument's recorded type decides how it is passed, so a
+// length modifier that does not match the platform cannot misread the payload.
+static int formatArgument(char* out, size_t size, char* spec, size_t specLen, char conversion,
+                          const OtaLogRecord& record, size_t& argPos) {
+  if (argPos >= record.length) return snprintf(out, size, "?");
+  uint8_t type = record.payload[argPos++];
+  const uint8_t* value = record.payload + argPos;
+
+  if (type == OTA_LOG_ARG_STRING) {
+    argPos += strlen((const char*)value) + 1;
+    if (conversion != 's') return snprintf(out, size, "?");
+    spec[specLen++] = 's';
+    spec[specLen] = '\0';
+    return snprintf(out, size, spec, (const char*)value);
+  }
+  if (type == OTA_LOG_ARG_POINTER) {
+    const void* pointer;
+    memcpy(&pointer, value, sizeof(pointer));
+    argPos += sizeof(pointer);
+    return snprintf(out, size, "%p", pointer);
+  }
+  if (type == OTA_LOG_ARG_DOUBLE) {
+    double number;
+    memcpy(&number, value, sizeof(number));
+    argPos += sizeof(number);
+    if (!strchr("fFeEgGaA", conversion)) return snprintf(out, size, "?");
+    spec[specLen++] = conversion;
+    spec[specLen] = '\0';
+    return snprintf(out, size, spec, number);
+  }
+
+  long long number;
+  if (type == OTA_LOG_ARG_INT64) {
+    int64_t wide;
+    memcpy(&wide, value, sizeof(wide));
+    argPos += sizeof(wide);
+    number = wide;
+  } else {
+    int32_t narrow;
+    memcpy(&narrow, value, sizeof(narrow));
+    argPos += sizeof(narrow);
+    number = isUnsignedConversion(conversion) ? (long long)(uint32_t)narrow : (long long)narrow;
+  }
+  if (conversion == 'c') {
+    spec[specLen++] = 'c';
+    spec[specLen] = '\0';
+    return snprintf(out, size, spec, (int)number);
+  }
+  if (!strchr("diuxXo", conversion)) return snprintf(out, size, "?");
+  spec[specLen++] = 'l';
+  spec[specLen++] = 'l';
+  spec[specLen++] = conversion;
+  spec[specLen] = '\0';
+  return snprintf(out, size, spec, number);
+}
+
+static size_t formatRecord(const OtaLogRecord& record, char* line, size_t size) {
+  static const char levelNames[] = "-EWID";
+  int written = snprintf(line, size, "%c (%lu) ", levelNames[record.level < 5 ? record.level : 0],
+                         (unsigned long)record.timestampMs);
+  size_t pos = written > 0 ? (size_t)written : 0;
+  size_t argPos = 0;
+  const char* format = record.format;
+
+  while (*format && pos < size - 2) {
+    if (*format != '%') {
+      line[pos++] = *format++;
+      continue;
+    }
+    if (format[1] == '%') {
+      line[pos++] = '%';
+      format += 2;
+      continue;
+    }
+    // %[flags][width][.precision][length]conversion; the length is replaced
+    // by one matching the recorded argument type
+    char spec[16];
+    size_t specLen = 0;
+    spec[specLen++] = *format++;
+    while (*format && strchr("-+ #0123456789.", *format) && specLen < sizeof(spec) - 4) spec[specLen++] = *format++;
+    while (*format && strchr("hlzjtL", *format)) format++;
+    if (*format == '\0') break;
+    char conversion = *format++;
+    int added = formatArgument(line + pos, size - 1 - pos, spec, specLen, conversion, record, argPos);
+    if (added > 0) pos += (size_t)added < size - 1 - pos ? (size_t)added : size - 2 - pos;
+  }
+  // Records carry no newline; every record is one line
+  line[pos++] = '\n';
+  return pos;
+}
+
+// ====================================================================================
+// OUTPUT
+// ====================================================================================
+
+static void drainRecords() {
+  char line[LOG_LINE_MAX];
+  OtaLogRecord record;
+  while (takePinned(record) || takeRecord(record)) {
+    size_t length = formatRecord(record, line, sizeof(line));
+    Serial.write((const uint8_t*)line, length);
+  }
+  // Claim the drops not yet reported, so two drains never report the same ones
+  uint32_t dropped = droppedRecords.load(std::memory_order_relaxed);
+  uint32_t reported = reportedDrops.load(std::memory_order_relaxed);
+  while ((int32_t)(dropped - reported) > 0) {
+    if (reportedDrops.compare_exchange_weak(reported, dropped, std::memory_order_relaxed)) {
+      int length = snprintf(line, sizeof(line), "W (%lu) log: %lu records dropped\n", (unsigned long)millis(),
+                            (unsigned long)(dropped - reported));
+      Serial.write((const uint8_t*)line, length);
+      break;
+    }
+  }
+}
+
+static void drainTask(void*) {
+  while (true) {
+    drainRecords();
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
+
+bool otaLogBegin() {
+  if (drainTaskHandle != nullptr) return true;
+  // Same priority as the Arduino loop task: the loop never blocks, so a lower
+  // priority would never run. Time slicing keeps the UART writes off the loop.
+  return xTaskCreate(drainTask, "ota_log", 3072, nullptr, tskIDLE_PRIORITY + 1, &drainTaskHandle) == pdPASS;
+}
+
+void otaLogFlush() {
+  drainRecords();
+  Serial.flush();
+}
+
+uint32_t otaLogStackHighWater() {
+  return drainTaskHandle == nullptr ? 0 : uxTaskGetStackHighWaterMark(drainTaskHandle);
+}
+
+uint32_t otaLogDropped() {
+  return droppedRecords.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,261 @@
+#include "ota_metrics.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ota_error.h"
+#include "ota_log.h"
+#include "ota_replay.h"
+#include "ota_telemetry.h"
+
+static const uint32_t latencyBucketsMs[] = OTA_METRICS_LATENCY_BUCKETS_MS;
+#define LATENCY_BUCKET_COUNT (sizeof(latencyBucketsMs) / sizeof(latencyBucketsMs[0]))
+
+#define REQUEST_TIMEOUT_MS 2000
+#define REQUEST_LINE_MAX 64
+
+struct PhaseLatency {
+  uint32_t buckets[LATENCY_BUCKET_COUNT + 1]; // last one is +Inf
+  uint32_t count;
+  uint64_t sumUs;
+};
+
+struct MetricsTotals {
+  uint32_t checks;
+  uint32_t failures[OTA_ERR_COUNT];
+  uint32_t httpRequests;
+  uint32_t redirectHops;
+  uint32_t tlsHandshakes;
+  uint32_t stalls;
+  uint64_t bytesDownloaded;
+  uint64_t downloadUs;
+  uint32_t lastThroughput; // bytes/s of the last check that downloaded anything
+  PhaseLatency phases[OTA_PHASE_COUNT];
+};
+
+static MetricsTotals totals;
+static portMUX_TYPE totalsLock = portMUX_INITIALIZER_UNLOCKED;
+static const char* metricsFirmwareVersion = "";
+
+void otaMetricsRecordAttempt(const OtaAttemptStats& attempt) {
+  const OtaAttemptTiming& timing = attempt.timing;
+  portENTER_CRITICAL(&totalsLock);
+  totals.checks++;
+  if (attempt.lastError > OTA_OK && attempt.lastError < OTA_ERR_COUNT) totals.failures[attempt.lastError]++;
+  totals.httpRequests += attempt.httpRequests;
+  totals.redirectHops += attempt.redirectHops;
+  totals.tlsHandshakes += attempt.tlsHandshakes;
+  totals.stalls += timing.stalls;
+  totals.bytesDownloaded += timing.bytesReceived;
+  totals.downloadUs += timing.downloadUs;
+  if (timing.downloadUs > 0) {
+    totals.lastThroughput = (uint32_t)((uint64_t)timing.bytesReceived * 1000000 / timing.downloadUs);
+  }
+  for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) {
+    if (!attempt.memory[phase].entered) continue;
+    PhaseLatency& latency = totals.phases[phase];
+    uint32_t elapsedMs = timing.phaseUs[phase] / 1000;
+    size_t bucket = 0;
+    while (bucket < LATENCY_BUCKET_COUNT && elapsedMs > latencyBucketsMs[bucket]) bucket++;
+    latency.buckets[bucket]++;
+    latency.count++;
+    latency.sumUs += timing.phaseUs[phase];
+  }
+  portEXIT_CRITICAL(&totalsLock);
+}
+
+// ====================================================================================
+// RENDERING
+// ====================================================================================
+
+// Appends to a fixed buffer; once something does not fit, output stops at the
+// last complete line.
+class MetricsWriter {
+ public:
+  MetricsWriter(char* out, size_t size) : out(out), size(size), length(0), full(size == 0) {}
+
+  void line(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    if (full) return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out + length, size - length, format, args);
+    va_end(args);
+    if (written < 0 || (size_t)written + 1 >= size - length) {
+      full = true;
+      out[length] = '\0';
+      return;
+    }
+    length += written;
+    out[length++] = '\n';
+    out[length] = '\0';
+  }
+
+  void header(const char* name, const char* type, const char* help) {
+    line("# HELP %s %s", name, help);
+    line("# TYPE %s %s", name, type);
+  }
+
+  size_t used() const { return length; }
+
+ private:
+  char* out;
+  size_t size;
+  size_t length;
+  bool full;
+};
+
+size_t otaMetricsRender(char* out, size_t size) {
+  // Copied so the lock is held only for a memcpy, never while formatting
+  static MetricsTotals snapshot;
+  portENTER_CRITICAL(&totalsLock);
+  snapshot = totals;
+  portEXIT_CRITICAL(&totalsLock);
+
+  MetricsWriter writer(out, size);
+  writer.header("ota_firmware_info", "gauge", "Running firmware version.");
+  writer.line("ota_firmware_info{version=\"%s\"} 1", metricsFirmwareVersion);
+  writer.header("ota_uptime_seconds", "gauge", "Seconds since boot.");
+  writer.line("ota_uptime_seconds %lu", (unsigned long)(millis() / 1000));
+  writer.header("ota_free_heap_bytes", "gauge", "Current free heap.");
+  writer.line("ota_free_heap_bytes %lu", (unsigned long)ESP.getFreeHeap());
+  writer.header("ota_largest_free_block_bytes", "gauge", "Largest block the heap can allocate.");
+  writer.line("ota_largest_free_block_bytes %lu", (unsigned long)ESP.getMaxAllocHeap());
+
+  writer.header("ota_checks_total", "counter", "Update checks run since boot.");
+  writer.line("ota_checks_total %lu", (unsigned long)snapshot.checks);
+  writer.header("ota_failures_total", "counter", "Update checks that ended in handleErrorState(), by code.");
+  for (int code = OTA_OK + 1; code < OTA_ERR_COUNT; code++) {
+    writer.line("ota_failures_total{code=\"%s\"} %lu", otaErrorName((OtaError)code),
+                (unsigned long)snapshot.failures[code]);
+  }
+  writer.header("ota_http_requests_total", "counter", "HTTP requests sent, including redirect hops.");
+  writer.line("ota_http_requests_total %lu", (unsigned long)snapshot.httpRequests);
+  writer.header("ota_redirects_total", "counter", "Redirect hops followed.");
+  writer.line("ota_redirects_total %lu", (unsigned long)snapshot.redirectHops);
+  writer.header("ota_tls_handshakes_total", "counter", "TLS sessions negotiated.");
+  writer.line("ota_tls_handshakes_total %lu", (unsigned long)snapshot.tlsHandshakes);
+  writer.header("ota_download_stalls_total", "counter", "Waits for download data longer than the stall threshold.");
+  writer.line("ota_download_stalls_total %lu", (unsigned long)snapshot.stalls);
+  writer.header("ota_downloaded_bytes_total", "counter", "Image and signature bytes received.");
+  writer.line("ota_downloaded_bytes_total %llu", (unsigned long long)snapshot.bytesDownloaded);
+  writer.header("ota_download_seconds_total", "counter", "Time spent streaming images into flash.");
+  writer.line("ota_download_seconds_total %.3f", snapshot.downloadUs / 1e6);
+  writer.header("ota_last_download_throughput_bytes_per_second", "gauge", "Throughput of the last download.");
+  writer.line("ota_last_download_throughput_bytes_per_second %lu", (unsigned long)snapshot.lastThroughput);
+
+  writer.header("ota_phase_duration_seconds", "histogram", "Wall time per update stage and check.");
+  for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) {
+    const PhaseLatency& latency = snapshot.phases[phase];
+    const char* name = otaPhaseName((OtaPhase)phase);
+    uint32_t cumulative = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+      cumulative += latency.buckets[bucket];
+      writer.line("ota_phase_duration_seconds_bucket{phase=\"%s\",le=\"%.3f\"} %lu", name,
+                  latencyBucketsMs[bucket] / 1000.0, (unsigned long)cumulative);
+    }
+    writer.line("ota_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %lu", name, (unsigned long)latency.count);
+    writer.line("ota_phase_duration_seconds_sum{phase=\"%s\"} %.6f", name, latency.sumUs / 1e6);
+    writer.line("ota_phase_duration_seconds_count{phase=\"%s\"} %lu", name, (unsigned long)latency.count);
+  }
+
+  writer.header("ota_log_dropped_total", "counter", "Log records dropped because the ring was full.");
+  writer.line("ota_log_dropped_total %lu", (unsigned long)otaLogDropped());
+  writer.header("ota_manifest_age_unchecked_total", "counter",
+                "Signed manifests accepted without an age check because the clock was not set.");
+  writer.line("ota_manifest_age_unchecked_total %lu", (unsigned long)otaReplayAgeUnchecked());
+  return writer.used();
+}
+
+// ====================================================================================
+// SERVER
+// ====================================================================================
+
+#if OTA_METRICS_PORT
+
+static char responseBuffer[OTA_METRICS_BUFFER_SIZE];
+static TaskHandle_t serverTaskHandle = nullptr;
+
+// Reads the request line and skips the headers. Returns false on timeout.
+static bool readRequest(WiFiClient& client, char* requestLine, size_t size) {
+  size_t length = 0;
+  bool firstLine = true;
+  bool lineEmpty = true;
+  unsigned long start = millis();
+  while (client.connected() && millis() - start < REQUEST_TIMEOUT_MS) {
+    int c = client.read();
+    if (c < 0) {
+      vTaskDelay(pdMS_TO_TICKS(5));
+      continue;
+    }
+    if (c == '\r') continue;
+    if (c == '\n') {
+      if (lineEmpty) return !firstLine;
+      firstLine = false;
+      lineEmpty = true;
+      continue;
+    }
+    lineEmpty = false;
+    if (firstLine && length < size - 1) requestLine[length++] = (char)c;
+    requestLine[length] = '\0';
+  }
+  return false;
+}
+
+static void serveClient(WiFiClient& client) {
+  char requestLine[REQUEST_LINE_MAX] = "";
+  if (!readRequest(client, requestLine, sizeof(requestLine))) return;
+
+  if (strncmp(requestLine, "GET /metrics ", 13) != 0 && strcmp(requestLine, "GET /metrics") != 0) {
+    client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    return;
+  }
+  size_t length = otaMetricsRender(responseBuffer, sizeof(responseBuffer));
+  client.printf("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\n"
+                "Connection: close\r\n\r\n",
+                (unsigned)length);
+  client.write((const uint8_t*)responseBuffer, length);
+}
+
+static void serverTask(void*) {
+  WiFiServer server(OTA_METRICS_PORT);
+  bool listening = false;
+  while (true) {
+    if (!listening) {
+      if (WiFi.status() == WL_CONNECTED) {
+        server.begin();
+        listening = true;
+      } else {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        continue;
+      }
+    }
+    WiFiClient client = server.available();
+    if (!client) {
+      vTaskDelay(pdMS_TO_TICKS(50));
+      continue;
+    }
+    serveClient(client);
+    client.stop();
+  }
+}
+
+bool otaMetricsBegin(const char* firmwareVersion) {
+  metricsFirmwareVersion = firmwareVersion;
+  if (serverTaskHandle != nullptr) return true;
+  // Pinned to the protocol core, away from the loop task that runs the OTA path
+  return xTaskCreatePinnedToCore(serverTask, "ota_metrics", 4096, nullptr, tskIDLE_PRIORITY + 1, &serverTaskHandle,
+                                 0) == pdPASS;
+}
+
+#else
+
+bool otaMetricsBegin(const char* firmwareVersion) {
+  metricsFirmwareVersion = firmwareVersion;
+  return true;
+}
+
+#endif
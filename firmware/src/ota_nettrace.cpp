@@ -0,0 +1,118 @@
+#include "ota_nettrace.h"
+
+#if OTA_NET_TRACE
+#include <Arduino.h>
+#include <string.h>
+
+struct NetTrace {
+  uint32_t imageLength;
+  uint32_t bytesRecorded;
+  uint32_t recordCount;
+  uint32_t lastUs;
+  size_t used;
+  bool truncated;
+  bool pending; // Recorded since the last export
+  uint8_t records[OTA_NET_TRACE_BUFFER_SIZE];
+};
+
+static NetTrace trace;
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+  size_t length = 0;
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[length++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return length;
+}
+
+static void putLittleEndian(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+void otaNetTraceBegin(size_t imageLength) {
+  trace.imageLength = (uint32_t)imageLength;
+  trace.bytesRecorded = 0;
+  trace.recordCount = 0;
+  trace.lastUs = micros();
+  trace.used = 0;
+  trace.truncated = false;
+  trace.pending = true;
+}
+
+void otaNetTraceArrival(size_t bytes) {
+  uint32_t now = micros();
+  uint8_t record[10];
+  size_t length = putVarint(record, now - trace.lastUs);
+  length += putVarint(record + length, (uint32_t)bytes);
+  if (trace.used + length > sizeof(trace.records)) {
+    trace.truncated = true;
+    return;
+  }
+  memcpy(trace.records + trace.used, record, length);
+  trace.used += length;
+  trace.lastUs = now;
+  trace.bytesRecorded += bytes;
+  trace.recordCount++;
+}
+
+// Base64 in lines of 76 characters, fed 57 bytes at a time
+class Base64Lines {
+ public:
+  explicit Base64Lines(Print& out) : out(out) {}
+
+  void write(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+      pending[pendingLength++] = data[i];
+      if (pendingLength == sizeof(pending)) flushLine();
+    }
+  }
+
+  void flushLine() {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (pendingLength == 0) return;
+    char line[77];
+    size_t out = 0;
+    for (size_t i = 0; i < pendingLength; i += 3) {
+      uint32_t group = (uint32_t)pending[i] << 16;
+      if (i + 1 < pendingLength) group |= (uint32_t)pending[i + 1] << 8;
+      if (i + 2 < pendingLength) group |= pending[i + 2];
+      line[out++] = alphabet[(group >> 18) & 0x3F];
+      line[out++] = alphabet[(group >> 12) & 0x3F];
+      line[out++] = i + 1 < pendingLength ? alphabet[(group >> 6) & 0x3F] : '=';
+      line[out++] = i + 2 < pendingLength ? alphabet[group & 0x3F] : '=';
+    }
+    line[out] = '\0';
+    this->out.println(line);
+    pendingLength = 0;
+  }
+
+ private:
+  Print& out;
+  uint8_t pending[57];
+  size_t pendingLength = 0;
+};
+
+void otaNetTraceExport(Print& out, uint32_t rttUs) {
+  if (!trace.pending) return;
+  trace.pending = false;
+
+  uint8_t header[OTA_NET_TRACE_HEADER_SIZE] = {0};
+  memcpy(header, OTA_NET_TRACE_MAGIC, 4);
+  header[4] = OTA_NET_TRACE_FORMAT_V1;
+  header[5] = trace.truncated ? OTA_NET_TRACE_TRUNCATED : 0;
+  putLittleEndian(header + 8, trace.imageLength);
+  putLittleEndian(header + 12, trace.bytesRecorded);
+  putLittleEndian(header + 16, rttUs);
+  putLittleEndian(header + 20, trace.recordCount);
+
+  out.println("=== OTA NETTRACE BEGIN ===");
+  Base64Lines lines(out);
+  lines.write(header, sizeof(header));
+  lines.write(trace.records, trace.used);
+  lines.flushLine();
+  out.println("=== OTA NETTRACE END ===");
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include "ota_profile.h"
+
+#if OTA_PROFILE
+#include <Arduino.h>
+#include <string.h>
+#include "ota_log.h"
+
+// Values below 2^SUB_BITS get exact buckets; above that each power of two is
+// split into 2^SUB_BITS buckets.
+#define SUB_BITS 2
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKET_COUNT ((32 - SUB_BITS + 1) * SUB_BUCKETS)
+
+struct ProbeStats {
+  uint32_t calls;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+  uint32_t buckets[BUCKET_COUNT];
+};
+
+static ProbeStats probes[OTA_PROBE_COUNT];
+
+static const char* probeName(int id) {
+  switch (id) {
+    case OTA_PROBE_NET_READ: return "read";
+    case OTA_PROBE_FLASH_WRITE: return "flash";
+    case OTA_PROBE_SHA256: return "sha256";
+  }
+  return "?";
+}
+
+static int bucketIndex(uint32_t value) {
+  if (value < SUB_BUCKETS) return value;
+  int exponent = 31 - __builtin_clz(value); // >= SUB_BITS
+  int sub = (value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+  return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// Largest value that falls into `index`
+static uint32_t bucketUpperBound(int index) {
+  if (index < SUB_BUCKETS) return index;
+  int exponent = index / SUB_BUCKETS + SUB_BITS - 1;
+  uint64_t lower = (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BITS);
+  uint64_t upper = lower + ((uint64_t)1 << (exponent - SUB_BITS)) - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+uint32_t otaProfileCycles() {
+  return ESP.getCycleCount();
+}
+
+void otaProfileRecord(OtaProbeId id, uint32_t cycles) {
+  ProbeStats& probe = probes[id];
+  if (probe.calls == 0 || cycles < probe.minCycles) probe.minCycles = cycles;
+  if (cycles > probe.maxCycles) probe.maxCycles = cycles;
+  probe.calls++;
+  probe.totalCycles += cycles;
+  probe.buckets[bucketIndex(cycles)]++;
+}
+
+void otaProfileReset() {
+  memset(probes, 0, sizeof(probes));
+}
+
+static uint32_t percentile(const ProbeStats& probe, uint32_t perMille) {
+  uint32_t rank = (uint32_t)(((uint64_t)probe.calls * perMille + 999) / 1000);
+  uint32_t seen = 0;
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    seen += probe.buckets[i];
+    if (seen >= rank) return bucketUpperBound(i) < probe.maxCycles ? bucketUpperBound(i) : probe.maxCycles;
+  }
+  return probe.maxCycles;
+}
+
+void otaProfileReport() {
+  uint32_t cyclesPerUs = ESP.getCpuFreqMHz();
+  for (int id = 0; id < OTA_PROBE_COUNT; id++) {
+    const ProbeStats& probe = probes[id];
+    if (probe.calls == 0) continue;
+    uint32_t average = (uint32_t)(probe.totalCycles / probe.calls);
+    OTA_LOGI("probe %-6s calls=%u cycles min=%u avg=%u p99=%u max=%u avg_us=%u total_ms=%u", probeName(id),
+             probe.calls, probe.minCycles, average, percentile(probe, 990), probe.maxCycles, average / cyclesPerUs,
+             (uint32_t)(probe.totalCycles / cyclesPerUs / 1000));
+  }
+}
+
+#else
+
+void otaProfileReset() {}
+void otaProfileReport() {}
+
+#endif
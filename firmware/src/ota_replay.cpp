@@ -0,0 +1,68 @@
+#include "ota_replay.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+#include "ota_log.h"
+
+#define REPLAY_NAMESPACE "ota"
+#define REPLAY_KEY_SEQUENCE "mf_seq"
+#define REPLAY_KEY_TIMESTAMP "mf_ts"
+
+// Any clock before this has not been set by SNTP
+#define CLOCK_VALID_AFTER 1600000000UL
+
+static bool replayLoaded = false;
+static uint32_t acceptedSequence = 0;
+static uint32_t acceptedTimestamp = 0;
+static uint32_t ageUnchecked = 0;
+
+static bool clockValid() { return (unsigned long)time(nullptr) > CLOCK_VALID_AFTER; }
+
+static void loadReplayState() {
+  if (replayLoaded) return;
+  Preferences prefs;
+  if (prefs.begin(REPLAY_NAMESPACE, true)) {
+    acceptedSequence = prefs.getULong(REPLAY_KEY_SEQUENCE, 0);
+    acceptedTimestamp = prefs.getULong(REPLAY_KEY_TIMESTAMP, 0);
+    prefs.end();
+  }
+  replayLoaded = true;
+}
+
+bool otaReplayClockBegin(uint32_t waitMs) {
+  configTime(0, 0, OTA_NTP_SERVER);
+  unsigned long start = millis();
+  while (!clockValid() && millis() - start < waitMs) delay(100);
+  return clockValid();
+}
+
+OtaReplayResult otaReplayCheck(uint32_t sequence, uint32_t timestamp) {
+  loadReplayState();
+  // Equal values are fine: the same manifest is fetched on every poll
+  if (sequence < acceptedSequence) return OTA_REPLAY_OLD_SEQUENCE;
+  if (timestamp < acceptedTimestamp) return OTA_REPLAY_OLD_TIMESTAMP;
+
+  if (!clockValid()) {
+    OTA_LOGW("WARNING: Clock not set; manifest age not checked.");
+    ageUnchecked++;
+    return OTA_REPLAY_OK;
+  }
+  if ((unsigned long)time(nullptr) > timestamp + OTA_MANIFEST_MAX_AGE_S) return OTA_REPLAY_EXPIRED;
+  return OTA_REPLAY_OK;
+}
+
+uint32_t otaReplayAgeUnchecked() { return ageUnchecked; }
+
+void otaReplayAccept(uint32_t sequence, uint32_t timestamp) {
+  loadReplayState();
+  if (sequence == acceptedSequence && timestamp == acceptedTimestamp) return;
+
+  Preferences prefs;
+  if (!prefs.begin(REPLAY_NAMESPACE, false)) return;
+  prefs.putULong(REPLAY_KEY_SEQUENCE, sequence);
+  prefs.putULong(REPLAY_KEY_TIMESTAMP, timestamp);
+  prefs.end();
+  acceptedSequence = sequence;
+  acceptedTimestamp = timestamp;
+}
@@ -0,0 +1,144 @@
+#include "ota_stats.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <stddef.h>
+#include <string.h>
+#include "ota_log.h"
+#include "ota_telemetry.h"
+
+#define STATS_NAMESPACE "ota"
+#define STATS_KEY "stats"
+
+// Bump when the fields before `failures` change. New error codes need no bump.
+#define OTA_STATS_LAYOUT 2
+
+// Fields stored ahead of the failure counts
+#define STATS_HEADER_SIZE offsetof(OtaPersistentStats, failures)
+
+// Longest failure table read back, e.g. one saved by newer firmware
+#define STATS_STORED_ERRORS_MAX 64
+
+// Layout 1 kept the failure counts in the middle; such a blob is still read
+// if it has as many entries as this firmware
+struct StatsLayout1 {
+  uint16_t layout;
+  uint16_t reserved;
+  uint32_t boots;
+  uint32_t checks;
+  uint32_t updatesStarted;
+  uint32_t updatesSucceeded;
+  uint32_t failures[OTA_ERR_COUNT];
+  uint32_t lastThroughput;
+  uint64_t bytesDownloaded;
+  uint32_t flashWrites;
+};
+
+static OtaPersistentStats stats;
+static uint32_t pendingAttempts = 0;
+static unsigned long firstPendingMs = 0;
+static bool dirty = false;
+
+static void markDirty() {
+  if (!dirty) firstPendingMs = millis();
+  dirty = true;
+}
+
+static size_t blobSize(size_t errorCount) {
+  return STATS_HEADER_SIZE + errorCount * sizeof(uint32_t);
+}
+
+static bool loadLayout1(const uint8_t* blob, size_t length) {
+  StatsLayout1 stored;
+  if (length != sizeof(stored)) return false;
+  memcpy(&stored, blob, sizeof(stored));
+  stats.boots = stored.boots;
+  stats.checks = stored.checks;
+  stats.updatesStarted = stored.updatesStarted;
+  stats.updatesSucceeded = stored.updatesSucceeded;
+  stats.lastThroughput = stored.lastThroughput;
+  stats.bytesDownloaded = stored.bytesDownloaded;
+  stats.flashWrites = stored.flashWrites;
+  memcpy(stats.failures, stored.failures, sizeof(stats.failures));
+  return true;
+}
+
+// Fills `stats` from NVS; returns false if nothing usable is stored
+static bool loadStored(Preferences& prefs) {
+  uint8_t blob[STATS_HEADER_SIZE + STATS_STORED_ERRORS_MAX * sizeof(uint32_t)];
+  size_t length = prefs.getBytesLength(STATS_KEY);
+  if (length < STATS_HEADER_SIZE || length > sizeof(blob) || prefs.getBytes(STATS_KEY, blob, length) != length) {
+    return false;
+  }
+  uint16_t layout;
+  memcpy(&layout, blob, sizeof(layout));
+  if (layout == 1) return loadLayout1(blob, length);
+  if (layout != OTA_STATS_LAYOUT) return false;
+
+  memcpy(&stats, blob, STATS_HEADER_SIZE);
+  if (length != blobSize(stats.errorCount)) return false;
+  size_t known = stats.errorCount;
+  if (known > OTA_ERR_COUNT) known = OTA_ERR_COUNT;
+  memcpy(stats.failures, blob + STATS_HEADER_SIZE, known * sizeof(uint32_t));
+  return true;
+}
+
+void otaStatsBegin() {
+  memset(&stats, 0, sizeof(stats));
+  Preferences prefs;
+  if (prefs.begin(STATS_NAMESPACE, true)) {
+    if (!loadStored(prefs)) memset(&stats, 0, sizeof(stats));
+    prefs.end();
+  }
+  stats.layout = OTA_STATS_LAYOUT;
+  stats.errorCount = OTA_ERR_COUNT;
+  stats.boots++;
+  // A boot on its own is not worth a flash write; it goes out with the next batch
+  markDirty();
+  OTA_LOGI("OTA history: boots=%u checks=%u updates=%u/%u bytes=%llu last_throughput=%u", stats.boots,
+           stats.checks, stats.updatesSucceeded, stats.updatesStarted, (unsigned long long)stats.bytesDownloaded,
+           stats.lastThroughput);
+}
+
+void otaStatsRecordAttempt(const OtaAttemptStats& attempt) {
+  const OtaAttemptTiming& timing = attempt.timing;
+  stats.checks++;
+  if (attempt.memory[OTA_PHASE_DOWNLOAD].entered) stats.updatesStarted++;
+  if (attempt.lastError == OTA_OK && attempt.phase == OTA_PHASE_FINALIZE) stats.updatesSucceeded++;
+  if (attempt.lastError > OTA_OK && attempt.lastError < OTA_ERR_COUNT) stats.failures[attempt.lastError]++;
+  stats.bytesDownloaded += timing.bytesReceived;
+  if (timing.downloadUs > 0) {
+    stats.lastThroughput = (uint32_t)((uint64_t)timing.bytesReceived * 1000000 / timing.downloadUs);
+  }
+  pendingAttempts++;
+  markDirty();
+}
+
+void otaStatsPoll() {
+  if (!dirty) return;
+  if (pendingAttempts >= OTA_STATS_FLUSH_ATTEMPTS || millis() - firstPendingMs >= OTA_STATS_FLUSH_INTERVAL_MS) {
+    otaStatsFlush();
+  }
+}
+
+void otaStatsFlush() {
+  if (!dirty) return;
+  Preferences prefs;
+  stats.flashWrites++;
+  size_t length = blobSize(OTA_ERR_COUNT); // without the struct's tail padding
+  bool saved = prefs.begin(STATS_NAMESPACE, false) && prefs.putBytes(STATS_KEY, &stats, length) == length;
+  prefs.end();
+  pendingAttempts = 0;
+  if (saved) {
+    dirty = false;
+  } else {
+    // Retry with the next batch rather than on every loop() pass
+    stats.flashWrites--;
+    firstPendingMs = millis();
+    OTA_LOGW("WARNING: Could not save OTA statistics to NVS.");
+  }
+}
+
+const OtaPersistentStats& otaStats() {
+  return stats;
+}
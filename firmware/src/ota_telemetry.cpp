@@ -0,0 +1,144 @@
+#include "ota_telemetry.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ota_arena.h"
+#include "ota_log.h"
+#include "ota_metrics.h"
+#include "ota_nettrace.h"
+#include "ota_profile.h"
+#include "ota_stats.h"
+#include "ota_tls_pool.h"
+#include "ota_trace.h"
+#include "ota_uplink.h"
+
+OtaAttemptStats otaAttempt;
+
+static void sampleLargestBlock(OtaPhaseMemory& memory) {
+  uint32_t largest = ESP.getMaxAllocHeap();
+  if (largest < memory.minLargestBlock) memory.minLargestBlock = largest;
+}
+
+static void closePhase() {
+  otaTelemetryAddTime(otaAttempt.timing.phaseUs[otaAttempt.phase], otaAttempt.timing.phaseStartUs);
+  OtaPhaseMemory& memory = otaAttempt.memory[otaAttempt.phase];
+  size_t poolPeak = otaTlsPoolPeak();
+  if (poolPeak > memory.tlsPoolPeak) memory.tlsPoolPeak = poolPeak;
+  sampleLargestBlock(memory);
+  memory.minEverFreeHeap = ESP.getMinFreeHeap();
+  // ESP-IDF reports stack in bytes; the mark only ever goes down
+  memory.stackHighWater = uxTaskGetStackHighWaterMark(nullptr);
+}
+
+void otaTelemetryBeginAttempt() {
+  memset(&otaAttempt, 0, sizeof(otaAttempt));
+  otaAttempt.startFreeHeap = ESP.getFreeHeap();
+  otaAttempt.startLargestFreeBlock = ESP.getMaxAllocHeap();
+  otaAttempt.startFreePsram = ESP.getFreePsram();
+  otaAttempt.timing.startUs = micros();
+  otaArenaResetPeak();
+  otaProfileReset();
+  otaTraceReset();
+  OTA_TRACE_STAGE_BEGIN("attempt");
+  otaTelemetryEnterPhase(OTA_PHASE_MANIFEST);
+}
+
+void otaTelemetryEnterPhase(OtaPhase phase) {
+  if (otaAttempt.memory[otaAttempt.phase].entered) {
+    closePhase();
+    OTA_TRACE_STAGE_END(otaPhaseName(otaAttempt.phase));
+  }
+  OTA_TRACE_STAGE_BEGIN(otaPhaseName(phase));
+  otaAttempt.phase = phase;
+  otaAttempt.timing.phaseStartUs = micros();
+  OtaPhaseMemory& memory = otaAttempt.memory[phase];
+  if (!memory.entered) {
+    memory.entered = true;
+    memory.minFreeHeap = UINT32_MAX;
+    memory.minLargestBlock = UINT32_MAX;
+  }
+  otaTlsPoolResetPeak();
+  otaTelemetrySampleHeap();
+  sampleLargestBlock(memory);
+}
+
+void otaTelemetrySampleHeap() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  OtaPhaseMemory& memory = otaAttempt.memory[otaAttempt.phase];
+  if (freeHeap < memory.minFreeHeap) memory.minFreeHeap = freeHeap;
+}
+
+void otaTelemetryAddTime(uint32_t& field, uint32_t startUs) {
+  field += (uint32_t)micros() - startUs;
+}
+
+void otaTelemetryEndAttempt() {
+  closePhase();
+  OTA_TRACE_STAGE_END(otaPhaseName(otaAttempt.phase));
+  OTA_TRACE_STAGE_END("attempt");
+  OtaAttemptTiming& timing = otaAttempt.timing;
+  timing.totalUs = (uint32_t)micros() - timing.startUs;
+  otaMetricsRecordAttempt(otaAttempt);
+  otaStatsRecordAttempt(otaAttempt);
+  otaUplinkRecordAttempt(otaAttempt);
+  // Pinned, so a full ring cannot drop it and it is kept at every log level
+  OTA_LOG_PINNED("ota_timing_us error=%d total=%u dns=%u tcp=%u tls=%u ttfb=%u redirect=%u parse=%u download=%u "
+                 "flash=%u sha=%u verify=%u finalize=%u bytes=%u stalls=%u",
+                 otaAttempt.lastError, timing.totalUs, timing.dnsUs, timing.tcpUs, timing.tlsUs, timing.ttfbUs,
+                 timing.redirectUs, timing.parseUs, timing.downloadUs, timing.flashWriteUs, timing.sha256Us,
+                 timing.verifyUs, timing.finalizeUs, timing.bytesReceived, timing.stalls);
+
+  // A shrinking largest block across checks means the OTA path fragments the heap
+  otaAttempt.endLargestFreeBlock = ESP.getMaxAllocHeap();
+  OTA_LOGI("OTA transport: requests=%u redirects=%u cache_hits=%u connections=%u tls_handshakes=%u",
+           otaAttempt.httpRequests, otaAttempt.redirectHops, otaAttempt.redirectCacheHits,
+           otaAttempt.connections, otaAttempt.tlsHandshakes);
+
+  // Peak heap used per stage, relative to the free heap when the check started
+  OTA_LOGI("OTA memory: start_free=%u start_largest_block=%u largest_free_block=%u min_ever_free=%u "
+           "free_psram=%u download_buffer=%u tls_pool_fallbacks=%u",
+           otaAttempt.startFreeHeap, otaAttempt.startLargestFreeBlock, otaAttempt.endLargestFreeBlock,
+           ESP.getMinFreeHeap(), otaAttempt.startFreePsram, otaAttempt.downloadBufferSize, otaTlsPoolFallbacks());
+  OTA_LOGI("OTA stacks: loop_free_min=%u log_free_min=%u", (unsigned)uxTaskGetStackHighWaterMark(nullptr),
+           otaLogStackHighWater());
+  OTA_LOGI("OTA arena: peak=%u of %u failures=%u", (unsigned)otaArenaPeak(), (unsigned)OTA_ARENA_SIZE,
+           otaArenaFailures());
+  otaProfileReport();
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_INFO
+  for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) {
+    const OtaPhaseMemory& memory = otaAttempt.memory[phase];
+    if (!memory.entered) continue;
+    uint32_t peakUsed = otaAttempt.startFreeHeap > memory.minFreeHeap ? otaAttempt.startFreeHeap - memory.minFreeHeap : 0;
+    OTA_LOGI("  %-9s peak_heap_used=%u min_free=%u min_largest_block=%u min_ever_free=%u stack_free=%u "
+             "tls_pool_peak=%u",
+             otaPhaseName((OtaPhase)phase), peakUsed, memory.minFreeHeap, memory.minLargestBlock,
+             memory.minEverFreeHeap, memory.stackHighWater, memory.tlsPoolPeak);
+  }
+#endif
+#if OTA_TRACE
+  otaLogFlush(); // keep the trace from interleaving with buffered log lines
+  otaTraceFlush();
+#endif
+#if OTA_NET_TRACE
+  // Plain connects time one round trip; a TLS connect takes about three
+  uint32_t rttUs = otaAttempt.tlsHandshakes > 0 ? otaAttempt.timing.tlsUs / (3 * otaAttempt.tlsHandshakes)
+                   : otaAttempt.connections > 0 ? otaAttempt.timing.tcpUs / otaAttempt.connections
+                                                : 0;
+  otaLogFlush();
+  otaNetTraceExport(Serial, rttUs);
+#endif
+}
+
+const char* otaPhaseName(OtaPhase phase) {
+  switch (phase) {
+    case OTA_PHASE_MANIFEST: return "manifest";
+    case OTA_PHASE_DOWNLOAD: return "download";
+    case OTA_PHASE_SIGNATURE: return "signature";
+    case OTA_PHASE_VERIFY: return "verify";
+    case OTA_PHASE_FINALIZE: return "finalize";
+    case OTA_PHASE_COUNT: break;
+  }
+  return "unknown";
+}
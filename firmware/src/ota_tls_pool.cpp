@@ -0,0 +1,116 @@
+#include "ota_tls_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if OTA_LOW_MEMORY_TLS
+#include "freertos/FreeRTOS.h"
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_PLATFORM_MEMORY) || defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+#error "OTA_LOW_MEMORY_TLS needs mbedtls built with MBEDTLS_PLATFORM_MEMORY"
+#endif
+
+// Each block starts with a header; sizes include the header and stay 8-byte aligned
+struct PoolBlock {
+  uint32_t size;
+  uint32_t used;
+};
+
+#define POOL_ALIGN 8
+#define POOL_HEADER sizeof(PoolBlock)
+
+alignas(POOL_ALIGN) static uint8_t pool[OTA_TLS_POOL_SIZE];
+static portMUX_TYPE poolLock = portMUX_INITIALIZER_UNLOCKED;
+static bool poolInstalled = false;
+static size_t poolInUse = 0;
+static size_t poolPeak = 0;
+static uint32_t poolFallbacks = 0;
+
+static PoolBlock* blockAt(size_t offset) {
+  return reinterpret_cast<PoolBlock*>(pool + offset);
+}
+
+static bool inPool(const void* ptr) {
+  return (const uint8_t*)ptr >= pool && (const uint8_t*)ptr < pool + sizeof(pool);
+}
+
+static void* poolCalloc(size_t count, size_t size) {
+  if (count != 0 && size > SIZE_MAX / count) return nullptr;
+  size_t request = count * size;
+  size_t needed = (request + POOL_HEADER + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+
+  void* result = nullptr;
+  portENTER_CRITICAL(&poolLock);
+  // First fit; mbedtls frees mostly in reverse order, so the pool stays compact
+  for (size_t offset = 0; offset < sizeof(pool); offset += blockAt(offset)->size) {
+    PoolBlock* block = blockAt(offset);
+    if (block->used || block->size < needed) continue;
+    if (block->size - needed >= POOL_HEADER + POOL_ALIGN) {
+      PoolBlock* rest = blockAt(offset + needed);
+      rest->size = block->size - needed;
+      rest->used = 0;
+      block->size = needed;
+    }
+    block->used = 1;
+    poolInUse += block->size;
+    if (poolInUse > poolPeak) poolPeak = poolInUse;
+    result = block + 1;
+    break;
+  }
+  if (result == nullptr) poolFallbacks++;
+  portEXIT_CRITICAL(&poolLock);
+
+  if (result == nullptr) return calloc(count, size);
+  memset(result, 0, request);
+  return result;
+}
+
+static void poolFree(void* ptr) {
+  if (ptr == nullptr) return;
+  if (!inPool(ptr)) {
+    free(ptr); // allocated before install, or a heap fallback
+    return;
+  }
+
+  portENTER_CRITICAL(&poolLock);
+  PoolBlock* block = static_cast<PoolBlock*>(ptr) - 1;
+  block->used = 0;
+  poolInUse -= block->size;
+  // Merge runs of free blocks
+  for (size_t offset = 0; offset < sizeof(pool);) {
+    PoolBlock* current = blockAt(offset);
+    size_t next = offset + current->size;
+    if (!current->used && next < sizeof(pool) && !blockAt(next)->used) {
+      current->size += blockAt(next)->size;
+      continue;
+    }
+    offset = next;
+  }
+  portEXIT_CRITICAL(&poolLock);
+}
+
+bool otaTlsPoolInstall() {
+  if (poolInstalled) return true;
+  PoolBlock* first = blockAt(0);
+  first->size = sizeof(pool);
+  first->used = 0;
+  if (mbedtls_platform_set_calloc_free(poolCalloc, poolFree) != 0) return false;
+  poolInstalled = true;
+  return true;
+}
+
+size_t otaTlsPoolInUse() { return poolInUse; }
+size_t otaTlsPoolPeak() { return poolPeak; }
+void otaTlsPoolResetPeak() { poolPeak = poolInUse; }
+uint32_t otaTlsPoolFallbacks() { return poolFallbacks; }
+
+#else
+
+bool otaTlsPoolInstall() { return false; }
+size_t otaTlsPoolInUse() { return 0; }
+size_t otaTlsPoolPeak() { return 0; }
+void otaTlsPoolResetPeak() {}
+uint32_t otaTlsPoolFallbacks() { return 0; }
+
+#endif
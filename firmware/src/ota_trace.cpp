@@ -0,0 +1,236 @@
+#include "ota_trace.h"
+
+#if OTA_TRACE
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static_assert((OTA_TRACE_RING_SIZE & (OTA_TRACE_RING_SIZE - 1)) == 0, "OTA_TRACE_RING_SIZE must be a power of two");
+
+#define TRACE_PHASE_BEGIN 'B'
+#define TRACE_PHASE_END 'E'
+
+struct TraceEvent {
+  uint32_t timestampUs;
+  const char* name;
+  TaskHandle_t task;
+  uint8_t phase; // TRACE_PHASE_BEGIN or TRACE_PHASE_END
+  uint8_t core;
+};
+
+// A stage event remembers how many ring events came before it, which is where
+// it goes when the two are merged
+struct StageEvent {
+  TraceEvent event;
+  uint32_t ringPosition;
+};
+
+static TraceEvent events[OTA_TRACE_RING_SIZE];
+static std::atomic<uint32_t> nextEvent(0);
+static StageEvent stageEvents[OTA_TRACE_STAGE_EVENTS];
+static std::atomic<uint32_t> nextStageEvent(0);
+
+static void fill(TraceEvent& event, const char* name, uint8_t phase) {
+  event.timestampUs = micros();
+  event.name = name;
+  event.task = xTaskGetCurrentTaskHandle();
+  event.phase = phase;
+  event.core = (uint8_t)xPortGetCoreID();
+}
+
+// Slots are claimed with one atomic add, so events from several tasks never
+// share a slot. A slot that is overwritten while being exported only garbles
+// that one event.
+static void record(const char* name, uint8_t phase) {
+  uint32_t index = nextEvent.fetch_add(1, std::memory_order_relaxed) & (OTA_TRACE_RING_SIZE - 1);
+  fill(events[index], name, phase);
+}
+
+static void recordStage(const char* name, uint8_t phase) {
+  uint32_t index = nextStageEvent.fetch_add(1, std::memory_order_relaxed);
+  if (index >= OTA_TRACE_STAGE_EVENTS) return;
+  stageEvents[index].ringPosition = nextEvent.load(std::memory_order_relaxed);
+  fill(stageEvents[index].event, name, phase);
+}
+
+void otaTraceReset() {
+  nextEvent.store(0, std::memory_order_relaxed);
+  nextStageEvent.store(0, std::memory_order_relaxed);
+}
+
+void otaTraceBegin(const char* name) {
+  record(name, TRACE_PHASE_BEGIN);
+}
+
+void otaTraceEnd(const char* name) {
+  record(name, TRACE_PHASE_END);
+}
+
+void otaTraceStageBegin(const char* name) {
+  recordStage(name, TRACE_PHASE_BEGIN);
+}
+
+void otaTraceStageEnd(const char* name) {
+  recordStage(name, TRACE_PHASE_END);
+}
+
+// Walks the stage events and the ring events in [begin, end) in the order
+// they were recorded
+class EventCursor {
+ public:
+  EventCursor(uint32_t begin, uint32_t end) : ringPosition(begin), ringEnd(end), stage(0) {
+    uint32_t recorded = nextStageEvent.load(std::memory_order_relaxed);
+    stageEnd = recorded < OTA_TRACE_STAGE_EVENTS ? recorded : OTA_TRACE_STAGE_EVENTS;
+  }
+
+  const TraceEvent* next() {
+    if (stage < stageEnd && (ringPosition == ringEnd || stageEvents[stage].ringPosition <= ringPosition)) {
+      return &stageEvents[stage++].event;
+    }
+    if (ringPosition < ringEnd) return &events[ringPosition++ & (OTA_TRACE_RING_SIZE - 1)];
+    return nullptr;
+  }
+
+ private:
+  uint32_t ringPosition;
+  uint32_t ringEnd;
+  uint32_t stage;
+  uint32_t stageEnd;
+};
+
+#define TRACE_TASKS_MAX 8
+#define TRACE_DEPTH_MAX 8
+
+// Open spans per task. An end event is kept only if it closes the innermost
+// open span, which drops the ends of chunk spans whose begin was overwritten.
+class SpanStacks {
+ public:
+  bool keep(const TraceEvent& event) {
+    Stack* stack = find(event.task);
+    if (stack == nullptr) return true; // too many tasks to follow
+    if (event.phase == TRACE_PHASE_BEGIN) {
+      if (stack->depth < TRACE_DEPTH_MAX) stack->open[stack->depth] = event.name;
+      stack->depth++;
+      return true;
+    }
+    if (stack->depth == 0) return false;
+    if (stack->depth <= TRACE_DEPTH_MAX && strcmp(stack->open[stack->depth - 1], event.name) != 0) return false;
+    stack->depth--;
+    return true;
+  }
+
+ private:
+  struct Stack {
+    TaskHandle_t task;
+    const char* open[TRACE_DEPTH_MAX];
+    uint32_t depth;
+  };
+
+  Stack* find(TaskHandle_t task) {
+    for (size_t i = 0; i < count; i++) {
+      if (stacks[i].task == task) return &stacks[i];
+    }
+    if (count == TRACE_TASKS_MAX) return nullptr;
+    stacks[count].task = task;
+    stacks[count].depth = 0;
+    return &stacks[count++];
+  }
+
+  Stack stacks[TRACE_TASKS_MAX];
+  size_t count = 0;
+};
+
+// Timestamp of the oldest event that will be exported
+static uint32_t firstTimestamp(uint32_t begin, uint32_t end) {
+  EventCursor cursor(begin, end);
+  const TraceEvent* first = cursor.next();
+  return first == nullptr ? micros() : first->timestampUs;
+}
+
+// Writes the thread names and the events in [begin, end), merged with the stage
+// events, as JSON array entries separated by ",\n". Timestamps are microseconds
+// after the first event, plus `offsetUs`. `separate` says an entry is already
+// written before them.
+static void writeEntries(Print& out, uint32_t begin, uint32_t end, uint64_t offsetUs, bool separate) {
+  uint32_t origin = firstTimestamp(begin, end);
+
+  // One thread_name record per task seen; the loop and log tasks live for good
+  TaskHandle_t named[TRACE_TASKS_MAX];
+  size_t namedCount = 0;
+  EventCursor names(begin, end);
+  for (const TraceEvent* event = names.next(); event != nullptr; event = names.next()) {
+    TaskHandle_t task = event->task;
+    bool seen = false;
+    for (size_t n = 0; n < namedCount; n++) seen = seen || named[n] == task;
+    if (seen || namedCount == TRACE_TASKS_MAX) continue;
+    named[namedCount++] = task;
+    out.printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+               separate ? ",\n" : "", (unsigned)(uintptr_t)task, pcTaskGetTaskName(task));
+    separate = true;
+  }
+
+  SpanStacks spans;
+  EventCursor cursor(begin, end);
+  for (const TraceEvent* next = cursor.next(); next != nullptr; next = cursor.next()) {
+    const TraceEvent& event = *next;
+    if (!spans.keep(event)) continue;
+    out.printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%u,\"args\":{\"core\":%u}}",
+               separate ? ",\n" : "", event.name, event.phase,
+               (unsigned long long)(offsetUs + (uint32_t)(event.timestampUs - origin)), (unsigned)(uintptr_t)event.task,
+               event.core);
+    separate = true;
+  }
+}
+
+// True if the check recorded anything
+static bool hasEvents(uint32_t begin, uint32_t end) {
+  return begin != end || nextStageEvent.load(std::memory_order_relaxed) > 0;
+}
+
+void otaTraceExport(Print& out) {
+  uint32_t end = nextEvent.load(std::memory_order_relaxed);
+  uint32_t begin = end > OTA_TRACE_RING_SIZE ? end - OTA_TRACE_RING_SIZE : 0;
+  if (!hasEvents(begin, end)) return;
+
+  out.println("=== OTA TRACE BEGIN ===");
+  out.print("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":");
+  out.print(begin);
+  out.println("},\"traceEvents\":[");
+  writeEntries(out, begin, end, 0, false);
+  out.println("");
+  out.println("]}");
+  out.println("=== OTA TRACE END ===");
+}
+
+static Print* output = nullptr;
+static bool outputHasEntries = false;
+
+void otaTraceSetOutput(Print* out) {
+  output = out;
+  outputHasEntries = false;
+}
+
+void otaTraceFlush() {
+  if (output == nullptr) {
+    otaTraceExport(Serial);
+    return;
+  }
+  uint32_t end = nextEvent.load(std::memory_order_relaxed);
+  uint32_t begin = end > OTA_TRACE_RING_SIZE ? end - OTA_TRACE_RING_SIZE : 0;
+  if (!hasEvents(begin, end)) return;
+  // micros() wraps every 71 minutes, sooner than checks are apart; millis() places the check
+  uint32_t sinceOriginUs = micros() - firstTimestamp(begin, end);
+  uint64_t nowUs = (uint64_t)millis() * 1000;
+  uint64_t originUs = nowUs > sinceOriginUs ? nowUs - sinceOriginUs : 0;
+  writeEntries(*output, begin, end, originUs, outputHasEntries);
+  output->flush();
+  outputHasEntries = true;
+}
+
+#else
+
+void otaTraceReset() {}
+
+#endif
@@ -0,0 +1,212 @@
+#include "ota_trust.h"
+
+#include <string.h>
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+#include "ota_log.h"
+#include "ota_trust_bundle.h"
+
+static OtaTrustEntry trustTable[OTA_TRUST_TABLE_SIZE];
+static size_t trustCount = 0;
+static OtaTrustEntry trustDefault = {0, "*", OTA_TRUST_BUNDLE, nullptr, nullptr, nullptr, {0}};
+
+static uint32_t hostHash(const char* host) {
+  uint32_t hash = 2166136261u;
+  for (const char* p = host; *p; p++) {
+    hash ^= (uint8_t)tolower(*p);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void applyEntry(WiFiClientSecure& client, const OtaTrustEntry& entry) {
+  switch (entry.mode) {
+    case OTA_TRUST_INSECURE:
+    case OTA_TRUST_SPKI_PIN: // the pin is checked by otaTrustVerifyPeer() instead
+      client.setInsecure();
+      break;
+    case OTA_TRUST_PEM:
+      client.setPreSharedKey(nullptr, nullptr);
+      client.setCACertBundle(nullptr);
+      client.setCACert(entry.pem);
+      break;
+    case OTA_TRUST_BUNDLE:
+      client.setPreSharedKey(nullptr, nullptr);
+      client.setCACert(nullptr); // also clears a previous setInsecure()
+      client.setCACertBundle(OTA_ROOT_CA_BUNDLE);
+      break;
+    case OTA_TRUST_PSK:
+      client.setCACert(nullptr);
+      client.setCACertBundle(nullptr);
+      client.setPreSharedKey(entry.pskIdentity, entry.pskKey);
+      break;
+  }
+}
+
+// Inserts or replaces an entry, keeping the table sorted by host hash.
+static bool storeEntry(const char* host, OtaTrustEntry& entry) {
+  size_t len = strlen(host);
+  if (len >= OTA_TRUST_HOST_MAX) return false;
+  for (size_t i = 0; i < len; i++) entry.host[i] = (char)tolower(host[i]);
+  entry.host[len] = '\0';
+  entry.hostHash = hostHash(host);
+
+  for (size_t i = 0; i < trustCount; i++) {
+    if (trustTable[i].hostHash == entry.hostHash && strcmp(trustTable[i].host, entry.host) == 0) {
+      trustTable[i] = entry;
+      return true;
+    }
+  }
+  if (trustCount == OTA_TRUST_TABLE_SIZE) return false;
+
+  size_t pos = trustCount;
+  while (pos > 0 && trustTable[pos - 1].hostHash > entry.hostHash) {
+    trustTable[pos] = trustTable[pos - 1];
+    pos--;
+  }
+  trustTable[pos] = entry;
+  trustCount++;
+  return true;
+}
+
+void otaTrustSetDefault(OtaTrustMode mode, const char* pem) {
+  trustDefault.mode = mode;
+  trustDefault.pem = pem;
+}
+
+bool otaTrustAddHost(const char* host, OtaTrustMode mode, const char* pem) {
+  OtaTrustEntry entry = {};
+  entry.mode = mode;
+  entry.pem = pem;
+  return storeEntry(host, entry);
+}
+
+bool otaTrustAddPinnedHost(const char* host, const char* spkiSha256Hex) {
+  if (strlen(spkiSha256Hex) != 64) return false;
+  OtaTrustEntry entry = {};
+  entry.mode = OTA_TRUST_SPKI_PIN;
+  for (int i = 0; i < 32; i++) {
+    int high = hexNibble(spkiSha256Hex[2 * i]);
+    int low = hexNibble(spkiSha256Hex[2 * i + 1]);
+    if (high < 0 || low < 0) return false;
+    entry.spkiPin[i] = (uint8_t)(high << 4 | low);
+  }
+  return storeEntry(host, entry);
+}
+
+bool otaTrustAddPskHost(const char* host, const char* identity, const char* keyHex) {
+  OtaTrustEntry entry = {};
+  entry.mode = OTA_TRUST_PSK;
+  entry.pskIdentity = identity;
+  entry.pskKey = keyHex;
+  return storeEntry(host, entry);
+}
+
+const OtaTrustEntry* otaTrustLookup(const char* host) {
+  uint32_t hash = hostHash(host);
+  size_t low = 0;
+  size_t high = trustCount;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (trustTable[mid].hostHash < hash) low = mid + 1;
+    else high = mid;
+  }
+  // Hash collisions are adjacent; confirm the name
+  for (size_t i = low; i < trustCount && trustTable[i].hostHash == hash; i++) {
+    if (strcasecmp(trustTable[i].host, host) == 0) return &trustTable[i];
+  }
+  return &trustDefault;
+}
+
+void otaTrustApply(WiFiClientSecure& client, const char* host) {
+  applyEntry(client, *otaTrustLookup(host));
+}
+
+static bool peerMatchesPin(WiFiClientSecure& client, const uint8_t* pin) {
+  const mbedtls_x509_crt* peer = client.getPeerCertificate();
+  if (peer == nullptr) return false;
+
+  // mbedtls writes the DER at the end of the buffer and returns its length
+  static uint8_t spki[600];
+  int len = mbedtls_pk_write_pubkey_der(const_cast<mbedtls_pk_context*>(&peer->pk), spki, sizeof(spki));
+  if (len <= 0) return false;
+
+  uint8_t digest[32];
+  mbedtls_sha256_ret(spki + sizeof(spki) - len, len, digest, 0);
+  return memcmp(digest, pin, sizeof(digest)) == 0;
+}
+
+bool otaTrustVerifyPeer(WiFiClientSecure& client, const char* host) {
+  const OtaTrustEntry* entry = otaTrustLookup(host);
+  if (entry->mode != OTA_TRUST_SPKI_PIN) return true;
+  if (peerMatchesPin(client, entry->spkiPin)) return true;
+  OTA_LOGE("PROBLEM: Server key for %s does not match the pinned SPKI hash.", host);
+  return false;
+}
+
+const char* otaTrustModeName(OtaTrustMode mode) {
+  switch (mode) {
+    case OTA_TRUST_BUNDLE: return "bundle";
+    case OTA_TRUST_PEM: return "pem";
+    case OTA_TRUST_INSECURE: return "insecure";
+    case OTA_TRUST_SPKI_PIN: return "pin";
+    case OTA_TRUST_PSK: return "psk";
+  }
+  return "unknown";
+}
+
+void otaTrustBenchmark(const char* host, uint16_t port, const char* pem, int rounds) {
+  OtaTrustEntry pemEntry = {};
+  pemEntry.mode = OTA_TRUST_PEM;
+  pemEntry.pem = pem;
+  OtaTrustEntry bundleEntry = {};
+  bundleEntry.mode = OTA_TRUST_BUNDLE;
+  const OtaTrustEntry* hostEntry = otaTrustLookup(host);
+
+  const OtaTrustEntry* cases[3];
+  int caseCount = 0;
+  if (pem != nullptr && strlen(pem) > 0) cases[caseCount++] = &pemEntry;
+  cases[caseCount++] = &bundleEntry;
+  if (hostEntry->mode == OTA_TRUST_SPKI_PIN || hostEntry->mode == OTA_TRUST_PSK) cases[caseCount++] = hostEntry;
+
+  OTA_LOGI("TLS trust benchmark against %s:%u, %d rounds per mode", host, port, rounds);
+  for (int c = 0; c < caseCount; c++) {
+    const OtaTrustEntry& entry = *cases[c];
+    int succeeded = 0;
+    unsigned long totalUs = 0;
+    unsigned long worstUs = 0;
+    uint32_t sessionHeap = 0;
+    for (int round = 0; round < rounds; round++) {
+      WiFiClientSecure client;
+      applyEntry(client, entry);
+      uint32_t freeBefore = ESP.getFreeHeap();
+      unsigned long start = micros();
+      bool connected = client.connect(host, port);
+      if (connected && entry.mode == OTA_TRUST_SPKI_PIN) connected = peerMatchesPin(client, entry.spkiPin);
+      unsigned long elapsed = micros() - start;
+      if (connected) {
+        succeeded++;
+        totalUs += elapsed;
+        if (elapsed > worstUs) worstUs = elapsed;
+        // Heap held by an established session (I/O buffers, peer chain)
+        uint32_t held = freeBefore - ESP.getFreeHeap();
+        if (held > sessionHeap) sessionHeap = held;
+      }
+      client.stop();
+    }
+
+    // The lifetime low-water mark shows the transient peak of the worst handshake so far
+    OTA_LOGI("  %-6s ok=%d/%d avg=%lu ms worst=%lu ms session_heap=%u B min_free_heap=%u B",
+             otaTrustModeName(entry.mode), succeeded, rounds,
+             succeeded ? totalUs / succeeded / 1000 : 0, worstUs / 1000,
+             sessionHeap, ESP.getMinFreeHeap());
+  }
+}
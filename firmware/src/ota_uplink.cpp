@@ -0,0 +1,132 @@
+#include "ota_uplink.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string.h>
+#include <time.h>
+#include "ota_arena.h"
+#include "ota_log.h"
+#include "ota_telemetry.h"
+#include "ota_text.h"
+
+// Any clock before this has not been set by SNTP
+#define CLOCK_VALID_AFTER 1600000000UL
+
+struct UplinkRecord {
+  uint32_t uptimeS;
+  uint32_t unixTime;
+  uint32_t totalMs;
+  uint32_t phaseMs[OTA_PHASE_COUNT];
+  uint32_t downloadMs;
+  uint32_t bytes;
+  uint16_t stalls;
+  uint8_t error;
+  uint8_t flags;
+  unsigned long queuedAt; // millis()
+};
+
+static_assert(OTA_PHASE_COUNT == 5, "record layout carries five stage times");
+
+static UplinkRecord records[OTA_UPLINK_MAX_RECORDS];
+static uint32_t firstRecord = 0; // total records queued before the oldest one held
+static uint32_t recordCount = 0;
+static uint32_t overwritten = 0;
+static uint32_t batchSequence = 0;
+
+void otaUplinkRecordAttempt(const OtaAttemptStats& attempt) {
+  const OtaAttemptTiming& timing = attempt.timing;
+  if (recordCount == OTA_UPLINK_MAX_RECORDS) {
+    firstRecord++;
+    recordCount--;
+    overwritten++;
+  }
+  UplinkRecord& record = records[(firstRecord + recordCount) % OTA_UPLINK_MAX_RECORDS];
+  recordCount++;
+
+  time_t now = time(nullptr);
+  record.uptimeS = millis() / 1000;
+  record.unixTime = (unsigned long)now > CLOCK_VALID_AFTER ? (uint32_t)now : 0;
+  record.totalMs = timing.totalUs / 1000;
+  for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) record.phaseMs[phase] = timing.phaseUs[phase] / 1000;
+  record.downloadMs = timing.downloadUs / 1000;
+  record.bytes = timing.bytesReceived;
+  record.stalls = timing.stalls;
+  record.error = (uint8_t)attempt.lastError;
+  record.flags = 0;
+  if (attempt.memory[OTA_PHASE_DOWNLOAD].entered) record.flags |= OTA_UPLINK_FLAG_DOWNLOAD_STARTED;
+  if (attempt.lastError == 0 && attempt.phase == OTA_PHASE_FINALIZE) record.flags |= OTA_UPLINK_FLAG_UPDATE_SUCCEEDED;
+  record.queuedAt = millis();
+}
+
+bool otaUplinkDue() {
+  if (recordCount == 0) return false;
+  if (recordCount >= OTA_UPLINK_BATCH_RECORDS) return true;
+  return millis() - records[firstRecord % OTA_UPLINK_MAX_RECORDS].queuedAt >= OTA_UPLINK_MAX_DELAY_MS;
+}
+
+static uint8_t* put16(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  return out + 2;
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+  return out + 4;
+}
+
+static size_t encodeBatch(uint8_t* out, uint32_t count, const char* firmwareVersion) {
+  uint8_t* pos = out;
+  memcpy(pos, OTA_UPLINK_MAGIC, 4);
+  pos += 4;
+  *pos++ = OTA_UPLINK_FORMAT_V1;
+  *pos++ = OTA_UPLINK_RECORD_SIZE;
+  pos = put16(pos, (uint16_t)count);
+  pos = put32(pos, batchSequence);
+  pos = put32(pos, overwritten);
+  WiFi.macAddress(pos);
+  pos += 6;
+  pos = put16(pos, 0);
+  memset(pos, 0, OTA_VERSION_MAX);
+  strncpy((char*)pos, firmwareVersion, OTA_VERSION_MAX);
+  pos += OTA_VERSION_MAX;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const UplinkRecord& record = records[(firstRecord + i) % OTA_UPLINK_MAX_RECORDS];
+    pos = put32(pos, record.uptimeS);
+    pos = put32(pos, record.unixTime);
+    pos = put32(pos, record.totalMs);
+    for (int phase = 0; phase < OTA_PHASE_COUNT; phase++) pos = put32(pos, record.phaseMs[phase]);
+    pos = put32(pos, record.downloadMs);
+    pos = put32(pos, record.bytes);
+    pos = put16(pos, record.stalls);
+    *pos++ = record.error;
+    *pos++ = record.flags;
+  }
+  return pos - out;
+}
+
+static_assert(OTA_UPLINK_HEADER_SIZE == 4 + 1 + 1 + 2 + 4 + 4 + 6 + 2 + OTA_VERSION_MAX, "header layout");
+
+int otaUplinkSend(OtaSession& session, const char* collectorUrl, const char* firmwareVersion) {
+  if (recordCount == 0) return HTTP_CODE_OK;
+  OtaArenaScope arenaScope;
+  uint32_t count = recordCount;
+  uint8_t* batch = (uint8_t*)otaArenaAlloc(OTA_UPLINK_HEADER_SIZE + count * OTA_UPLINK_RECORD_SIZE);
+  if (batch == nullptr) return OTA_HTTP_ERROR_OUT_OF_MEMORY;
+  size_t length = encodeBatch(batch, count, firmwareVersion);
+
+  HTTPClient http;
+  http.setTimeout(15000);
+  int httpCode = otaHttpPost(http, session, collectorUrl, batch, length, OTA_UPLINK_CONTENT_TYPE);
+  http.end();
+  if (httpCode >= 200 && httpCode < 300) {
+    firstRecord += count;
+    recordCount -= count;
+    batchSequence++;
+    OTA_LOGI("Telemetry: sent %u records.", (unsigned)count);
+  } else {
+    OTA_LOGW("Telemetry upload failed (HTTP %d); %u records kept.", httpCode, (unsigned)recordCount);
+  }
+  return httpCode;
+}
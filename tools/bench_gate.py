@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""Performance regression gate for the native download benchmark.
+
+Runs the native_bench program and compares its results with the baseline
+committed in firmware/native/bench/baseline.json. The baseline holds two
+suites, each with the bench arguments it was recorded with:
+  pipeline  virtual clock over every link profile: throughput, total and
+            per-stage latency, peak heap. Runs repeat exactly, so one run
+            per configuration is enough and any change is real.
+  cpu       real clock on the lan link with no flash cost, repeated: SHA-256,
+            signature check and manifest parse times. These are noisy and
+            depend on the machine.
+
+A metric regresses when its median moves the wrong way by more than the
+suite's threshold and, for repeated runs, a one-sided Mann-Whitney U test
+finds the shift significant at --alpha. The cpu suite is gated only on the
+machine that recorded it; elsewhere it is reported and not gated.
+
+Exit status: 0 if nothing regressed, 1 if something did or a run failed,
+2 on bad arguments or a missing baseline.
+
+Example:
+    cd firmware && pio run -e native_bench && cd ..
+    python3 tools/bench_gate.py compare
+    python3 tools/bench_gate.py record        # after an intended change
+"""
+
+import argparse
+import datetime
+import json
+import math
+import platform
+import statistics
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+REPO = Path(__file__).resolve().parent.parent
+DEFAULT_PROGRAM = REPO / "firmware" / ".pio" / "build" / "native_bench" / "program"
+DEFAULT_BASELINE = REPO / "firmware" / "native" / "bench" / "baseline.json"
+BASELINE_FORMAT = 1
+
+PHASES = ("manifest", "download", "signature", "verify", "finalize")
+
+SUITES = {
+    "pipeline": {
+        "args": ["--clock", "virtual", "--links", "all", "--flash", "esp32", "--modes", "split,bundle",
+                 "--buffers", "4096,16384", "--image-size", "524288"],
+        "metrics": {"throughput_kBps": "higher", "total_ms": "lower", "download_ms": "lower",
+                    "peak_heap_used": "lower", **{f"phase_ms.{phase}": "lower" for phase in PHASES}},
+        "threshold": 0.05,
+        "machine_bound": False,
+    },
+    "cpu": {
+        "args": ["--clock", "real", "--links", "lan", "--flash", "none", "--modes", "split,bundle",
+                 "--buffers", "16384", "--image-size", "1048576", "--repeat", "10"],
+        "metrics": {"sha256_ms": "lower", "verify_ms": "lower", "parse_ms": "lower"},
+        "threshold": 0.15,
+        "machine_bound": True,
+    },
+}
+
+
+def machine_id() -> str:
+    """CPU model and architecture; CPU timings only compare on the same one."""
+    model = platform.processor() or platform.machine()
+    try:
+        with open("/proc/cpuinfo", encoding="utf-8") as cpuinfo:
+            for line in cpuinfo:
+                if line.startswith("model name"):
+                    model = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    return f"{platform.machine()} {model}"
+
+
+def git_commit() -> str:
+    """Short commit of the tree, with "-dirty" if tracked files other than the
+    baseline differ from it, i.e. the measured code is not that commit."""
+    def git(*args):
+        return subprocess.run(["git", "-C", str(REPO), *args], capture_output=True, text=True,
+                              check=True).stdout.strip()
+    try:
+        commit = git("rev-parse", "--short", "HEAD")
+        baseline = DEFAULT_BASELINE.relative_to(REPO).as_posix()
+        changed = git("status", "--porcelain", "--untracked-files=no", "--", ".", f":(exclude){baseline}")
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+    return f"{commit}-dirty" if changed else commit
+
+
+def metric_value(run: dict, name: str) -> float:
+    value = run
+    for part in name.split("."):
+        value = value[part]
+    return float(value)
+
+
+def run_suite(program: Path, args: list, metrics: dict) -> dict:
+    """Runs the bench; returns {configuration: {metric: [samples]}}. Raises RuntimeError on a failed run."""
+    # A fresh directory each time, so no NVS state carries over between runs
+    with tempfile.TemporaryDirectory(prefix="bench_gate_") as workdir:
+        result = subprocess.run([str(program.resolve()), *args], capture_output=True, text=True, cwd=workdir)
+    runs = [json.loads(line) for line in result.stdout.splitlines() if line.startswith("{")]
+    failed = [run for run in runs if not run["ok"]]
+    if result.returncode != 0 or failed or not runs:
+        detail = ", ".join(f"{run['link']}/{run['mode']}/{run['buffer']}: {run['error']}" for run in failed)
+        raise RuntimeError(f"bench exited with {result.returncode}{': ' + detail if detail else ''}"
+                           f"{result.stderr.strip() and chr(10) + result.stderr.strip()}")
+    samples = {}
+    for run in runs:
+        key = f"{run['link']}/{run['flash']}/{run['mode']}/{run['buffer']}"
+        for name in metrics:
+            samples.setdefault(key, {}).setdefault(name, []).append(metric_value(run, name))
+    return samples
+
+
+def mann_whitney_p(baseline: list, current: list, better: str) -> float:
+    """One-sided p-value that `current` is shifted away from `baseline` in the
+    direction opposite to `better` ("higher" or "lower"); normal approximation
+    with tie and continuity corrections."""
+    n1, n2 = len(baseline), len(current)
+    combined = sorted((value, group) for group, values in enumerate((baseline, current)) for value in values)
+    ranks = [0.0] * len(combined)
+    tie_term = 0.0
+    start = 0
+    while start < len(combined):
+        end = start
+        while end + 1 < len(combined) and combined[end + 1][0] == combined[start][0]:
+            end += 1
+        for i in range(start, end + 1):
+            ranks[i] = (start + end) / 2 + 1
+        ties = end - start + 1
+        tie_term += ties ** 3 - ties
+        start = end + 1
+    rank_sum = sum(rank for rank, (_, group) in zip(ranks, combined) if group == 1)
+    u = rank_sum - n2 * (n2 + 1) / 2  # Large when `current` is higher
+    mean = n1 * n2 / 2
+    n = n1 + n2
+    variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    shift = (mean - u) if better == "higher" else (u - mean)
+    z = (shift - 0.5) / math.sqrt(variance)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def compare_metric(baseline: list, current: list, better: str, threshold: float, alpha: float) -> dict:
+    before, after = statistics.median(baseline), statistics.median(current)
+    entry = {"baseline": before, "current": after}
+    if before == 0:
+        entry["status"] = "ok" if after == 0 else "new"  # Nothing to scale a threshold by
+        return entry
+    change = (after - before) / abs(before)
+    entry["change"] = round(change, 4)
+    worse_by = -change if better == "higher" else change
+    repeated = len(baseline) > 1 and len(current) > 1
+    significant = True
+    if repeated:
+        entry["p"] = mann_whitney_p(baseline, current, better)
+        significant = entry["p"] < alpha
+    if worse_by > threshold and significant:
+        entry["status"] = "regressed"
+    elif -worse_by > threshold and (not repeated or mann_whitney_p(current, baseline, better) < alpha):
+        entry["status"] = "improved"
+    else:
+        entry["status"] = "ok"
+    return entry
+
+
+def record(args, suites: list) -> int:
+    baseline = {"format": BASELINE_FORMAT, "suites": {}}
+    if args.baseline.exists():
+        baseline = json.loads(args.baseline.read_text(encoding="utf-8"))
+    baseline["recorded"] = datetime.datetime.now(datetime.timezone.utc).strftime("%Y-%m-%dT%H:%M:%SZ")
+    baseline["commit"] = git_commit()
+    baseline["machine"] = machine_id()
+    for name in suites:
+        suite = SUITES[name]
+        print(f"recording {name} ...", file=sys.stderr)
+        try:
+            results = run_suite(args.program, suite["args"], suite["metrics"])
+        except RuntimeError as error:
+            print(f"{name}: {error}", file=sys.stderr)
+            return 1
+        baseline["suites"][name] = {"args": suite["args"], "threshold": suite["threshold"], "results": results}
+    args.baseline.write_text(json.dumps(baseline, indent=1, sort_keys=True) + "\n", encoding="utf-8")
+    print(f"wrote {args.baseline} ({', '.join(suites)}) at {baseline['commit']}", file=sys.stderr)
+    return 0
+
+
+def compare(args, suites: list) -> int:
+    if not args.baseline.exists():
+        print(f"no baseline at {args.baseline}; run record first", file=sys.stderr)
+        return 2
+    baseline = json.loads(args.baseline.read_text(encoding="utf-8"))
+    if baseline.get("format") != BASELINE_FORMAT:
+        print(f"{args.baseline}: baseline format {baseline.get('format')}, expected {BASELINE_FORMAT}; record again",
+              file=sys.stderr)
+        return 2
+    same_machine = baseline.get("machine") == machine_id()
+    report = {"baseline_commit": baseline.get("commit"), "commit": git_commit(), "suites": {}}
+    regressions = 0
+    for name in suites:
+        stored = baseline["suites"].get(name)
+        if stored is None:
+            print(f"{name}: not in the baseline; skipped", file=sys.stderr)
+            continue
+        suite = SUITES[name]
+        threshold = args.threshold if args.threshold is not None else stored["threshold"]
+        gated = same_machine or not suite["machine_bound"]
+        if not gated:
+            print(f"{name}: baseline recorded on {baseline.get('machine')}; reported, not gated", file=sys.stderr)
+        try:
+            current = run_suite(args.program, stored["args"], suite["metrics"])
+        except RuntimeError as error:
+            print(f"{name}: {error}", file=sys.stderr)
+            return 1
+        results = {}
+        for key, metrics in sorted(stored["results"].items()):
+            for metric, samples in sorted(metrics.items()):
+                if key not in current or metric not in current[key]:
+                    print(f"{name}: {key} {metric} missing from this run", file=sys.stderr)
+                    regressions += gated
+                    continue
+                entry = compare_metric(samples, current[key][metric], suite["metrics"][metric], threshold, args.alpha)
+                results.setdefault(key, {})[metric] = entry
+                if entry["status"] == "regressed" and gated:
+                    regressions += 1
+                if entry["status"] != "ok" or args.verbose:
+                    change = f"{entry['change']:+.1%}" if "change" in entry else "n/a"
+                    p = f" p={entry['p']:.4f}" if "p" in entry else ""
+                    print(f"{name:<8} {key:<28} {metric:<20} {entry['baseline']:>12.3f} -> "
+                          f"{entry['current']:>12.3f} {change:>8}{p}  {entry['status']}")
+        report["suites"][name] = {"threshold": threshold, "gated": gated, "results": results}
+
+    if args.output:
+        Path(args.output).write_text(json.dumps(report, indent=1) + "\n", encoding="utf-8")
+    print(f"{regressions} regression(s) against {args.baseline.name} from {baseline.get('commit')}", file=sys.stderr)
+    return 1 if regressions else 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("command", choices=("compare", "record"))
+    parser.add_argument("--program", type=Path, default=DEFAULT_PROGRAM, help="native_bench binary")
+    parser.add_argument("--baseline", type=Path, default=DEFAULT_BASELINE)
+    parser.add_argument("--suites", default=",".join(SUITES), help="comma-separated: " + ", ".join(SUITES))
+    parser.add_argument("--threshold", type=float, help="relative change that counts, e.g. 0.05; default per suite")
+    parser.add_argument("--alpha", type=float, default=0.01, help="significance level for repeated runs")
+    parser.add_argument("--output", help="JSON report of every comparison")
+    parser.add_argument("--verbose", action="store_true", help="print unchanged metrics too")
+    args = parser.parse_args()
+
+    suites = [name for name in args.suites.split(",") if name]
+    unknown = [name for name in suites if name not in SUITES]
+    if unknown or not suites:
+        parser.error(f"unknown suite: {', '.join(unknown)}")
+    if not args.program.exists():
+        print(f"no bench program at {args.program}; build it with pio run -e native_bench", file=sys.stderr)
+        return 2
+    return record(args, suites) if args.command == "record" else compare(args, suites)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
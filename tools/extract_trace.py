@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Cut OTA timeline and network traces out of a captured serial log.
+
+Firmware built with -DOTA_TRACE=1 prints one Chrome trace JSON document per
+update check between "=== OTA TRACE BEGIN ===" and "=== OTA TRACE END ===".
+Each document is written to its own file; open it in chrome://tracing or
+https://ui.perfetto.dev.
+
+Firmware built with -DOTA_NET_TRACE=1 prints the byte arrival times of each
+download, base64 encoded, between "=== OTA NETTRACE BEGIN ===" and
+"=== OTA NETTRACE END ===". Each is written to <prefix>_<n>.otnt, the file
+the native_replay program plays back (see include/ota_nettrace.h).
+
+Example:
+    pio device monitor | tee serial.log
+    python3 tools/extract_trace.py serial.log --out-prefix ota_trace
+"""
+
+import argparse
+import base64
+import binascii
+import json
+import struct
+import sys
+
+BEGIN_MARKER = "=== OTA TRACE BEGIN ==="
+END_MARKER = "=== OTA TRACE END ==="
+NET_BEGIN_MARKER = "=== OTA NETTRACE BEGIN ==="
+NET_END_MARKER = "=== OTA NETTRACE END ==="
+
+NET_TRACE_HEADER = struct.Struct("<4sBBHIIII")
+NET_TRACE_TRUNCATED = 0x01
+
+
+def extract(lines):
+    """Yields (kind, text) for every complete trace in `lines`; kind is "timeline" or "net"."""
+    kind = None
+    body = None
+    for line in lines:
+        line = line.rstrip("\r\n")
+        if line.endswith(BEGIN_MARKER):
+            kind, body = "timeline", []
+        elif line.endswith(NET_BEGIN_MARKER):
+            kind, body = "net", []
+        elif line.endswith(END_MARKER) or line.endswith(NET_END_MARKER):
+            if body is not None and line.endswith(END_MARKER if kind == "timeline" else NET_END_MARKER):
+                yield kind, "\n".join(body)
+            body = None
+        elif body is not None:
+            body.append(line)
+
+
+def describe_net_trace(data):
+    """Returns a one-line summary of a network trace, or raises ValueError."""
+    if len(data) < NET_TRACE_HEADER.size:
+        raise ValueError("shorter than the header")
+    magic, version, flags, _, image_length, recorded, rtt_us, records = NET_TRACE_HEADER.unpack_from(data)
+    if magic != b"OTNT" or version != 1:
+        raise ValueError("not a version 1 network trace")
+    elapsed_us = 0
+    value = shift = 0
+    fields = 0
+    for byte in data[NET_TRACE_HEADER.size:]:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte & 0x80:
+            continue
+        if fields % 2 == 0:
+            elapsed_us += value
+        fields += 1
+        value = shift = 0
+    if fields != 2 * records:
+        raise ValueError(f"{fields // 2} records decoded, header says {records}")
+    note = " (buffer filled; the rest was not recorded)" if flags & NET_TRACE_TRUNCATED else ""
+    return (f"{records} reads, {recorded} of {image_length} bytes over {elapsed_us / 1000:.1f} ms, "
+            f"rtt {rtt_us / 1000:.1f} ms{note}")
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="serial log file, or - for stdin")
+    parser.add_argument("--out-prefix", default="ota_trace", help="output files are <prefix>_<n>.json or .otnt")
+    args = parser.parse_args()
+
+    source = sys.stdin if args.log == "-" else open(args.log, encoding="utf-8", errors="replace")
+    count = 0
+    with source:
+        for kind, text in extract(source):
+            if kind == "net":
+                try:
+                    data = base64.b64decode("".join(text.split()), validate=True)
+                    summary = describe_net_trace(data)
+                except (binascii.Error, ValueError) as error:
+                    print(f"skipping network trace {count + 1}: {error}", file=sys.stderr)
+                    continue
+                count += 1
+                path = f"{args.out_prefix}_{count}.otnt"
+                with open(path, "wb") as out:
+                    out.write(data)
+                print(f"wrote {path}: {summary}")
+                continue
+            try:
+                trace = json.loads(text)
+            except json.JSONDecodeError as error:
+                print(f"skipping trace {count + 1}: {error}", file=sys.stderr)
+                continue
+            count += 1
+            path = f"{args.out_prefix}_{count}.json"
+            with open(path, "w", encoding="utf-8") as out:
+                json.dump(trace, out)
+            dropped = trace.get("otherData", {}).get("dropped", 0)
+            note = f" ({dropped} oldest events overwritten)" if dropped else ""
+            print(f"wrote {path}: {len(trace['traceEvents'])} events{note}")
+
+    if count == 0:
+        print("no complete trace found", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
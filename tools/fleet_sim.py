@@ -0,0 +1,505 @@
+#!/usr/bin/env python3
+"""Fleet simulator for sizing the manifest and artifact servers.
+
+Plays 10k-100k devices polling for updates the way the firmware does, and
+sends their requests to a real server (tools/ota_server.py, a mirror or a CDN
+test endpoint). Simulated time runs --speed times faster than real time.
+
+Each device follows the firmware's schedule: one check at boot, then one every
+--interval seconds from boot. Every check fetches the manifest (and its .sig
+with --signed-manifest). When the manifest names a newer version and the
+rollout admits the device, it downloads the artifacts, reboots and checks
+again. A failed check waits for the next interval. Options change that policy
+to compare alternatives:
+  --jitter        spread each wait by up to +/- that fraction of the interval
+  --retry-base    retry failures after base * 2^n seconds, up to the interval
+  --conditional   send If-None-Match / If-Modified-Since for the manifest
+  --rollout       admit a growing share of devices, e.g. 0:5,2h:25,12h:100
+  --boot-spread   boot the fleet over this many seconds; 0 = a power cut
+
+Every --bucket seconds of simulated time, it writes one JSON line with:
+  - checks, requests, mean and peak (1 s) request rate, 304s, downloads and
+    failures
+  - egress bytes and Mbit/s
+  - peak_sessions: devices with a connection open at the same time, each
+    session lasting as long as it would over --link-kbps and --rtt-ms
+  - peak_inflight: connections actually open to the server, live runs only
+A summary line follows.
+
+--dry-run fetches each distinct response from the server once and replays it,
+without pacing. Use it for 100k devices over days; a live run that cannot
+keep up reports its lag in the summary.
+
+Example:
+    python3 tools/ota_server.py --root release/ --port 8080 --quiet &
+    python3 tools/fleet_sim.py --server http://127.0.0.1:8080 --devices 20000 \\
+        --duration 6h --speed 120 --conditional --output fleet.jsonl
+"""
+
+import argparse
+import asyncio
+import heapq
+import json
+import math
+import random
+import ssl
+import sys
+import time
+import urllib.parse
+from array import array
+from collections import Counter
+
+MAX_REDIRECTS = 5
+READ_BLOCK = 64 * 1024
+REBOOT_S = 5.0             # From ESP.restart() to the boot check
+CONNECT_ROUND_TRIPS = 3    # TCP handshake plus a full TLS 1.2 handshake
+REQUEST_TIMEOUT_S = 30.0
+
+
+def parse_duration(text: str) -> float:
+    """Seconds from "90", "15m", "6h" or "2d"."""
+    units = {"s": 1, "m": 60, "h": 3600, "d": 86400}
+    if text and text[-1] in units:
+        return float(text[:-1]) * units[text[-1]]
+    return float(text)
+
+
+def parse_rollout(text: str):
+    """[(start_s, percent)] sorted by time, from "0:5,2h:25,12h:100"."""
+    stages = []
+    for item in text.split(","):
+        at, _, percent = item.partition(":")
+        stages.append((parse_duration(at), float(percent)))
+    stages.sort()
+    if not stages or stages[0][0] > 0:
+        stages.insert(0, (0.0, 0.0))
+    return stages
+
+
+def rollout_percent(stages, now: float) -> float:
+    percent = 0.0
+    for start, value in stages:
+        if start <= now:
+            percent = value
+    return percent
+
+
+def compare_versions(left: str, right: str) -> int:
+    """compareVersionStrings() in fimware.cpp: dotted numbers, missing parts are 0."""
+    a = [int(p) if p.isdigit() else 0 for p in left.lstrip("v").split(".")]
+    b = [int(p) if p.isdigit() else 0 for p in right.lstrip("v").split(".")]
+    width = max(len(a), len(b))
+    a += [0] * (width - len(a))
+    b += [0] * (width - len(b))
+    return (a > b) - (a < b)
+
+
+class Response:
+    __slots__ = ("status", "headers", "wire_bytes", "body")
+
+    def __init__(self, status, headers, wire_bytes, body=b""):
+        self.status = status
+        self.headers = headers
+        self.wire_bytes = wire_bytes
+        self.body = body
+
+
+class Connection:
+    """One HTTP/1.1 keep-alive connection to the server."""
+
+    def __init__(self, host, port, context):
+        self.host = host
+        self.port = port
+        self.context = context
+        self.reader = None
+        self.writer = None
+
+    async def request(self, path: str, headers: dict, keep_body: bool) -> Response:
+        if self.writer is None:
+            self.reader, self.writer = await asyncio.open_connection(self.host, self.port, ssl=self.context)
+        lines = [f"GET {path} HTTP/1.1", f"Host: {self.host}", "User-Agent: ESP32-OTA-fleet-sim"]
+        lines += [f"{name}: {value}" for name, value in headers.items()]
+        self.writer.write(("\r\n".join(lines) + "\r\n\r\n").encode())
+        head = await self.reader.readuntil(b"\r\n\r\n")
+        status_line, *header_lines = head.decode("latin-1").split("\r\n")
+        status = int(status_line.split()[1])
+        fields = {}
+        for line in header_lines:
+            name, _, value = line.partition(":")
+            if name:
+                fields[name.strip().lower()] = value.strip()
+        wire = len(head)
+        body = bytearray()
+        if status not in (204, 304) and fields.get("transfer-encoding", "").lower() == "chunked":
+            while True:
+                size_line = await self.reader.readuntil(b"\r\n")
+                size = int(size_line.split(b";")[0], 16)
+                chunk = await self.reader.readexactly(size + 2)
+                wire += len(size_line) + len(chunk)
+                if keep_body:
+                    body += chunk[:-2]
+                if size == 0:  # No trailers: the last chunk ends the body
+                    break
+        elif status not in (204, 304):
+            remaining = int(fields.get("content-length", "0"))
+            while remaining > 0:
+                chunk = await self.reader.readexactly(min(remaining, READ_BLOCK))
+                remaining -= len(chunk)
+                wire += len(chunk)
+                if keep_body:
+                    body += chunk
+        if fields.get("connection", "").lower() == "close":
+            self.close()
+        return Response(status, fields, wire, bytes(body))
+
+    def close(self):
+        if self.writer is not None:
+            self.writer.close()
+            self.writer = None
+
+
+class LiveTransport:
+    """Sends every request to the server."""
+
+    def __init__(self, base: str):
+        url = urllib.parse.urlsplit(base)
+        self.host = url.hostname
+        self.port = url.port or (443 if url.scheme == "https" else 80)
+        self.context = None
+        if url.scheme == "https":
+            self.context = ssl.create_default_context()
+            self.context.check_hostname = False
+            self.context.verify_mode = ssl.CERT_NONE
+        self.inflight = 0
+        self.peak_inflight = 0
+
+    def open(self):
+        self.inflight += 1
+        self.peak_inflight = max(self.peak_inflight, self.inflight)
+        return Connection(self.host, self.port, self.context)
+
+    def release(self, connection):
+        connection.close()
+        self.inflight -= 1
+
+    async def get(self, connection, path, headers, keep_body):
+        return await asyncio.wait_for(connection.request(path, headers, keep_body), REQUEST_TIMEOUT_S)
+
+
+class ReplayTransport(LiveTransport):
+    """Fetches each distinct (path, validators) response once and replays it."""
+
+    def __init__(self, base: str):
+        super().__init__(base)
+        self.snapshots = {}
+
+    def open(self):
+        return None
+
+    def release(self, connection):
+        pass
+
+    async def get(self, connection, path, headers, keep_body):
+        key = (path, tuple(sorted(headers.items())))
+        if key not in self.snapshots:
+            live = Connection(self.host, self.port, self.context)
+            try:
+                self.snapshots[key] = await asyncio.wait_for(live.request(path, headers, True), REQUEST_TIMEOUT_S)
+            finally:
+                live.close()
+        return self.snapshots[key]
+
+
+class Bucket:
+    __slots__ = ("checks", "requests", "not_modified", "downloads", "failures", "egress", "peak_inflight")
+
+    def __init__(self):
+        self.checks = self.requests = self.not_modified = self.downloads = self.failures = 0
+        self.egress = 0
+        self.peak_inflight = 0
+
+
+class Fleet:
+    def __init__(self, args, transport):
+        self.args = args
+        self.transport = transport
+        self.random = random.Random(args.seed)
+        self.stages = parse_rollout(args.rollout)
+        self.buckets = {}
+        self.per_second = Counter()  # Requests by simulated second
+        self.session_starts = array("d")
+        self.session_ends = array("d")
+        self.versions = [args.current_version] * args.devices
+        self.validators = [None] * args.devices      # (etag, last_modified) of the last manifest
+        self.manifests = [None] * args.devices       # Its parsed body, reused on 304
+        self.failures = [0] * args.devices
+        self.cohorts = [(i * 2654435761) % 10000 / 100.0 for i in range(args.devices)]
+        self.installed_at = []
+        self.new_version = None
+        self.lag = 0.0
+
+    def bucket(self, now: float) -> Bucket:
+        index = int(now // self.args.bucket)
+        if index not in self.buckets:
+            self.buckets[index] = Bucket()
+        return self.buckets[index]
+
+    def wait(self, base: float) -> float:
+        spread = self.args.jitter * base
+        return base + (self.random.uniform(-spread, spread) if spread else 0.0)
+
+    def next_check(self, device: int, now: float, ok: bool, boot: float) -> float:
+        args = self.args
+        if ok:
+            self.failures[device] = 0
+        else:
+            self.failures[device] += 1
+            if args.retry_base > 0:
+                return now + min(self.wait(args.retry_base * 2 ** (self.failures[device] - 1)), args.interval)
+        if args.jitter:
+            return now + self.wait(args.interval)
+        # The firmware's timer runs from boot: previousMillisUpdate = millis()
+        return boot + (math.floor((now - boot) / args.interval + 1e-6) + 1) * args.interval
+
+    async def fetch(self, connection, path, headers, stats, keep_body=False):
+        """GET with redirects; returns the final response and the modelled seconds it took."""
+        seconds = 0.0
+        for _ in range(MAX_REDIRECTS + 1):
+            response = await self.transport.get(connection, path, headers, keep_body)
+            stats.requests += 1
+            stats.egress += response.wire_bytes
+            seconds += self.args.rtt_ms / 1000.0 + response.wire_bytes * 8 / (self.args.link_kbps * 1000.0)
+            location = response.headers.get("location")
+            if response.status not in (301, 302, 307, 308) or not location:
+                return response, seconds
+            target = urllib.parse.urlsplit(location)
+            path = (target.path or "/") + ("?" + target.query if target.query else "")
+            headers = {}
+            seconds += CONNECT_ROUND_TRIPS * self.args.rtt_ms / 1000.0  # The CDN is another host
+        return response, seconds
+
+    async def check(self, device: int, now: float, boot: float, heap):
+        args = self.args
+        stats = self.bucket(now)
+        stats.checks += 1
+        requests_before = stats.requests
+        seconds = CONNECT_ROUND_TRIPS * args.rtt_ms / 1000.0
+        connection = self.transport.open()
+        stats.peak_inflight = max(stats.peak_inflight, getattr(self.transport, "inflight", 0))
+        ok = False
+        installed = False
+        try:
+            headers = {}
+            if args.conditional and self.validators[device]:
+                etag, modified = self.validators[device]
+                if etag:
+                    headers["If-None-Match"] = etag
+                if modified:
+                    headers["If-Modified-Since"] = modified
+            response, spent = await self.fetch(connection, args.manifest_path, headers, stats, keep_body=True)
+            seconds += spent
+            if response.status == 304 and self.manifests[device] is not None:
+                stats.not_modified += 1
+                manifest = self.manifests[device]
+            elif response.status == 200:
+                manifest = json.loads(response.body)
+                self.manifests[device] = manifest
+                self.validators[device] = (response.headers.get("etag"), response.headers.get("last-modified"))
+            else:
+                raise OSError(f"manifest: HTTP {response.status}")
+            if args.signed_manifest:
+                response, spent = await self.fetch(connection, args.manifest_path + ".sig", {}, stats)
+                seconds += spent
+                if response.status != 200:
+                    raise OSError(f"manifest signature: HTTP {response.status}")
+
+            version = str(manifest.get("version", ""))
+            admitted = self.cohorts[device] < rollout_percent(self.stages, now)
+            if compare_versions(version, self.versions[device]) > 0 and admitted:
+                self.new_version = version
+                urls = [manifest["bundle_url"]] if manifest.get("bundle_url") else \
+                    [manifest["file_url"], manifest["signature_url"]]
+                for url in urls:
+                    target = urllib.parse.urlsplit(url)
+                    path = target.path + ("?" + target.query if target.query else "")
+                    response, spent = await self.fetch(connection, path, {}, stats)
+                    seconds += spent
+                    if response.status != 200:
+                        raise OSError(f"artifact: HTTP {response.status}")
+                stats.downloads += 1
+                self.versions[device] = version
+                self.installed_at.append(now + seconds)
+                installed = True
+            ok = True
+        except (OSError, ValueError, KeyError, asyncio.IncompleteReadError, asyncio.TimeoutError):
+            stats.failures += 1
+        finally:
+            self.transport.release(connection)
+        self.per_second[int(now)] += stats.requests - requests_before
+
+        self.session_starts.append(now)
+        self.session_ends.append(now + seconds)
+        if installed:
+            reboot = now + seconds + REBOOT_S
+            heapq.heappush(heap, (reboot, device, reboot))
+        else:
+            heapq.heappush(heap, (self.next_check(device, now, ok, boot), device, boot))
+
+    async def run(self):
+        args = self.args
+        heap = []
+        for device in range(args.devices):
+            boot = self.random.uniform(0, args.boot_spread) if args.boot_spread else 0.0
+            heap.append((boot, device, boot))
+        heapq.heapify(heap)
+        limit = asyncio.Semaphore(args.max_inflight)
+        pending = set()
+        started = time.monotonic()
+
+        async def guarded(device, now, boot):
+            try:
+                await self.check(device, now, boot, heap)
+            finally:
+                limit.release()
+
+        while heap or pending:
+            if not heap:
+                await asyncio.wait(pending, return_when=asyncio.FIRST_COMPLETED)
+                continue
+            now, device, boot = heap[0]
+            if now >= args.duration:
+                if not pending:
+                    break
+                await asyncio.wait(pending, return_when=asyncio.FIRST_COMPLETED)
+                continue
+            if args.dry_run:
+                heapq.heappop(heap)
+                await self.check(device, now, boot, heap)
+                continue
+            delay = started + now / args.speed - time.monotonic()
+            if delay > 0:
+                # Completed checks may push earlier wake-ups (reboots)
+                if pending:
+                    await asyncio.wait(pending, timeout=delay, return_when=asyncio.FIRST_COMPLETED)
+                else:
+                    await asyncio.sleep(delay)
+                continue
+            self.lag = max(self.lag, -delay * args.speed)
+            heapq.heappop(heap)
+            await limit.acquire()
+            task = asyncio.ensure_future(guarded(device, now, boot))
+            pending.add(task)
+            task.add_done_callback(pending.discard)
+
+    def peak_sessions(self):
+        """Peak of overlapping modelled sessions, per bucket."""
+        events = sorted([(t, 1) for t in self.session_starts] + [(t, -1) for t in self.session_ends],
+                        key=lambda event: (event[0], event[1]))
+        peaks = {}
+        open_sessions = 0
+        for at, step in events:
+            open_sessions += step
+            index = int(at // self.args.bucket)
+            if open_sessions > peaks.get(index, 0):
+                peaks[index] = open_sessions
+        return peaks
+
+    def report(self, out):
+        args = self.args
+        peaks = self.peak_sessions()
+        second_peaks = {}
+        for second, count in self.per_second.items():
+            index = int(second // args.bucket)
+            second_peaks[index] = max(second_peaks.get(index, 0), count)
+        totals = Bucket()
+        peak_rate = 0
+        peak_mbps = 0.0
+        peak_sessions = 0
+        for index in range(int(args.duration // args.bucket) + (args.duration % args.bucket > 0)):
+            b = self.buckets.get(index, Bucket())
+            rate = b.requests / args.bucket
+            mbps = b.egress * 8 / args.bucket / 1e6
+            row = {"t_s": index * args.bucket, "checks": b.checks, "requests": b.requests,
+                   "requests_per_s": round(rate, 2), "peak_requests_per_s": second_peaks.get(index, 0),
+                   "not_modified": b.not_modified, "downloads": b.downloads,
+                   "failures": b.failures, "egress_bytes": b.egress, "egress_mbps": round(mbps, 3),
+                   "peak_sessions": peaks.get(index, 0)}
+            if not args.dry_run:
+                row["peak_inflight"] = b.peak_inflight
+            out.write(json.dumps(row) + "\n")
+            for field in ("checks", "requests", "not_modified", "downloads", "failures", "egress"):
+                setattr(totals, field, getattr(totals, field) + getattr(b, field))
+            peak_rate = max(peak_rate, second_peaks.get(index, 0))
+            peak_mbps = max(peak_mbps, mbps)
+            peak_sessions = max(peak_sessions, peaks.get(index, 0))
+
+        installed = sorted(self.installed_at)
+        summary = {"summary": True, "devices": args.devices, "duration_s": args.duration,
+                   "checks": totals.checks, "requests": totals.requests, "not_modified": totals.not_modified,
+                   "downloads": totals.downloads, "failures": totals.failures, "egress_bytes": totals.egress,
+                   "peak_requests_per_s": peak_rate, "peak_egress_mbps": round(peak_mbps, 3),
+                   "peak_sessions": peak_sessions, "new_version": self.new_version, "updated": len(installed)}
+        for share in (50, 95):
+            needed = (args.devices * share + 99) // 100
+            summary[f"t{share}_updated_s"] = round(installed[needed - 1], 1) if len(installed) >= needed else None
+        if not args.dry_run:
+            summary["peak_inflight"] = self.transport.peak_inflight
+            summary["lag_s"] = round(self.lag, 1)
+        out.write(json.dumps(summary) + "\n")
+        return summary
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--server", required=True, help="base URL every request goes to, e.g. http://127.0.0.1:8080")
+    parser.add_argument("--manifest-path", default="/manifest.json")
+    parser.add_argument("--signed-manifest", action="store_true", help="also fetch MANIFEST.sig on every check")
+    parser.add_argument("--devices", type=int, default=10000)
+    parser.add_argument("--current-version", default="1.0", help="version the fleet runs at boot")
+    parser.add_argument("--duration", type=parse_duration, default=parse_duration("24h"),
+                        help="simulated time: seconds or 15m / 6h / 2d")
+    parser.add_argument("--interval", type=parse_duration, default=3600.0, help="UPDATE_CHECK_INTERVAL")
+    parser.add_argument("--jitter", type=float, default=0.0, help="fraction, e.g. 0.1 for +/- 10%%")
+    parser.add_argument("--retry-base", type=parse_duration, default=0.0,
+                        help="first retry after a failure; 0 waits for the next interval like the firmware")
+    parser.add_argument("--conditional", action="store_true", help="conditional GET of the manifest")
+    parser.add_argument("--rollout", default="0:100", metavar="AT:PERCENT,...",
+                        help="share of devices admitted to the new version over time")
+    parser.add_argument("--boot-spread", type=parse_duration, default=None,
+                        help="boot times spread over this long; default one interval, 0 = all at once")
+    parser.add_argument("--link-kbps", type=float, default=1000.0, help="device link for session lengths")
+    parser.add_argument("--rtt-ms", type=float, default=100.0, help="device round trip for session lengths")
+    parser.add_argument("--speed", type=float, default=60.0, help="simulated seconds per real second")
+    parser.add_argument("--dry-run", action="store_true", help="replay one fetch per distinct response, no pacing")
+    parser.add_argument("--max-inflight", type=int, default=1000, help="open connections at most, live runs")
+    parser.add_argument("--bucket", type=parse_duration, default=300.0, help="simulated seconds per report line")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--output", help="JSON Lines file; default stdout")
+    args = parser.parse_args()
+    if args.boot_spread is None:
+        args.boot_spread = args.interval
+    if args.devices <= 0 or args.interval <= 0 or args.bucket <= 0 or args.speed <= 0 or args.duration <= 0:
+        parser.error("--devices, --interval, --bucket, --speed and --duration must be positive")
+    try:
+        parse_rollout(args.rollout)
+    except ValueError:
+        parser.error(f"bad --rollout: {args.rollout}")
+
+    transport = ReplayTransport(args.server) if args.dry_run else LiveTransport(args.server)
+    fleet = Fleet(args, transport)
+    try:
+        asyncio.run(fleet.run())
+    except KeyboardInterrupt:
+        pass
+    out = open(args.output, "w") if args.output else sys.stdout
+    summary = fleet.report(out)
+    if out is not sys.stdout:
+        out.close()
+    print(f"{summary['requests']} requests, peak {summary['peak_requests_per_s']}/s, "
+          f"{summary['egress_bytes'] / 1e6:.1f} MB egress, peak {summary['peak_sessions']} sessions",
+          file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Generate the compact CA bundle compiled into the firmware.
+
+Reads PEM root certificates and writes a C header holding them in the
+x509 certificate bundle format understood by WiFiClientSecure::setCACertBundle():
+
+    [ count:2 BE ] then per certificate, sorted by raw subject DER:
+    [ subject_len:2 BE ][ key_len:2 BE ][ subject DER ][ SubjectPublicKeyInfo DER ]
+
+During the handshake the TLS layer binary-searches this table by the issuer
+of the server's chain and checks one signature against the stored key, so
+no PEM is parsed per connection.
+
+Example:
+    python3 tools/gen_trust_bundle.py certs/*.pem -o firmware/include/ota_trust_bundle.h
+"""
+
+import argparse
+import base64
+import re
+import struct
+import sys
+
+PEM_RE = re.compile(rb"-----BEGIN CERTIFICATE-----(.+?)-----END CERTIFICATE-----", re.S)
+
+
+def read_tlv(data: bytes, offset: int):
+    """Returns (tag, header_len, value_len) of the DER element at offset."""
+    tag = data[offset]
+    length = data[offset + 1]
+    header = 2
+    if length & 0x80:
+        count = length & 0x7F
+        length = int.from_bytes(data[offset + 2 : offset + 2 + count], "big")
+        header += count
+    return tag, header, length
+
+
+def subject_and_spki(der: bytes):
+    # Certificate ::= SEQUENCE { tbsCertificate, signatureAlgorithm, signature }
+    _, cert_hdr, _ = read_tlv(der, 0)
+    tbs = cert_hdr
+    _, tbs_hdr, _ = read_tlv(der, tbs)
+    pos = tbs + tbs_hdr
+
+    fields = []
+    while len(fields) < 7:
+        tag, hdr, length = read_tlv(der, pos)
+        if not fields and tag != 0xA0:
+            fields.append(None)  # v1 certificate without explicit version
+        fields.append(der[pos : pos + hdr + length])
+        pos += hdr + length
+
+    # version, serial, signature, issuer, validity, subject, subjectPublicKeyInfo
+    return fields[5], fields[6]
+
+
+def load_certificates(paths):
+    certs = []
+    for path in paths:
+        with open(path, "rb") as f:
+            for match in PEM_RE.finditer(f.read()):
+                der = base64.b64decode(b"".join(match.group(1).split()))
+                subject, spki = subject_and_spki(der)
+                certs.append((subject, spki, path))
+    return certs
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("pem", nargs="+", help="PEM files with root certificates")
+    parser.add_argument("-o", "--out", default="firmware/include/ota_trust_bundle.h")
+    args = parser.parse_args()
+
+    certs = sorted(load_certificates(args.pem), key=lambda c: c[0])
+    if not certs:
+        print("error: no certificates found", file=sys.stderr)
+        return 1
+
+    bundle = struct.pack(">H", len(certs))
+    for subject, spki, _ in certs:
+        bundle += struct.pack(">HH", len(subject), len(spki)) + subject + spki
+
+    lines = [
+        "#pragma once",
+        "",
+        "// Generated by tools/gen_trust_bundle.py. Do not edit.",
+        "// Roots:",
+    ]
+    lines += [f"//   {path.split('/')[-1]}" for _, _, path in certs]
+    lines += ["", "#include <stdint.h>", "", "static const uint8_t OTA_ROOT_CA_BUNDLE[] = {"]
+    for i in range(0, len(bundle), 16):
+        lines.append("  " + " ".join(f"0x{b:02x}," for b in bundle[i : i + 16]))
+    lines += ["};", ""]
+
+    with open(args.out, "w") as f:
+        f.write("\n".join(lines))
+
+    print(f"Wrote {args.out}: {len(certs)} roots, {len(bundle)} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Pack a signed OTA update bundle from the release artifacts.
+
+The bundle layout is described in firmware/include/ota_bundle.h:
+
+    [ 80-byte header ][ signature ][ firmware image ]
+
+The signature covers the SHA-256 of the header, which carries the SHA-256 of
+the image. Signing is delegated to the `openssl` CLI so the same private key
+used for `signature.bin` can be reused.
+
+Example:
+    python3 tools/make_bundle.py --firmware firmware.bin --key private.pem \\
+        --version v1.3 --out firmware.bundle
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+MAGIC = b"OTAB"
+FORMAT_V1 = 1
+HASH_SHA256 = 1
+COMPRESSION = {"none": 0}
+HEADER_SIZE = 80
+VERSION_LEN = 32
+MAX_SIG_LEN = 512
+
+
+def build_header(image: bytes, version: str, sig_len: int, compression: int) -> bytes:
+    encoded_version = version.encode("ascii")
+    if not encoded_version or len(encoded_version) > VERSION_LEN:
+        raise ValueError(f"version must be 1..{VERSION_LEN} ASCII characters")
+    header = struct.pack(
+        "<4sBBBBIHH32s32s",
+        MAGIC,
+        FORMAT_V1,
+        HASH_SHA256,
+        compression,
+        0,
+        len(image),
+        sig_len,
+        0,
+        encoded_version.ljust(VERSION_LEN, b"\0"),
+        hashlib.sha256(image).digest(),
+    )
+    assert len(header) == HEADER_SIZE
+    return header
+
+
+def sign(data: bytes, key_path: str) -> bytes:
+    with tempfile.TemporaryDirectory() as tmp:
+        data_path = os.path.join(tmp, "header.bin")
+        sig_path = os.path.join(tmp, "header.sig")
+        with open(data_path, "wb") as f:
+            f.write(data)
+        subprocess.run(
+            ["openssl", "dgst", "-sha256", "-sign", key_path, "-out", sig_path, data_path],
+            check=True,
+        )
+        with open(sig_path, "rb") as f:
+            return f.read()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--firmware", required=True, help="compiled firmware.bin")
+    parser.add_argument("--key", required=True, help="PEM private key matching PUBLIC_KEY in config.h")
+    parser.add_argument("--version", required=True, help="release version, e.g. v1.3 or 1.3")
+    parser.add_argument("--out", default="firmware.bundle", help="output bundle path")
+    parser.add_argument("--compression", default="none", choices=sorted(COMPRESSION))
+    args = parser.parse_args()
+
+    with open(args.firmware, "rb") as f:
+        image = f.read()
+    if not image:
+        print("error: firmware image is empty", file=sys.stderr)
+        return 1
+
+    # The device strips a leading "v" from the manifest version before comparing.
+    version = args.version[1:] if args.version.startswith("v") else args.version
+    compression = COMPRESSION[args.compression]
+
+    # The signature length is part of the signed header, so sign once to learn
+    # it and again over the final header. RSA lengths are fixed; ECDSA DER
+    # signatures can vary by a byte, so retry until the length is stable.
+    sig_len = 0
+    for _ in range(32):
+        header = build_header(image, version, sig_len, compression)
+        signature = sign(header, args.key)
+        if len(signature) == sig_len:
+            break
+        sig_len = len(signature)
+    else:
+        print("error: could not produce a stable signature length", file=sys.stderr)
+        return 1
+
+    if sig_len > MAX_SIG_LEN:
+        print(f"error: signature is {sig_len} bytes, device accepts at most {MAX_SIG_LEN}", file=sys.stderr)
+        return 1
+
+    with open(args.out, "wb") as f:
+        f.write(header)
+        f.write(signature)
+        f.write(image)
+
+    print(f"Wrote {args.out}: version {version}, image {len(image)} bytes, signature {sig_len} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+"""Reference server for OTA manifests and artifacts.
+
+Serves a directory (manifest, firmware, signatures, bundles, delta files or
+anything else the manifest points at) over HTTP/1.1 with keep-alive. It
+stands in for GitHub Releases in tests and CI, and can run on site as a
+mirror. It needs no packages beyond the standard library. One asyncio loop
+handles all connections, and file contents are cached in memory, so a single
+process keeps up with a large fleet polling the manifest.
+
+Supported:
+  - GET and HEAD, with strong ETags and Last-Modified
+  - If-None-Match / If-Modified-Since (304)
+  - single byte ranges with If-Range (206 / 416)
+  - chunked transfer encoding for paths matching --chunked
+  - redirects (--redirect /releases/=https://cdn.example.com/ota/), like
+    GitHub's hop to its CDN
+  - per-connection and total bandwidth limits and an added response
+    latency (--rate, --total-rate, --latency)
+
+Devices refuse plain http:// unless the signed-manifest mode is on, so pass
+--cert/--key to serve HTTPS otherwise.
+
+Example:
+    python3 tools/ota_server.py --root release/ --port 8443 --cert cert.pem --key key.pem
+and in secrets/config.h:
+    #define MANIFEST_URL "https://192.168.1.10:8443/manifest.json"
+"""
+
+import argparse
+import asyncio
+import email.utils
+import fnmatch
+import hashlib
+import os
+import ssl
+import sys
+import time
+import urllib.parse
+
+MAX_HEADER_BYTES = 16 * 1024
+IDLE_TIMEOUT_S = 30
+SEND_BLOCK = 16 * 1024
+CONTENT_TYPES = {".json": "application/json", ".sig": "application/octet-stream", ".bin": "application/octet-stream"}
+REASONS = {
+    200: "OK", 206: "Partial Content", 301: "Moved Permanently", 302: "Found", 304: "Not Modified",
+    307: "Temporary Redirect", 308: "Permanent Redirect", 400: "Bad Request", 404: "Not Found",
+    405: "Method Not Allowed", 416: "Range Not Satisfiable", 431: "Request Header Fields Too Large",
+}
+
+
+class FileCache:
+    """Whole-file cache keyed by path; an entry is reloaded when mtime or size change."""
+
+    def __init__(self, root: str):
+        self.root = os.path.realpath(root)
+        self.entries = {}
+
+    def lookup(self, url_path: str):
+        """Returns (body, etag, mtime) for a URL path, or None."""
+        relative = urllib.parse.unquote(url_path).lstrip("/")
+        path = os.path.realpath(os.path.join(self.root, relative))
+        if path != self.root and not path.startswith(self.root + os.sep):
+            return None
+        try:
+            info = os.stat(path)
+        except OSError:
+            return None
+        if not os.path.isfile(path):
+            return None
+        entry = self.entries.get(path)
+        if entry is None or entry[2] != info.st_mtime or len(entry[0]) != info.st_size:
+            with open(path, "rb") as f:
+                body = f.read()
+            etag = '"' + hashlib.sha256(body).hexdigest()[:32] + '"'
+            entry = (body, etag, info.st_mtime)
+            self.entries[path] = entry
+        return entry
+
+
+class TokenBucket:
+    """Shared byte budget refilled at `rate` bytes per second."""
+
+    def __init__(self, rate: float):
+        self.rate = rate
+        self.tokens = rate
+        self.stamp = time.monotonic()
+
+    async def take(self, count: int):
+        while True:
+            now = time.monotonic()
+            self.tokens = min(self.rate, self.tokens + (now - self.stamp) * self.rate)
+            self.stamp = now
+            if self.tokens >= count:
+                self.tokens -= count
+                return
+            await asyncio.sleep((count - self.tokens) / self.rate)
+
+
+class Server:
+    def __init__(self, args):
+        self.cache = FileCache(args.root)
+        self.redirects = []
+        for rule in args.redirect:
+            source, _, target = rule.partition("=")
+            if not source.startswith("/") or not target:
+                raise ValueError(f"bad --redirect rule: {rule}")
+            self.redirects.append((source, target))
+        self.redirect_status = args.redirect_status
+        self.redirect_max_age = args.redirect_max_age
+        self.chunked = args.chunked
+        self.rate = args.rate * 1024 if args.rate else None
+        self.total = TokenBucket(args.total_rate * 1024) if args.total_rate else None
+        self.latency = args.latency / 1000.0
+        self.quiet = args.quiet
+        self.connections = 0
+        self.peak_connections = 0
+
+    async def handle_connection(self, reader, writer):
+        self.connections += 1
+        self.peak_connections = max(self.peak_connections, self.connections)
+        peer = writer.get_extra_info("peername")
+        client = peer[0] if peer else "-"
+        try:
+            while await self.handle_request(reader, writer, client):
+                pass
+        except (ConnectionError, asyncio.IncompleteReadError, asyncio.TimeoutError, asyncio.LimitOverrunError):
+            pass
+        finally:
+            self.connections -= 1
+            writer.close()
+
+    async def handle_request(self, reader, writer, client) -> bool:
+        """Serves one request; returns whether the connection stays open."""
+        try:
+            head = await asyncio.wait_for(reader.readuntil(b"\r\n\r\n"), IDLE_TIMEOUT_S)
+        except asyncio.LimitOverrunError:
+            await self.send(writer, 431, [], b"", keep_alive=False)
+            return False
+        lines = head.decode("latin-1").split("\r\n")
+        parts = lines[0].split(" ")
+        if len(parts) != 3 or not parts[2].startswith("HTTP/1."):
+            await self.send(writer, 400, [], b"", keep_alive=False)
+            return False
+        method, target, version = parts
+        headers = {}
+        for line in lines[1:]:
+            name, sep, value = line.partition(":")
+            if sep:
+                headers[name.strip().lower()] = value.strip()
+        body_length = int(headers.get("content-length", "0") or 0)
+        if body_length:
+            await reader.readexactly(body_length)
+
+        connection = headers.get("connection", "").lower()
+        keep_alive = connection != "close" if version == "HTTP/1.1" else connection == "keep-alive"
+        path = urllib.parse.urlsplit(target).path
+
+        if self.latency:
+            await asyncio.sleep(self.latency)
+        status, response_headers, body, chunked = self.respond(method, path, headers)
+        sent = await self.send(writer, status, response_headers, body if method != "HEAD" else b"",
+                               keep_alive=keep_alive, chunked=chunked, length=len(body))
+        if not self.quiet:
+            print(f"{client} \"{method} {target}\" {status} {sent}", file=sys.stderr)
+        return keep_alive
+
+    def respond(self, method, path, headers):
+        """Returns (status, headers, body, chunked) for one request."""
+        if method not in ("GET", "HEAD"):
+            return 405, [("Allow", "GET, HEAD")], b"", False
+
+        for source, target in self.redirects:
+            if path.startswith(source):
+                location = target + path[len(source):]
+                extra = [("Location", location)]
+                if self.redirect_max_age is not None:
+                    extra.append(("Cache-Control", f"max-age={self.redirect_max_age}"))
+                return self.redirect_status, extra, b"", False
+
+        entry = self.cache.lookup(path)
+        if entry is None:
+            return 404, [("Content-Type", "text/plain")], b"not found\n", False
+        content, etag, mtime = entry
+        validators = [
+            ("ETag", etag),
+            ("Last-Modified", email.utils.formatdate(mtime, usegmt=True)),
+            ("Accept-Ranges", "bytes"),
+            ("Content-Type", CONTENT_TYPES.get(os.path.splitext(path)[1], "application/octet-stream")),
+        ]
+
+        if not_modified(headers, etag, mtime):
+            return 304, validators[:2], b"", False
+
+        range_header = headers.get("range")
+        if range_header and headers.get("if-range", etag) in (etag, validators[1][1]):
+            span = parse_range(range_header, len(content))
+            if span is None:
+                return 416, [("Content-Range", f"bytes */{len(content)}")], b"", False
+            first, last = span
+            return 206, validators + [("Content-Range", f"bytes {first}-{last}/{len(content)}")], \
+                content[first:last + 1], False
+
+        chunked = any(fnmatch.fnmatch(path, pattern) for pattern in self.chunked)
+        return 200, validators, content, chunked
+
+    async def send(self, writer, status, headers, body, keep_alive, chunked=False, length=None):
+        """Writes one response at the configured rate; returns the body bytes sent."""
+        lines = [f"HTTP/1.1 {status} {REASONS.get(status, 'Status')}"]
+        lines += [f"{name}: {value}" for name, value in headers]
+        if chunked:
+            lines.append("Transfer-Encoding: chunked")
+        elif status != 304:
+            lines.append(f"Content-Length: {len(body) if length is None or body else length}")
+        lines.append("Connection: " + ("keep-alive" if keep_alive else "close"))
+        writer.write(("\r\n".join(lines) + "\r\n\r\n").encode("latin-1"))
+
+        started = time.monotonic()
+        sent = 0
+        while sent < len(body):
+            block = body[sent:sent + SEND_BLOCK]
+            if self.total:
+                await self.total.take(len(block))
+            writer.write(b"%x\r\n%s\r\n" % (len(block), block) if chunked else block)
+            sent += len(block)
+            await writer.drain()
+            if self.rate:
+                ahead = sent / self.rate - (time.monotonic() - started)
+                if ahead > 0:
+                    await asyncio.sleep(ahead)
+        if chunked and body:
+            writer.write(b"0\r\n\r\n")
+        await writer.drain()
+        return sent
+
+
+def not_modified(headers, etag, mtime) -> bool:
+    if "if-none-match" in headers:
+        tags = [tag.strip() for tag in headers["if-none-match"].split(",")]
+        return "*" in tags or etag in tags or ("W/" + etag) in tags
+    if "if-modified-since" in headers:
+        try:
+            since = email.utils.parsedate_to_datetime(headers["if-modified-since"]).timestamp()
+        except (TypeError, ValueError):
+            return False
+        return int(mtime) <= since
+    return False
+
+
+def parse_range(value: str, size: int):
+    """Returns (first, last) for a single "bytes=" range, or None if unsatisfiable."""
+    unit, _, spec = value.partition("=")
+    if unit.strip() != "bytes" or "," in spec or size == 0:
+        return None
+    start, _, end = spec.strip().partition("-")
+    try:
+        if start == "":
+            suffix = int(end)
+            if suffix == 0:
+                return None
+            return max(0, size - suffix), size - 1
+        first = int(start)
+        last = int(end) if end else size - 1
+    except ValueError:
+        return None
+    if first >= size or last < first:
+        return None
+    return first, min(last, size - 1)
+
+
+async def serve(args) -> None:
+    server = Server(args)
+    context = None
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+    listener = await asyncio.start_server(server.handle_connection, args.host, args.port, ssl=context,
+                                          limit=MAX_HEADER_BYTES, backlog=args.backlog)
+    scheme = "https" if context else "http"
+    print(f"Serving {args.root} on {scheme}://{args.host}:{args.port}/", file=sys.stderr)
+    try:
+        async with listener:
+            await listener.serve_forever()
+    finally:
+        print(f"Peak concurrent connections: {server.peak_connections}", file=sys.stderr)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--root", default=".", help="directory to serve")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--cert", help="PEM certificate; serves HTTPS together with --key")
+    parser.add_argument("--key", help="PEM private key")
+    parser.add_argument("--redirect", action="append", default=[], metavar="PREFIX=TARGET",
+                        help="answer paths under PREFIX with a redirect to TARGET + rest of path")
+    parser.add_argument("--redirect-status", type=int, default=302, choices=(301, 302, 307, 308))
+    parser.add_argument("--redirect-max-age", type=int, help="Cache-Control max-age on redirects")
+    parser.add_argument("--chunked", action="append", default=[], metavar="GLOB",
+                        help="send matching paths with chunked encoding instead of Content-Length")
+    parser.add_argument("--rate", type=float, help="per-connection limit, KB/s")
+    parser.add_argument("--total-rate", type=float, help="limit over all connections, KB/s")
+    parser.add_argument("--latency", type=float, default=0, help="delay before each response, ms")
+    parser.add_argument("--backlog", type=int, default=1024)
+    parser.add_argument("--quiet", action="store_true", help="no access log")
+    args = parser.parse_args()
+    if bool(args.cert) != bool(args.key):
+        parser.error("--cert and --key go together")
+    if not os.path.isdir(args.root):
+        parser.error(f"{args.root} is not a directory")
+
+    try:
+        asyncio.run(serve(args))
+    except KeyboardInterrupt:
+        pass
+    except ValueError as error:
+        print(error, file=sys.stderr)
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
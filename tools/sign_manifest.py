@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Stamp and sign manifest.json for the signed-manifest (plain HTTP) mode.
+
+Sets the anti-replay fields the device checks before trusting a manifest:
+
+    "sequence"  - increases with every published manifest
+    "timestamp" - Unix time the manifest was signed
+
+and, with --firmware, the image the manifest's file_url points at:
+
+    "sha256"    - hex SHA-256 of the firmware image
+    "size"      - its length in bytes
+
+A manifest that uses file_url + signature_url must carry both: the image
+signature alone does not say which version it is. A bundle_url manifest does
+not need them; the bundle's signed header pins its own image.
+
+It then writes a detached signature next to it (manifest.json.sig by default),
+signed with the same private key as the firmware.
+
+Example:
+    python3 tools/sign_manifest.py --manifest manifest.json --key private.pem --firmware firmware.bin
+"""
+
+import argparse
+import hashlib
+import json
+import subprocess
+import sys
+import time
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--manifest", default="manifest.json")
+    parser.add_argument("--key", required=True, help="PEM private key matching PUBLIC_KEY in config.h")
+    parser.add_argument("--sequence", type=int, help="explicit sequence number (default: previous + 1)")
+    parser.add_argument("--signature", help="signature output path (default: <manifest>.sig)")
+    parser.add_argument("--firmware", help="firmware image named by file_url; sets sha256 and size")
+    args = parser.parse_args()
+
+    with open(args.manifest) as f:
+        manifest = json.load(f)
+
+    previous = int(manifest.get("sequence", 0))
+    sequence = args.sequence if args.sequence is not None else previous + 1
+    if sequence <= 0:
+        print("error: sequence must be positive", file=sys.stderr)
+        return 1
+    if sequence < previous:
+        print(f"warning: sequence {sequence} is lower than the previous {previous}; devices will reject it",
+              file=sys.stderr)
+
+    if args.firmware:
+        with open(args.firmware, "rb") as f:
+            image = f.read()
+        manifest["sha256"] = hashlib.sha256(image).hexdigest()
+        manifest["size"] = len(image)
+    if "file_url" in manifest and "bundle_url" not in manifest and not ("sha256" in manifest and "size" in manifest):
+        print("error: file_url needs sha256 and size in a signed manifest; pass --firmware", file=sys.stderr)
+        return 1
+
+    manifest["sequence"] = sequence
+    manifest["timestamp"] = int(time.time())
+
+    # The device verifies the exact bytes it downloads, so sign the file as written
+    with open(args.manifest, "w") as f:
+        json.dump(manifest, f, indent=2)
+        f.write("\n")
+
+    signature_path = args.signature or args.manifest + ".sig"
+    subprocess.run(
+        ["openssl", "dgst", "-sha256", "-sign", args.key, "-out", signature_path, args.manifest],
+        check=True,
+    )
+
+    if len(json.dumps(manifest, indent=2)) + 1 > 1024:
+        print("warning: manifest exceeds the 1024 bytes the device accepts", file=sys.stderr)
+
+    print(f"Signed {args.manifest}: sequence {sequence}, signature {signature_path}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Minimal collector for the OTA telemetry uplink.
+
+Accepts the batches that devices POST (layout in
+firmware/include/ota_uplink.h), decodes them and appends one JSON object per
+attempt record to a file or stdout. It is a stand-in for the real collector
+in tests and on the bench.
+
+Devices refuse plain http:// unless the signed-manifest mode is on, so pass
+--cert/--key to serve HTTPS otherwise.
+
+Example:
+    python3 tools/telemetry_collector.py --port 8443 --cert cert.pem --key key.pem \\
+        --out attempts.jsonl
+and in secrets/config.h:
+    #define OTA_COLLECTOR_URL "https://192.168.1.10:8443/ota/telemetry"
+"""
+
+import argparse
+import json
+import ssl
+import struct
+import sys
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+MAGIC = b"OTAT"
+FORMAT_V1 = 1
+HEADER = struct.Struct("<4sBBHII6sH32s")
+RECORD = struct.Struct("<III5IIIHBB")
+PHASES = ("manifest", "download", "signature", "verify", "finalize")
+FLAG_DOWNLOAD_STARTED = 0x01
+FLAG_UPDATE_SUCCEEDED = 0x02
+
+
+def decode_batch(data: bytes) -> list:
+    """Returns one dict per record; raises ValueError on a malformed batch."""
+    if len(data) < HEADER.size:
+        raise ValueError("batch shorter than its header")
+    magic, fmt, record_size, count, sequence, overwritten, mac, _, version = HEADER.unpack_from(data)
+    if magic != MAGIC or fmt != FORMAT_V1:
+        raise ValueError("not an OTA telemetry batch")
+    if record_size < RECORD.size or len(data) != HEADER.size + count * record_size:
+        raise ValueError("record size or count does not match the body length")
+
+    device = {
+        "mac": ":".join(f"{b:02x}" for b in mac),
+        "firmware": version.rstrip(b"\0").decode("ascii", "replace"),
+        "batch": sequence,
+        "overwritten": overwritten,
+    }
+    records = []
+    for index in range(count):
+        fields = RECORD.unpack_from(data, HEADER.size + index * record_size)
+        uptime, unix_time, total_ms = fields[0:3]
+        phase_ms = fields[3:8]
+        download_ms, received, stalls, error, flags = fields[8:13]
+        records.append({
+            **device,
+            "uptime_s": uptime,
+            "time": unix_time or None,
+            "total_ms": total_ms,
+            "phase_ms": dict(zip(PHASES, phase_ms)),
+            "download_ms": download_ms,
+            "bytes": received,
+            "throughput_bps": received * 1000 // download_ms if download_ms else None,
+            "stalls": stalls,
+            "error": error,
+            "download_started": bool(flags & FLAG_DOWNLOAD_STARTED),
+            "update_succeeded": bool(flags & FLAG_UPDATE_SUCCEEDED),
+        })
+    return records
+
+
+def make_handler(out):
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            length = int(self.headers.get("Content-Length", 0))
+            try:
+                records = decode_batch(self.rfile.read(length))
+            except ValueError as error:
+                self.send_error(400, str(error))
+                return
+            for record in records:
+                out.write(json.dumps(record) + "\n")
+            out.flush()
+            self.send_response(204)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+
+        def log_message(self, format, *args):
+            print(f"{self.client_address[0]} {format % args}", file=sys.stderr)
+
+    return Handler
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--cert", help="PEM certificate; serves HTTPS together with --key")
+    parser.add_argument("--key", help="PEM private key")
+    parser.add_argument("--out", help="append JSON lines here instead of stdout")
+    args = parser.parse_args()
+
+    out = open(args.out, "a", encoding="utf-8") if args.out else sys.stdout
+    server = ThreadingHTTPServer((args.host, args.port), make_handler(out))
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+    print(f"Collecting OTA telemetry on {'https' if args.cert else 'http'}://{args.host}:{args.port}/", file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())